@@ -1,7 +1,9 @@
 // MQTT_Lib.cpp - Implementation file for MQTT Library
 #include "MQTT_Lib.h"
 #include <WiFi.h>
+#include <Dns.h>
 #include "RTCManager.h"
+#include "mqtt_spool.h"
 
 // Declare external rtc instance from iotboard.h
 extern RTCManager rtc;
@@ -23,41 +25,427 @@ void MQTT_Lib::setMacAddress(String temp_mac){
 String MQTT_Lib::getMacAddress(){
     return macAddress;
 }
-// Generate full topic string based on configuration
-// Update the getTopic function with flexible key validation
-
-String MQTT_Lib::getTopic(String request) {
-    String temp_topic = "empty";
-
+// Build "company/location/department/line/machine/" into topic_prefix.
+// Fields not set through setsubtopic() come from the subtopics namespace;
+// this is the only place that opens it. Publishers on other tasks copy the
+// prefix, so it is only rewritten under the network lock.
+void MQTT_Lib::buildTopicPrefix() {
+    lockNetwork();
     if(cached_company.length() == 0 || cached_location.length() == 0 || cached_department.length() == 0 || cached_line.length() == 0 || cached_machine.length() == 0) {
         subtopicsPref.begin("subtopics", true);
-        cached_company = subtopicsPref.getString("company", "embedsol");
-        cached_location = subtopicsPref.getString("location", "bhosari");
-        cached_department = subtopicsPref.getString("department", "production");
-        cached_line = subtopicsPref.getString("line", "test");
-        cached_machine = subtopicsPref.getString("machine", "testmachine");
+        if(cached_company.length() == 0) cached_company = subtopicsPref.getString("company", "embedsol");
+        if(cached_location.length() == 0) cached_location = subtopicsPref.getString("location", "bhosari");
+        if(cached_department.length() == 0) cached_department = subtopicsPref.getString("department", "production");
+        if(cached_line.length() == 0) cached_line = subtopicsPref.getString("line", "test");
+        if(cached_machine.length() == 0) cached_machine = subtopicsPref.getString("machine", "testmachine");
         subtopicsPref.end();
     }
-    
-    temp_topic = "";
-    temp_topic += cached_company;
-    temp_topic += "/";
-    temp_topic += cached_location; 
-    temp_topic += "/";
-    temp_topic += cached_department;
-    temp_topic += "/";
-    temp_topic += cached_line;
-    temp_topic += "/";
-    temp_topic += cached_machine;
-    temp_topic += "/";
-    
-    if(temp_topic.length() == 0 || temp_topic == "//////") {
-        return "empty";
+
+    int len = snprintf(topic_prefix, sizeof(topic_prefix), "%s/%s/%s/%s/%s/", cached_company.c_str(), cached_location.c_str(),
+                       cached_department.c_str(), cached_line.c_str(), cached_machine.c_str());
+    if(len < 0 || len >= (int)sizeof(topic_prefix)) {
+        Serial.println("[MQTT] ✗ Topic prefix too long, truncated");
+        len = sizeof(topic_prefix) - 1;
     }
-    
-    temp_topic += request;
-    
-    return temp_topic;
+    topic_prefix_len = len;
+    topic_prefix_valid = true;
+    unlockNetwork();
+}
+
+const char* MQTT_Lib::getTopicPrefix() {
+    if(!topic_prefix_valid) buildTopicPrefix();
+    return topic_prefix;
+}
+
+// Prefix + suffix into a caller's MQTT_TOPIC_MAX_LEN buffer (on its stack),
+// logged and nullptr if too long
+const char* MQTT_Lib::topicWithSuffix(const char* suffix, char* buffer) {
+    const char* topic = getTopic(suffix, buffer, MQTT_TOPIC_MAX_LEN);
+    if(!topic) Serial.printf("[MQTT] ✗ Topic too long: %s\n", suffix);
+    return topic;
+}
+
+// Generate full topic string based on configuration
+String MQTT_Lib::getTopic(String request) {
+    char buffer[MQTT_TOPIC_MAX_LEN];
+    const char* topic = getTopic(request.c_str(), buffer, sizeof(buffer));
+    return topic ? String(topic) : String();
+}
+
+const char* MQTT_Lib::getTopic(const char* suffix, char* buffer, size_t size) {
+    if(!topic_prefix_valid) buildTopicPrefix();
+    size_t suffixLen = strlen(suffix);
+    lockNetwork();      // setsubtopic() may be rebuilding the prefix
+    size_t prefixLen = topic_prefix_len;
+    bool fits = prefixLen + suffixLen < size;
+    if(fits) memcpy(buffer, topic_prefix, prefixLen);
+    unlockNetwork();
+    if(!fits) return nullptr;
+    memcpy(&buffer[prefixLen], suffix, suffixLen + 1);
+    return buffer;
+}
+
+// Publish to prefix + suffix without building a String
+bool MQTT_Lib::publishSuffix(const char* suffix, const char* payload, bool retained) {
+    return publishSuffix(suffix, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool MQTT_Lib::publishSuffix(const char* suffix, const uint8_t* payload, unsigned int length, bool retained) {
+    if(conn_state != MQTT_STATE_READY) return false;
+    if(!lockNetwork(MQTT_LOCK_WAIT_MS)) return queueBusy(suffix, payload, length, retained);
+    char topicBuffer[MQTT_TOPIC_MAX_LEN];
+    const char* topic = topicWithSuffix(suffix, topicBuffer);
+    bool ok = topic && PubSubClient::publish(topic, payload, length, retained);
+    unlockNetwork();
+    return ok;
+}
+
+// Full-topic publish. Hides PubSubClient::publish() so callers outside the
+// MQTT task go through the network lock too.
+bool MQTT_Lib::publish(const char* topic, const char* payload, bool retained) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool MQTT_Lib::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    if(conn_state != MQTT_STATE_READY || !lockNetwork(MQTT_LOCK_WAIT_MS)) return false;
+    bool ok = PubSubClient::publish(topic, payload, length, retained);
+    unlockNetwork();
+    return ok;
+}
+
+// Streamed publish: the length comes from measurePayload() and the document
+// is serialised through a small chunk buffer straight into the socket, so
+// the payload is never held in memory and may exceed the PubSubClient
+// buffer. A write failure leaves a half-sent packet, so the connection is
+// dropped and the state machine reconnects.
+bool MQTT_Lib::streamJson(const char* topic, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    size_t length = measurePayload(doc, encoding);
+    if(!PubSubClient::beginPublish(topic, length, retained)) return false;
+    MQTTBufferedPrint out(*this);
+    serializePayload(doc, out, encoding);
+    out.flush();
+    if(out.failed || out.written != length || !PubSubClient::endPublish()) {
+        Serial.printf("[MQTT] ✗ Streamed publish failed after %u of %u bytes\n", (unsigned)out.written, (unsigned)length);
+        tap.stop();
+        return false;
+    }
+    return true;
+}
+
+bool MQTT_Lib::publishJson(const char* suffix, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    if(conn_state != MQTT_STATE_READY) return false;
+    if(!lockNetwork(MQTT_LOCK_WAIT_MS)) return queueBusyJson(suffix, doc, retained, encoding);
+    char topicBuffer[MQTT_TOPIC_MAX_LEN];
+    const char* topic = topicWithSuffix(suffix, topicBuffer);
+    bool ok = topic && streamJson(topic, doc, retained, encoding);
+    unlockNetwork();
+    return ok;
+}
+
+bool MQTT_Lib::publishJsonTo(const char* topic, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    if(conn_state != MQTT_STATE_READY || !lockNetwork(MQTT_LOCK_WAIT_MS)) return false;
+    bool ok = streamJson(topic, doc, retained, encoding);
+    unlockNetwork();
+    return ok;
+}
+
+// Like publishSpooled(): streamed when online with no backlog, otherwise
+// serialised once into the spool
+bool MQTT_Lib::publishSpooledJson(const char* suffix, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    if (!lockNetwork(MQTT_LOCK_WAIT_MS)) return queueBusyJson(suffix, doc, retained, encoding);
+    bool queued = hasSpool() && spool->pending();
+    bool ok = false;
+    if (!queued && conn_state == MQTT_STATE_READY) {
+        ok = publishJson(suffix, doc, retained, encoding);
+    }
+    if (!ok && hasSpool()) {
+        size_t length = measurePayload(doc, encoding);
+        uint8_t* payload = (length <= MQTT_SPOOL_MAX_PAYLOAD) ? (uint8_t*)malloc(length + 1) : nullptr;
+        char topicBuffer[MQTT_TOPIC_MAX_LEN];
+        const char* topic = payload ? topicWithSuffix(suffix, topicBuffer) : nullptr;
+        if (topic) {
+            serializePayload(doc, payload, length + 1, encoding);
+            ok = spool->push(topic, payload, length, retained);
+        }
+        free(payload);
+    }
+    unlockNetwork();
+    return ok;
+}
+
+void MQTT_Lib::setSpool(MQTTSpool* _spool) {
+    spool = _spool;
+    if (spool) spool->setPacketLimit(getBufferSize());
+}
+
+bool MQTT_Lib::hasSpool() {
+    return spool && spool->isReady();
+}
+
+// Publish now if connected and nothing older is waiting; otherwise append
+// to the spool so messages reach the broker in order. Returns false only if
+// the message was neither sent nor stored.
+bool MQTT_Lib::publishSpooled(const char* suffix, const char* payload, bool retained) {
+    if (!lockNetwork(MQTT_LOCK_WAIT_MS)) return queueBusy(suffix, (const uint8_t*)payload, strlen(payload), retained);
+    size_t length = strlen(payload);
+    bool queued = hasSpool() && spool->pending();
+    bool ok = false;
+    if (!queued && conn_state == MQTT_STATE_READY) {
+        ok = publishSuffix(suffix, (const uint8_t*)payload, length, retained);
+    }
+    if (!ok && hasSpool()) {
+        char topicBuffer[MQTT_TOPIC_MAX_LEN];
+        const char* topic = topicWithSuffix(suffix, topicBuffer);
+        if (topic) ok = spool->push(topic, (const uint8_t*)payload, length, retained);
+    }
+    unlockNetwork();
+    return ok;
+}
+
+void MQTT_Lib::setQueue(MQTTPublishQueue* _queue) {
+    queue = _queue;
+    if (queue) queue->setConsumer(task_handle);
+}
+
+MQTTPublishQueue* MQTT_Lib::getQueue() {
+    return queue;
+}
+
+// Hand a message to the MQTT task. The suffix is copied into the queue's
+// topic table on first use; false if the table is full or the ring
+// refused the message.
+bool MQTT_Lib::enqueue(const char* suffix, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!queue || !queue->isReady()) return false;
+    int8_t id = queue->addTopic(suffix);
+    if (id < 0) return false;
+    return queue->push(id, payload, length, retained);
+}
+
+// Serialise straight into a ring slot; false if it does not fit or the
+// queue dropped it
+bool MQTT_Lib::enqueueJson(const char* suffix, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    if (!queue || !queue->isReady()) return false;
+    int8_t id = queue->addTopic(suffix);
+    if (id < 0) return false;
+    size_t length = measurePayload(doc, encoding);
+    if (length >= queue->slotBytes()) return false;     // Room for the terminator too
+    uint16_t slotBytes = queue->slotBytes();
+    return queue->pushWith(id, length, retained, [&doc, slotBytes, encoding](uint8_t* slot) {
+        serializePayload(doc, slot, slotBytes, encoding);
+    });
+}
+
+// The network lock stayed busy past MQTT_LOCK_WAIT_MS: hand the message to
+// the publish queue rather than drop it. Its drain spools it if needed, so
+// this also covers the spooled calls. Without a queue the caller gets false
+// and the miss shows in busySkips().
+bool MQTT_Lib::queueBusy(const char* suffix, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!enqueue(suffix, payload, length, retained)) return false;
+    lock_queued++;
+    return true;
+}
+
+bool MQTT_Lib::queueBusyJson(const char* suffix, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    if (!enqueueJson(suffix, doc, retained, encoding)) return false;
+    lock_queued++;
+    return true;
+}
+
+// Publish what producers queued, straight from the ring slots. Behind a
+// spool backlog, or while offline with a spool, messages go to the spool
+// instead so their order is kept; offline without one they wait in the ring.
+void MQTT_Lib::drainQueue() {
+    if (!queue || !queue->isReady()) return;
+    bool online = (conn_state == MQTT_STATE_READY);
+    if (!online && !hasSpool()) return;
+    for (uint8_t i = 0; i < MQTT_QUEUE_DRAIN_MAX; i++) {
+        bool popped = queue->pop([this, online](const char* suffix, const uint8_t* payload, uint16_t length, bool retained) {
+            bool spooled = hasSpool() && (!online || spool->pending());
+            bool ok = false;
+            if (!spooled) ok = publishSuffix(suffix, payload, length, retained);
+            if (!ok && hasSpool()) {
+                char topicBuffer[MQTT_TOPIC_MAX_LEN];
+                const char* topic = topicWithSuffix(suffix, topicBuffer);
+                if (topic) ok = spool->push(topic, payload, length, retained);
+            }
+            if (!ok) queue_failures++;
+        });
+        if (!popped) break;
+    }
+}
+
+// ==================== QOS 1 ====================
+
+// Copy the topic into a free in-flight slot and return where the payload
+// goes; nullptr when the window is full. Caller holds the network lock.
+uint8_t* MQTT_Lib::inflightReserve(const char* topic, uint32_t length, bool retained) {
+    size_t topicLen = strlen(topic);
+    if (inflight_used >= inflight_window || topicLen > 0xFFFF) {
+        qos1_rejected++;
+        return nullptr;
+    }
+    MQTTInflight* slot = nullptr;
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX && !slot; i++) {
+        if (!inflight[i].data) slot = &inflight[i];
+    }
+    if (!slot) return nullptr;
+    slot->data = (uint8_t*)malloc(topicLen + length + 1);
+    if (!slot->data) {
+        qos1_rejected++;
+        return nullptr;
+    }
+    memcpy(slot->data, topic, topicLen);
+
+    // Ids from the top half so they never collide with PubSubClient's
+    // own SUBSCRIBE ids; skip any still waiting for a PUBACK
+    bool inUse;
+    do {
+        next_packet_id = (next_packet_id == 0xFFFF) ? 0x8000 : next_packet_id + 1;
+        inUse = false;
+        for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++) {
+            if (inflight[i].data && &inflight[i] != slot && inflight[i].packetId == next_packet_id) inUse = true;
+        }
+    } while (inUse);
+
+    slot->packetId = next_packet_id;
+    slot->topicLen = topicLen;
+    slot->length = length;
+    slot->retained = retained;
+    slot->order = inflight_order++;
+    slot->sent = false;
+    slot->dup = false;
+    inflight_used++;
+    return slot->data + topicLen;
+}
+
+// Raw QoS 1 PUBLISH, since PubSubClient only sends QoS 0. Goes through
+// PubSubClient::write() so the keep-alive timer sees the traffic.
+bool MQTT_Lib::sendInflight(MQTTInflight& msg) {
+    uint32_t remaining = 2 + msg.topicLen + 2 + msg.length;
+    uint8_t header[5];
+    uint8_t pos = 0;
+    header[pos++] = 0x32 | (msg.dup ? 0x08 : 0) | (msg.retained ? 0x01 : 0);
+    do {
+        uint8_t digit = remaining & 0x7F;
+        remaining >>= 7;
+        header[pos++] = remaining ? (digit | 0x80) : digit;
+    } while (remaining);
+
+    MQTTBufferedPrint out(*this);
+    out.write(header, pos);
+    out.write((uint8_t)(msg.topicLen >> 8));
+    out.write((uint8_t)(msg.topicLen & 0xFF));
+    out.write(msg.data, msg.topicLen);
+    out.write((uint8_t)(msg.packetId >> 8));
+    out.write((uint8_t)(msg.packetId & 0xFF));
+    out.write(msg.data + msg.topicLen, msg.length);
+    out.flush();
+    if (out.failed) {
+        Serial.printf("[MQTT] ✗ QoS 1 publish %u failed\n", msg.packetId);
+        tap.stop();     // Half-sent packet; reconnect and resend with DUP
+        return false;
+    }
+    msg.sent = true;
+    msg.sentAt = millis();
+    return true;
+}
+
+// Send what is still unsent, oldest first, and reconnect if the broker
+// sits on a PUBACK for too long. Called from the READY step.
+void MQTT_Lib::serviceInflight() {
+    if (inflight_used == 0) return;
+    while (true) {
+        MQTTInflight* next = nullptr;
+        for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++) {
+            MQTTInflight& msg = inflight[i];
+            if (!msg.data) continue;
+            if (msg.sent) {
+                // Signed: a message sent during this call has sentAt after
+                // any time read before the send
+                if ((int32_t)(millis() - msg.sentAt) >= MQTT_PUBACK_TIMEOUT_MS) {
+                    fail("No PUBACK", MQTT_CONNECTION_TIMEOUT);
+                    return;
+                }
+            } else if (!next || (int32_t)(msg.order - next->order) < 0) {
+                next = &msg;
+            }
+        }
+        if (!next) return;
+        if (next->dup) qos1_resent++;
+        if (!sendInflight(*next)) return;
+    }
+}
+
+// PUBACK releases the message; called by the tap from inside loop()
+void MQTT_Lib::onPacket(void* ctx, uint8_t type, const uint8_t* head, uint8_t headLen) {
+    if (type != MQTT_PKT_PUBACK || headLen < 2) return;
+    MQTT_Lib* self = (MQTT_Lib*)ctx;
+    uint16_t id = ((uint16_t)head[0] << 8) | head[1];
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++) {
+        MQTTInflight& msg = self->inflight[i];
+        if (!msg.data || msg.packetId != id || !msg.sent) continue;
+        free(msg.data);
+        msg.data = nullptr;
+        self->inflight_used--;
+        self->qos1_acked++;
+        return;
+    }
+}
+
+// Accepted while offline too, as long as the window has room; the message
+// goes out once the connection is up
+bool MQTT_Lib::publishQos1To(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!lockNetwork(MQTT_LOCK_WAIT_MS)) return false;
+    uint8_t* slot = inflightReserve(topic, length, retained);
+    if (slot) {
+        memcpy(slot, payload, length);
+        if (conn_state == MQTT_STATE_READY) serviceInflight();
+    }
+    unlockNetwork();
+    return slot != nullptr;
+}
+
+bool MQTT_Lib::publishQos1(const char* suffix, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!lockNetwork(MQTT_LOCK_WAIT_MS)) return false;
+    char topicBuffer[MQTT_TOPIC_MAX_LEN];
+    const char* topic = topicWithSuffix(suffix, topicBuffer);
+    bool ok = topic && publishQos1To(topic, payload, length, retained);
+    unlockNetwork();
+    return ok;
+}
+
+bool MQTT_Lib::publishQos1(const char* suffix, const char* payload, bool retained) {
+    return publishQos1(suffix, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+// Serialised once into the in-flight slot, which is kept for resends
+bool MQTT_Lib::publishQos1Json(const char* suffix, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding) {
+    if (!lockNetwork(MQTT_LOCK_WAIT_MS)) return false;
+    size_t length = measurePayload(doc, encoding);
+    char topicBuffer[MQTT_TOPIC_MAX_LEN];
+    const char* topic = topicWithSuffix(suffix, topicBuffer);
+    uint8_t* slot = topic ? inflightReserve(topic, length, retained) : nullptr;
+    if (slot) {
+        serializePayload(doc, slot, length + 1, encoding);
+        if (conn_state == MQTT_STATE_READY) serviceInflight();
+    }
+    unlockNetwork();
+    return slot != nullptr;
+}
+
+void MQTT_Lib::setInflightWindow(uint8_t window) {
+    if (window < 1) window = 1;
+    if (window > MQTT_INFLIGHT_MAX) window = MQTT_INFLIGHT_MAX;
+    inflight_window = window;   // Shrinking only stops new messages until enough are acknowledged
+}
+
+uint8_t MQTT_Lib::inflightCount() {
+    return inflight_used;
+}
+
+// Takes effect on the next connect
+void MQTT_Lib::setCleanSession(bool clean) {
+    clean_session = clean;
 }
 
 void MQTT_Lib::config(const char *ip, uint16_t port, const char *user, const char *password, const char *willMsg, Client &client) {
@@ -68,30 +456,55 @@ void MQTT_Lib::config(const char *ip, uint16_t port, const char *user, const cha
     Serial.print("MQTT PORT:");
     Serial.println(port);
     
-    PubSubClient::setClient(client);
+    tap.attach(&client);
+    tap.setPacketHook(onPacket, this);
+    PubSubClient::setClient(tap);
     PubSubClient::setServer(mqttIP, port); // Convert port from string to integer
     PubSubClient::setBufferSize(4096); // Reduced buffer size to prevent heap corruption (was 32000)
-    PubSubClient::setKeepAlive(15); // Keep-alive interval for connection (increased for stability)
+    if (spool) spool->setPacketLimit(getBufferSize());
+    PubSubClient::setKeepAlive(keep_alive); // Keep-alive interval for connection (increased for stability)
     PubSubClient::setSocketTimeout(5); // Socket timeout in seconds (increased for reliability)
   
+    mqtt_host = String(ip);
+    mqtt_port = port;
+    broker_resolved = mqttIP.fromString(ip);   // Names are resolved in the DNS step
+    broker_ip = mqttIP;
     
     mqtt_user = String(user);
     mqtt_password = String(password);
     will_message = String(willMsg);
 }
 
+// A W5500 client connects without blocking (see MQTTClientTap)
+void MQTT_Lib::config(const char *ip, uint16_t port, const char *user, const char *password, const char *willMsg, EthernetClient &client) {
+    config(ip, port, user, password, willMsg, static_cast<Client&>(client));
+    tap.attach(&client, &client);
+}
+
+// The socket belongs to whichever task runs service(), so the switch is
+// picked up there rather than done here
 void MQTT_Lib::setClient(Client &client){
-    PubSubClient::setClient(client);
+    if(tap.client() == &client) return;
+    pending_eth = nullptr;
+    pending_client = &client;
+}
+
+void MQTT_Lib::setClient(EthernetClient &client){
+    if(tap.client() == &client) return;
+    pending_eth = &client;
+    pending_client = &client;
 }
 
-// Start MQTT connection
+// Start connecting. Nothing waits here: the attempt is carried by the
+// following loop() calls (or MQTTTask); check connected() for the result.
 void MQTT_Lib::begin() {
     connect();
+    if (!task_handle) service();
 }
 
 // Configure MQTT topic details
 void MQTT_Lib::setsubtopic(const DynamicJsonDocument &obj) {
-    
+    lockNetwork();      // The cached fields are read when the prefix is rebuilt
     if(obj.containsKey("company")) cached_company = obj["company"].as<String>();
     if(obj.containsKey("company_name")) cached_company = obj["company_name"].as<String>();
     if(obj.containsKey("companyname")) cached_company = obj["companyname"].as<String>();
@@ -104,77 +517,446 @@ void MQTT_Lib::setsubtopic(const DynamicJsonDocument &obj) {
     if(obj.containsKey("machinename")) cached_machine = obj["machinename"].as<String>();
     if(obj.containsKey("machine_name")) cached_machine = obj["machine_name"].as<String>();
 
+    buildTopicPrefix();
+    unlockNetwork();
 }
 
 void MQTT_Lib::setsubscribeto(String _sub_to){
     sub_to = _sub_to;
 }
 
-// Attempt to connect to MQTT broker
-bool MQTT_Lib::connect() {
-    counter = 0;
-    String will_topic = getTopic("events/connection_status");
-    char buffer[200];
+String MQTT_Lib::getMacTopic(String request){
+    String temp_topic = "devices/" + macAddress + "/" + request;
+    return temp_topic;
+}
+
+
+// ==================== CONNECTION STATE MACHINE ====================
+
+static const char* const mqtt_state_names[] = { "idle", "dns", "tcp", "tcp wait", "connect", "subscribe", "ready", "backoff" };
+
+void MQTT_Lib::setState(MQTTConnState state) {
+    conn_state = state;
+    state_timer = millis();
+}
+
+// Drop the socket and schedule the next attempt: exponential backoff with
+// jitter so a fleet of gateways does not reconnect in lockstep after a
+// broker restart
+void MQTT_Lib::fail(const char* reason, int error) {
+    last_error = error;
+    tap.stop();
+    PubSubClient::connected();      // Let PubSubClient notice the closed socket
+    failures++;
+    uint32_t ceiling = MQTT_RECONNECT_MIN_MS << (failures > 6 ? 6 : failures - 1);
+    if(ceiling > MQTT_RECONNECT_MAX_MS) ceiling = MQTT_RECONNECT_MAX_MS;
+    backoff_ms = ceiling / 2 + random(ceiling / 2 + 1);
+    Serial.printf("[MQTT] ✗ %s (%d), retry in %lu ms\n", reason, error, (unsigned long)backoff_ms);
+    setState(MQTT_STATE_BACKOFF);
+}
+
+// MQTT 3.1.1 CONNECT with the options PubSubClient::connect() would use:
+// retained QoS 1 will, username and password, and a clean session unless
+// setCleanSession(false) asked for a persistent one. Written straight to the socket so the
+// CONNACK can be polled for.
+bool MQTT_Lib::sendConnect() {
+    char will_topic[MQTT_TOPIC_MAX_LEN];
+    if(!getTopic("events/connection_status", will_topic, sizeof(will_topic))) return false;
+    char will_msg[64];
     DynamicJsonDocument status(100);
     status["status"] = "disconnected"; // Mark as disconnected initially
-    
-    serializeJsonPretty(status, buffer);
-    
-    // Try to establish connection with MQTT broker
-    
-    if(!PubSubClient::connect(macAddress.c_str(), mqtt_user.c_str(), mqtt_password.c_str(), will_topic.c_str(), 1, true, buffer)) {
-        Serial.print(".");
-        Serial.print(PubSubClient::state()); // Print connection state
-            return false; // Exit if connection fails after multiple attempts
-        
+    serializeJsonPretty(status, will_msg);
+
+    const char* fields[5] = { macAddress.c_str(), will_topic, will_msg, mqtt_user.c_str(), mqtt_password.c_str() };
+    size_t remaining = 10;
+    for(uint8_t i = 0; i < 5; i++) remaining += 2 + strlen(fields[i]);
+    if(remaining > 0x3FFF || remaining + 3 > MQTT_CONNECT_MAX_LEN) return false;
+
+    uint8_t packet[MQTT_CONNECT_MAX_LEN];
+    size_t pos = 0;
+    packet[pos++] = 0x10;
+    if(remaining > 127) {
+        packet[pos++] = (remaining & 0x7F) | 0x80;
+        packet[pos++] = remaining >> 7;
+    } else {
+        packet[pos++] = remaining;
     }
-    Serial.println("Connected!");
-    
+    static const uint8_t protocol[7] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04 };
+    memcpy(&packet[pos], protocol, sizeof(protocol));
+    pos += sizeof(protocol);
+    packet[pos++] = 0xC0 | 0x20 | 0x08 | 0x04 | (clean_session ? 0x02 : 0);  // User, password, will retain, will QoS 1, will, clean session
+    packet[pos++] = keep_alive >> 8;
+    packet[pos++] = keep_alive & 0xFF;
+    for(uint8_t i = 0; i < 5; i++) {
+        size_t len = strlen(fields[i]);
+        packet[pos++] = len >> 8;
+        packet[pos++] = len & 0xFF;
+        memcpy(&packet[pos], fields[i], len);
+        pos += len;
+    }
+    return tap.client()->write(packet, pos) == pos;
+}
+
+// CONNACK accepted: replay PubSubClient::connect() against it so the
+// library's own session state is set, then subscribe
+void MQTT_Lib::finishConnect() {
+    tap.setPreload(connack, sizeof(connack));
+    tap.setSwallowWrites(true);
+    bool ok = PubSubClient::connect(macAddress.c_str(), mqtt_user.c_str(), mqtt_password.c_str());
+    tap.setSwallowWrites(false);
+    if(!ok) {
+        fail("CONNECT failed", PubSubClient::state());
+        return;
+    }
+    session_present = !clean_session && (connack[2] & 0x01);
+
+    // Anything written on the last connection may or may not have
+    // reached the broker: resend it with DUP once subscribed
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_MAX; i++) {
+        if (inflight[i].data && inflight[i].sent) {
+            inflight[i].sent = false;
+            inflight[i].dup = true;
+        }
+    }
+
+    uint32_t before = tap.subacks;
+    uint8_t sent = 0;
     // Subscribe to device-specific topic
-    PubSubClient::subscribe(String("devices/" + macAddress + "/+").c_str());
+    if(PubSubClient::subscribe(String("devices/" + macAddress + "/+").c_str())) sent++;
+    char sub_topic[MQTT_TOPIC_MAX_LEN];
+    if(getTopic(sub_to.c_str(), sub_topic, sizeof(sub_topic)) && PubSubClient::subscribe(sub_topic)) sent++;
+    if(sent < 2) {
+        fail("SUBSCRIBE failed", PubSubClient::state());
+        return;
+    }
+    subacks_expected = before + sent;
+    setState(MQTT_STATE_SUBSCRIBE);
+}
 
-    
-    PubSubClient::subscribe(getTopic(sub_to).c_str());
-    
-    
-    
-    // Mark as connected
-    status["status"] = "connected";
-    status["timestamp"] = rtc.getDateTime();
-    serializeJsonPretty(status, buffer);
-    PubSubClient::publish(getTopic("events/connection_status").c_str() , buffer,true) ;
-    // PubSubClient::publish(getTopic("status").c_str() , buffer) ;
+// Open the socket. A W5500 only records the address here and connects in
+// bounded attempts from MQTT_STATE_TCP_WAIT; other clients connect before
+// returning.
+void MQTT_Lib::startTcp() {
+    Serial.printf("[MQTT] Connecting to %s:%u\n", mqtt_host.c_str(), mqtt_port);
+    tap.reset();
+    if(!broker_resolved && tap.isW5500()) {
+        fail("Cannot resolve broker", MQTT_CONNECT_FAILED);
+        return;
+    }
+    bool ok = broker_resolved ? tap.beginConnect(broker_ip, mqtt_port) : tap.beginConnect(mqtt_host.c_str(), mqtt_port);
+    if(!ok) {
+        fail("TCP connect failed", MQTT_CONNECT_FAILED);
+        return;
+    }
+    setState(MQTT_STATE_TCP_WAIT);
+}
 
-    return true;
+// One step of the connection state machine; the caller holds the network
+// lock, so nothing here waits on the network
+void MQTT_Lib::serviceLocked() {
+    Client* next = pending_client;
+    if(next) {
+        EthernetClient* eth = pending_eth;
+        pending_client = nullptr;
+        if(conn_state != MQTT_STATE_IDLE && conn_state != MQTT_STATE_BACKOFF) {
+            tap.stop();
+            PubSubClient::connected();
+            Serial.println("[MQTT] Transport changed, reconnecting");
+        }
+        tap.attach(next, eth == next ? eth : nullptr);
+        if(conn_state != MQTT_STATE_IDLE) setState(MQTT_STATE_DNS);
+    }
+    if(!tap.client()) return;   // Not configured
+
+    if(!network_ready) {
+        if(conn_state != MQTT_STATE_IDLE) {
+            if(conn_state != MQTT_STATE_BACKOFF) tap.stop();
+            PubSubClient::connected();
+            setState(MQTT_STATE_IDLE);
+        }
+        return;
+    }
+
+    switch(conn_state) {
+        case MQTT_STATE_IDLE:
+            failures = 0;
+            setState(MQTT_STATE_DNS);
+            break;
+
+        case MQTT_STATE_BACKOFF:
+            if(retry_now || millis() - state_timer >= backoff_ms) {
+                retry_now = false;
+                setState(MQTT_STATE_DNS);
+            }
+            break;
+
+        case MQTT_STATE_DNS:
+            break;  // Resolved in service() without the lock
+
+        case MQTT_STATE_TCP:
+            startTcp();     // Reached with the lock for a W5500 only
+            break;
+
+        case MQTT_STATE_TCP_WAIT: {
+            int8_t result = tap.pollConnect();
+            if(result < 0) {
+                fail("TCP connect failed", MQTT_CONNECT_FAILED);
+                break;
+            }
+            if(result == 0) {
+                if(millis() - state_timer >= MQTT_TCP_TIMEOUT_MS) fail("TCP connect timed out", MQTT_CONNECTION_TIMEOUT);
+                break;
+            }
+            if(!sendConnect()) {
+                fail("CONNECT failed", MQTT_CONNECT_FAILED);
+                break;
+            }
+            connack_len = 0;
+            setState(MQTT_STATE_CONNECT);
+            break;
+        }
+
+        case MQTT_STATE_CONNECT: {
+            Client* client = tap.client();
+            if(!client->connected()) {
+                fail("Closed before CONNACK", MQTT_CONNECTION_LOST);
+                break;
+            }
+            while(connack_len < sizeof(connack) && client->available() > 0) {
+                connack[connack_len++] = client->read();
+            }
+            if(connack_len < sizeof(connack)) {
+                if(millis() - state_timer >= MQTT_CONNACK_TIMEOUT_MS) fail("No CONNACK", MQTT_CONNECTION_TIMEOUT);
+                break;
+            }
+            if(connack[0] != 0x20 || connack[1] != 0x02) {
+                fail("Bad CONNACK", MQTT_CONNECT_FAILED);
+            } else if(connack[3] != 0) {
+                fail("Broker refused connection", connack[3]);  // MQTT_CONNECT_BAD_PROTOCOL..UNAUTHORIZED
+            } else {
+                finishConnect();
+            }
+            break;
+        }
+
+        case MQTT_STATE_SUBSCRIBE:
+            if(!PubSubClient::loop()) {
+                fail("SUBSCRIBE failed", PubSubClient::state());
+                break;
+            }
+            if(tap.subacks >= subacks_expected) {
+                if(tap.subackFailures) Serial.println("[MQTT] ⚠ Broker rejected a subscription");
+                failures = 0;
+                connects++;
+                setState(MQTT_STATE_READY);
+                Serial.printf("[MQTT] ✓ Connected!%s\n", session_present ? " (session resumed)" : "");
+
+                char buffer[200];
+                DynamicJsonDocument status(100);
+                status["status"] = "connected";
+                status["timestamp"] = rtc.getDateTime();
+                serializeJsonPretty(status, buffer);
+                publishSuffix("events/connection_status", buffer, true);
+            } else if(millis() - state_timer >= MQTT_SUBACK_TIMEOUT_MS) {
+                fail("No SUBACK", MQTT_CONNECTION_TIMEOUT);
+            }
+            break;
 
+        case MQTT_STATE_READY:
+            if(!PubSubClient::loop()) {   // Maintain MQTT connection and handle incoming messages
+                failures = 0;
+                fail("Connection lost", PubSubClient::state());
+                break;
+            }
+            serviceInflight();
+            if (conn_state != MQTT_STATE_READY) break;
+            if (hasSpool()) spool->replay(*this);  // Drain messages queued while offline
+            break;
+    }
 }
 
-String MQTT_Lib::getMacTopic(String request){
-    String temp_topic = "devices/" + macAddress + "/" + request;
-    return temp_topic;
+// Broker address for the TCP step. lwIP lookups can take seconds but do not
+// touch the SPI bus, so they run without the network lock. Ethernet-only
+// setups fall back to the W5500 resolver, which needs the lock and is
+// capped at MQTT_DNS_TIMEOUT_MS; a resolved name is reused for
+// MQTT_DNS_REFRESH_MS so a down broker does not cost a lookup per retry.
+void MQTT_Lib::resolveBroker() {
+    if(broker_ip.fromString(mqtt_host.c_str())) {
+        broker_resolved = true;
+        return;
+    }
+    if(broker_resolved && millis() - resolved_at < MQTT_DNS_REFRESH_MS) return;
+
+    IPAddress resolved;
+    bool ok = (WiFi.hostByName(mqtt_host.c_str(), resolved) == 1);
+    if(!ok && tap.isW5500()) {
+        DNSClient dns;
+        lockNetwork();
+        dns.begin(Ethernet.dnsServerIP());
+        ok = (dns.getHostByName(mqtt_host.c_str(), resolved, MQTT_DNS_TIMEOUT_MS) == 1);
+        unlockNetwork();
+    }
+    if(ok) {
+        broker_ip = resolved;
+        resolved_at = millis();
+    }
+    broker_resolved = ok;
 }
 
+// Steps that block without touching the W5500 run before the lock is
+// taken: name resolution, and the connect of a non-W5500 (lwIP) client
+void MQTT_Lib::service() {
+    if(conn_state == MQTT_STATE_DNS && network_ready && !pending_client) {
+        resolveBroker();
+        setState(MQTT_STATE_TCP);
+    }
+    if(conn_state == MQTT_STATE_TCP && network_ready && !pending_client && tap.client() && !tap.isW5500()) {
+        startTcp();
+    }
+
+    lockNetwork();
+    serviceLocked();
+    drainQueue();
+    unlockNetwork();
+}
 
 // Handle MQTT loop operations with a 50ms interval
 void MQTT_Lib::loop() {
+    if (task_handle) return;  // Serviced by MQTTTask
     if ((millis() - loop_timer) >= MQTT_LOOP_INTERVAL) {
         loop_timer = millis();
-        if (MQTT_CONNECTED == PubSubClient::state()) {
-            PubSubClient::loop();  // Maintain MQTT connection and handle incoming messages
-            mqtt_timer = millis();
-        } else {
-            // If disconnected, attempt reconnection at defined intervals
-            if ((millis() - mqtt_timer) > MQTT_RECONNECT_INTERVAL) {
-                mqtt_timer = millis();
-                Serial.println("connecting to MQTT");
-                connect();
-            }
-        }
+        service();
     }
 }
 
+void MQTT_Lib::setNetworkReady(bool ready) {
+    network_ready = ready;
+}
+
+// Request an attempt now, skipping the rest of any backoff delay. Does not
+// wait for it: returns whether the connection is already up.
+bool MQTT_Lib::connect() {
+    retry_now = true;
+    return conn_state == MQTT_STATE_READY;
+}
+
 uint8_t MQTT_Lib::connectionStatus(){
-    return (PubSubClient::state());
+    if (conn_state == MQTT_STATE_READY) return MQTT_CONNECTED;
+    int state = PubSubClient::state();
+    return (state == MQTT_CONNECTED) ? MQTT_DISCONNECTED : state;
+}
+
+bool MQTT_Lib::connected() {
+    return conn_state == MQTT_STATE_READY;
+}
+
+MQTTConnState MQTT_Lib::getState() {
+    return conn_state;
+}
+
+uint32_t MQTT_Lib::connectCount() {
+    return connects;
+}
+
+// Full-topic and QoS 1 publishes, and suffix publishes with no queue to
+// take them, are refused when the lock stays busy; the caller may retry
+uint32_t MQTT_Lib::busySkips() {
+    return lock_misses - lock_queued;
+}
+
+const char* MQTT_Lib::getStateName() {
+    return mqtt_state_names[conn_state];
+}
+
+void MQTT_Lib::printStatus() {
+    Serial.printf("State: %s%s\n", getStateName(), task_handle ? " (task)" : "");
+    Serial.printf("Connects: %lu, consecutive failures: %lu, last error: %d\n",
+                  (unsigned long)connects, (unsigned long)failures, last_error);
+    if (conn_state == MQTT_STATE_BACKOFF) {
+        unsigned long waited = millis() - state_timer;
+        Serial.printf("Next attempt in %lu ms\n", waited < backoff_ms ? (unsigned long)(backoff_ms - waited) : 0UL);
+    }
+    Serial.printf("Network busy: %lu publishes queued, %lu skipped\n", (unsigned long)lock_queued, (unsigned long)busySkips());
+    Serial.printf("QoS 1: %u/%u in flight, %lu acked, %lu resent, %lu rejected, %s session\n",
+                  inflight_used, inflight_window, (unsigned long)qos1_acked, (unsigned long)qos1_resent,
+                  (unsigned long)qos1_rejected, clean_session ? "clean" : "persistent");
+    if (queue) {
+        queue->printStatus();
+        Serial.printf("Queued messages lost (not sent, not spooled): %lu\n", (unsigned long)queue_failures);
+    }
+}
+
+// ==================== NETWORK LOCK / TASK ====================
+
+void MQTT_Lib::setNetworkLock(SemaphoreHandle_t lock) {
+    net_lock = lock;
+}
+
+// Callbacks run inside service() with the lock held and may publish, so
+// the holder can take it again
+bool MQTT_Lib::lockNetwork(uint32_t waitMs) {
+    if (!net_lock) return true;
+    if (xSemaphoreGetMutexHolder(net_lock) == xTaskGetCurrentTaskHandle()) {
+        lock_depth++;
+        return true;
+    }
+    TickType_t ticks = (waitMs == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(waitMs);
+    if (xSemaphoreTake(net_lock, ticks) != pdTRUE) {
+        lock_misses++;
+        return false;
+    }
+    return true;
+}
+
+void MQTT_Lib::unlockNetwork() {
+    if (!net_lock) return;
+    if (lock_depth > 0) {
+        lock_depth--;
+        return;
+    }
+    xSemaphoreGive(net_lock);
+}
+
+void MQTT_Lib::taskEntry(void* pvParameters) {
+    MQTT_Lib* self = (MQTT_Lib*)pvParameters;
+    while (!self->task_stop) {
+        self->service();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_TASK_POLL_MS));
+    }
+    if (self->queue) self->queue->setConsumer(nullptr);
+    self->task_handle = nullptr;
+    vTaskDelete(NULL);
+}
+
+// Run the state machine on its own task so a slow or unreachable broker
+// never stalls boardloop(). Opt-in: message callbacks then run on this task
+// too, concurrently with the loop task and with the network lock held, so
+// they need to fit in MQTT_TASK_STACK and guard anything the loop shares.
+bool MQTT_Lib::startTask(uint8_t core, uint8_t priority) {
+    if (task_handle) return true;
+    task_stop = false;
+    BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "MQTTTask", MQTT_TASK_STACK, this, priority, &task_handle, core);
+    if (ok != pdPASS) {
+        task_handle = nullptr;
+        Serial.println("[MQTT] Failed to start connection task");
+        return false;
+    }
+    if (queue) queue->setConsumer(task_handle);
+    Serial.printf("[MQTT] Connection task running on core %d (priority %d)\n", core, priority);
+    return true;
+}
+
+void MQTT_Lib::stopTask() {
+    if (!task_handle) return;
+    task_stop = true;
+    xTaskNotifyGive(task_handle);
+    for (uint16_t i = 0; i < 2000 && task_handle; i++) {
+        delay(1);
+    }
+}
+
+bool MQTT_Lib::taskRunning() {
+    return task_handle != nullptr;
 }
 
 
@@ -8,28 +8,173 @@
 #include <ArduinoJson.h>
 #include <map>
 #include <Preferences.h>
+#include "mqtt_client_tap.h"
+#include "mqtt_publish_queue.h"
 
 // Define reconnect and loop intervals
-#define MQTT_RECONNECT_INTERVAL 5000  // Time interval for MQTT reconnect attempts (in ms)
+#define MQTT_RECONNECT_MIN_MS 1000     // First retry delay after a failed attempt (in ms)
+#define MQTT_RECONNECT_MAX_MS 60000    // Backoff ceiling (in ms)
 #define MQTT_LOOP_INTERVAL 50          // Time interval for calling the loop function (in ms)
+#define MQTT_TOPIC_MAX_LEN 256         // Prefix plus suffix, including the terminator
+#define MQTT_TCP_TIMEOUT_MS 5000       // Connect attempts, socket not up: give up
+#define MQTT_CONNACK_TIMEOUT_MS 5000   // CONNECT sent, no CONNACK: give up
+#define MQTT_DNS_TIMEOUT_MS 1000       // W5500 name lookup, run under the network lock
+#define MQTT_DNS_REFRESH_MS 600000     // Reuse a resolved broker address this long
+#define MQTT_SUBACK_TIMEOUT_MS 5000    // SUBSCRIBE sent, no SUBACK: give up
+#define MQTT_CONNECT_MAX_LEN 640       // CONNECT packet: client id, will, credentials
+#define MQTT_LOCK_WAIT_MS 5            // How long publishers wait for the network lock; then queued if setQueue()
+#define MQTT_QUEUE_DRAIN_MAX 16        // Queued messages published per service() step
+#define MQTT_STREAM_CHUNK 256          // Socket write size for streamed JSON
+#define MQTT_INFLIGHT_MAX 16           // QoS 1 messages awaiting PUBACK, at most
+#define MQTT_INFLIGHT_WINDOW 8         // Default in-flight window
+#define MQTT_PUBACK_TIMEOUT_MS 15000   // Oldest unacknowledged publish: reconnect and resend
+
+// Connection task: runs the state machine below instead of boardloop()
+#define MQTT_TASK_STACK 8192
+#define MQTT_TASK_PRIORITY 2
+#define MQTT_TASK_POLL_MS 10
 
 extern Preferences subtopicsPref;
 
+class MQTTSpool;
+
+// Print adapter for streamed publishes: ArduinoJson writes a byte at a
+// time, which would be one SPI transaction per byte on the W5500, so
+// output is gathered into MQTT_STREAM_CHUNK-sized socket writes
+class MQTTBufferedPrint : public Print {
+    private:
+        Print& out;
+        uint8_t buf[MQTT_STREAM_CHUNK];
+        size_t len = 0;
+    public:
+        size_t written = 0;
+        bool failed = false;
+
+        MQTTBufferedPrint(Print& target) : out(target) {}
+
+        size_t write(uint8_t b) override {
+            buf[len++] = b;
+            if (len == sizeof(buf)) flush();
+            return 1;
+        }
+
+        size_t write(const uint8_t* data, size_t size) override {
+            for (size_t i = 0; i < size; i++) write(data[i]);
+            return size;
+        }
+
+        void flush() override {
+            if (len == 0) return;
+            if (!failed && out.write(buf, len) != len) failed = true;
+            written += len;
+            len = 0;
+        }
+};
+
+// Wire format for document publishes. MQTT 3.1.1 has no content-type
+// property, so binary payloads go to "<topic>/msgpack".
+enum MQTTPayloadEncoding : uint8_t {
+    MQTT_PAYLOAD_JSON = 0,
+    MQTT_PAYLOAD_MSGPACK
+};
+
+#define MQTT_MSGPACK_TOPIC_SUFFIX "/msgpack"
+
+inline size_t measurePayload(const JsonDocument& doc, MQTTPayloadEncoding encoding) {
+    return encoding == MQTT_PAYLOAD_MSGPACK ? measureMsgPack(doc) : measureJson(doc);
+}
+
+inline size_t serializePayload(const JsonDocument& doc, Print& out, MQTTPayloadEncoding encoding) {
+    return encoding == MQTT_PAYLOAD_MSGPACK ? serializeMsgPack(doc, out) : serializeJson(doc, out);
+}
+
+// size includes room for the JSON terminator
+inline size_t serializePayload(const JsonDocument& doc, uint8_t* buffer, size_t size, MQTTPayloadEncoding encoding) {
+    return encoding == MQTT_PAYLOAD_MSGPACK ? serializeMsgPack(doc, buffer, size) : serializeJson(doc, (char*)buffer, size);
+}
+
+// Outbound QoS 1 message kept until its PUBACK arrives
+struct MQTTInflight {
+    uint8_t* data;          // Topic then payload; nullptr when the slot is free
+    uint32_t length;        // Payload bytes
+    uint32_t order;         // Submission order, resent oldest first
+    unsigned long sentAt;
+    uint16_t topicLen;
+    uint16_t packetId;
+    bool retained;
+    bool sent;              // Written on the current connection
+    bool dup;               // Written on an earlier connection
+};
+
+// Connection state machine. Each step does one bounded piece of work per
+// service() call; a failure anywhere drops the socket and waits in BACKOFF.
+enum MQTTConnState : uint8_t {
+    MQTT_STATE_IDLE = 0,    // Network link down
+    MQTT_STATE_DNS,         // Resolve the broker name
+    MQTT_STATE_TCP,         // Open the socket
+    MQTT_STATE_TCP_WAIT,    // Bounded W5500 connect attempts until the socket is up
+    MQTT_STATE_CONNECT,     // CONNECT sent, waiting for CONNACK
+    MQTT_STATE_SUBSCRIBE,   // SUBSCRIBEs sent, waiting for SUBACKs
+    MQTT_STATE_READY,
+    MQTT_STATE_BACKOFF      // Waiting out the retry delay
+};
+
 class MQTT_Lib : public PubSubClient {
 public:
     MQTT_Lib();
     String getTopic(String request); // Construct full topic string
+    const char* getTopic(const char* suffix, char* buffer, size_t size); // Into caller's buffer, nullptr if too long
+    const char* getTopicPrefix();      // "company/location/department/line/machine/"; rewritten only by setsubtopic()
+    bool publishSuffix(const char* suffix, const char* payload, bool retained = false);
+    bool publishSuffix(const char* suffix, const uint8_t* payload, unsigned int length, bool retained = false);
+    void setSpool(MQTTSpool* spool);   // Store-and-forward queue for publishSpooled()
+    bool hasSpool();
+    bool publishSpooled(const char* suffix, const char* payload, bool retained = false); // Publish, or queue while offline
+    bool publishJson(const char* suffix, const JsonDocument& doc, bool retained = false, MQTTPayloadEncoding encoding = MQTT_PAYLOAD_JSON); // Serialised straight into the socket
+    bool publishJsonTo(const char* topic, const JsonDocument& doc, bool retained = false, MQTTPayloadEncoding encoding = MQTT_PAYLOAD_JSON); // Same, full topic
+    bool publishSpooledJson(const char* suffix, const JsonDocument& doc, bool retained = false, MQTTPayloadEncoding encoding = MQTT_PAYLOAD_JSON);
+    void setQueue(MQTTPublishQueue* queue); // Lock-free outbound ring drained by service()
+    MQTTPublishQueue* getQueue();
+    bool enqueue(const char* suffix, const uint8_t* payload, unsigned int length, bool retained = false); // Never touches the socket
+    bool enqueueJson(const char* suffix, const JsonDocument& doc, bool retained = false, MQTTPayloadEncoding encoding = MQTT_PAYLOAD_JSON); // Serialised into the ring slot
+    // QoS 1: kept until the broker's PUBACK, resent with DUP after a
+    // reconnect. false when the in-flight window is full (retry later).
+    bool publishQos1(const char* suffix, const uint8_t* payload, unsigned int length, bool retained = false);
+    bool publishQos1(const char* suffix, const char* payload, bool retained = false);
+    bool publishQos1To(const char* topic, const uint8_t* payload, unsigned int length, bool retained = false);
+    bool publishQos1Json(const char* suffix, const JsonDocument& doc, bool retained = false, MQTTPayloadEncoding encoding = MQTT_PAYLOAD_JSON);
+    void setInflightWindow(uint8_t window);
+    uint8_t inflightCount();
+    void setCleanSession(bool clean);  // Default true; false: broker keeps the session across reconnects
+    bool publish(const char* topic, const char* payload, bool retained = false);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained = false);
     void config(const char *ip, uint16_t port, const char *user, const char *password, const char *willMsg, Client &client);
+    void config(const char *ip, uint16_t port, const char *user, const char *password, const char *willMsg, EthernetClient &client);
     void setMacAddress(String temp_mac);
-    void setClient(Client &client);
+    void setClient(Client &client);    // Switch transport; applied by the next service() step
+    void setClient(EthernetClient &client);
     String getMacAddress();
     void setsubscribeto(String _sub_to);
-    void begin();  // Initialize MQTT connection
-    bool connect(); // Attempt to connect to MQTT broker
-    void loop();  // Handle MQTT loop operations
+    void begin();  // Start connecting; completes over later loop() calls
+    bool connect(); // Request an attempt now (skips backoff); does not wait, true if already connected
+    void loop();  // Drives the connection and callbacks (no-op while the task runs)
+    void service(); // Advance the connection state machine by one step
+    void setNetworkReady(bool ready);  // Link state from the board loop
+    void setNetworkLock(SemaphoreHandle_t lock); // Mutex shared with other users of the interface
+    bool lockNetwork(uint32_t waitMs = portMAX_DELAY); // Reentrant for the holder
+    void unlockNetwork();
+    bool startTask(uint8_t core = ARDUINO_RUNNING_CORE, uint8_t priority = MQTT_TASK_PRIORITY);
+    void stopTask();
+    bool taskRunning();
     void setsubtopic(const DynamicJsonDocument &obj);
     void setCallback(MQTT_CALLBACK_SIGNATURE); // Set MQTT message callback function
     uint8_t connectionStatus();
+    bool connected();  // Connected and subscribed
+    MQTTConnState getState();
+    uint32_t connectCount();           // Successful connects so far; changes on every reconnect
+    const char* getStateName();
+    uint32_t busySkips();              // Publishes refused because the network lock stayed busy
+    void printStatus();
     String getMacTopic(String request);
 
 private:
@@ -41,15 +186,83 @@ private:
     String cached_line ="";
     String cached_machine ="";
 
+    // Prefix built once from the cached fields; full topics are assembled
+    // in per-call stack buffers, never in here
+    char topic_prefix[MQTT_TOPIC_MAX_LEN];
+    uint16_t topic_prefix_len = 0;
+    bool topic_prefix_valid = false;
+
+    MQTTSpool* spool = nullptr;
+    MQTTPublishQueue* queue = nullptr;
+    uint32_t queue_failures = 0;        // Dequeued but neither sent nor spooled
+    void drainQueue();
+    bool streamJson(const char* topic, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding);
+
+    // QoS 1 in-flight window
+    MQTTInflight inflight[MQTT_INFLIGHT_MAX] = {};
+    uint8_t inflight_window = MQTT_INFLIGHT_WINDOW;
+    uint8_t inflight_used = 0;
+    uint32_t inflight_order = 0;
+    uint16_t next_packet_id = 0x8000;   // PubSubClient numbers its SUBSCRIBEs from 1
+    bool clean_session = true;
+    bool session_present = false;
+    uint32_t qos1_acked = 0;
+    uint32_t qos1_resent = 0;
+    uint32_t qos1_rejected = 0;
+    uint8_t* inflightReserve(const char* topic, uint32_t length, bool retained);
+    bool sendInflight(MQTTInflight& msg);
+    void serviceInflight();
+    static void onPacket(void* ctx, uint8_t type, const uint8_t* head, uint8_t headLen);
+
+    void startTcp();
+    void resolveBroker();
+    void buildTopicPrefix();
+    const char* topicWithSuffix(const char* suffix, char* buffer);
+
+    // Connection state machine
+    MQTTClientTap tap;
+    Client* volatile pending_client = nullptr;
+    EthernetClient* volatile pending_eth = nullptr;     // Set with pending_client for a W5500
+    volatile MQTTConnState conn_state = MQTT_STATE_IDLE;
+    volatile bool network_ready = false;
+    volatile bool retry_now = false;
+    String mqtt_host;
+    uint16_t mqtt_port = 1883;
+    uint16_t keep_alive = 15;
+    IPAddress broker_ip;
+    bool broker_resolved = false;
+    unsigned long resolved_at = 0;
+    unsigned long state_timer = 0;      // Entry time of the current step
+    uint32_t backoff_ms = 0;
+    uint32_t failures = 0;              // Consecutive failed attempts
+    int last_error = 0;                 // PubSubClient state or CONNACK return code
+    uint8_t connack[4];
+    uint8_t connack_len = 0;
+    uint32_t subacks_expected = 0;
+    uint32_t connects = 0;
+    uint32_t lock_misses = 0;
+    uint32_t lock_queued = 0;           // Lock misses handed to the publish queue instead
+    bool queueBusy(const char* suffix, const uint8_t* payload, unsigned int length, bool retained);
+    bool queueBusyJson(const char* suffix, const JsonDocument& doc, bool retained, MQTTPayloadEncoding encoding);
+
+    SemaphoreHandle_t net_lock = nullptr;
+    uint8_t lock_depth = 0;             // Nested lockNetwork() calls by the holder
+    TaskHandle_t task_handle = nullptr;
+    volatile bool task_stop = false;
+    static void taskEntry(void* pvParameters);
+
+    void setState(MQTTConnState state);
+    void fail(const char* reason, int error);
+    bool sendConnect();
+    void finishConnect();
+    void serviceLocked();
+
     String macAddress = "00:00:00:00:00:00"; 
     String sub_to = "+";  
     String mqtt_user;
     String mqtt_password;
     String will_message;
-    unsigned long mqtt_timer = 0; // Timer for reconnect attempts
     unsigned long loop_timer = 0; // Timer for loop execution interval
-    uint8_t counter = 0; // Connection attempt counter
-    bool update_success_flag = false; // Flag for tracking MQTT connection status
 };
 
 #endif
\ No newline at end of file
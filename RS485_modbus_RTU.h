@@ -1,3 +1,6 @@
+#ifndef RS485_MODBUS_RTU_H
+#define RS485_MODBUS_RTU_H
+
 #include "HardwareSerial.h"
 #include <ModbusRTU.h>
 #include "pindefinition.h"
@@ -36,10 +39,354 @@ void modbusInit(){
     Serial.println("[MODBUS] Initialization complete");
 }
 
+// ==================== POLL SCHEDULER ====================
+// Declarative cyclic polling on top of mb. Each rtuPollAdd() entry names a
+// slave, function (01-04), address range, period and destination. Entries
+// for the same slave and function that overlap or touch are merged into one
+// request of at most 125 registers / 2000 bits, polled at the fastest member
+// period, so the bus carries one frame where it used to carry several.
+// Requests go out one at a time with at least 3.5 character times plus
+// RTU_POLL_TURNAROUND_MS of silence after the previous reply.
+
+#ifndef RTU_POLL_MAX_ENTRIES
+#define RTU_POLL_MAX_ENTRIES        32
+#endif
+#define RTU_POLL_MAX_SLAVES         16
+#define RTU_POLL_MAX_REGS           125     // FC03/04 PDU limit
+#define RTU_POLL_MAX_BITS           2000    // FC01/02 PDU limit
+#define RTU_POLL_TURNAROUND_MS      5       // Slave turnaround allowance on top of t3.5
+#define RTU_POLL_STUCK_MS           3000    // Give up on a reply the library never reported
+
+// Called after every poll of an entry; ok is false on timeout or exception
+typedef std::function<void(uint16_t entry, bool ok)> RTUPollCallback;
+
+struct RTUPollEntry {
+    uint8_t slave;
+    uint8_t fc;
+    uint16_t address;
+    uint16_t count;
+    uint32_t periodMs;
+    void* dest;                 // uint16_t[count] for FC03/04, bool[count] for FC01/02
+    RTUPollCallback onUpdate;
+};
+
+struct RTUPollBlock {
+    uint8_t slave;
+    uint8_t fc;
+    uint16_t address;
+    uint16_t count;
+    uint32_t periodMs;
+    unsigned long nextDue;
+    uint32_t seq;               // rtu_poll_current only: request number, 0 when none in flight
+};
+
+struct RTUSlaveStats {
+    uint8_t slave;
+    uint32_t requests;
+    uint32_t errors;
+    uint8_t lastError;
+    uint32_t lastRttMs;
+    uint32_t maxRttMs;
+    uint32_t totalRttMs;        // Successful replies only
+};
+
+static RTUPollEntry rtu_poll_entries[RTU_POLL_MAX_ENTRIES];
+static uint16_t rtu_poll_entry_count = 0;
+static RTUPollBlock rtu_poll_blocks[RTU_POLL_MAX_ENTRIES];
+static uint16_t rtu_poll_block_count = 0;
+static bool rtu_poll_dirty = false;
+
+static RTUSlaveStats rtu_slave_stats[RTU_POLL_MAX_SLAVES];
+static uint8_t rtu_slave_count = 0;
+
+// In-flight request. A copy rather than an index so the table can be
+// rebuilt while a reply is pending.
+static RTUPollBlock rtu_poll_current;
+static bool rtu_poll_waiting = false;
+static unsigned long rtu_poll_sent_at = 0;
+static unsigned long rtu_poll_idle_since = 0;
+
+// Every request ModbusRTU accepts gets a sequence number. ModbusRTU runs
+// one transaction at a time and its callback carries no tag, so
+// rtu_poll_lib_seq records which request it is working on; a reply is
+// ours only if that is still the request in flight (rtu_poll_current.seq).
+// Giving up after RTU_POLL_STUCK_MS clears the in-flight seq, so a late
+// reply to the abandoned request is dropped.
+static uint32_t rtu_poll_seq = 0;
+static uint32_t rtu_poll_lib_seq = 0;
+static uint32_t rtu_poll_stale = 0;     // Late replies dropped
+
+static union {
+    uint16_t regs[RTU_POLL_MAX_REGS];
+    bool bits[RTU_POLL_MAX_BITS];
+} rtu_poll_buf;
+
+static inline bool rtuPollIsBitFc(uint8_t fc) {
+    return fc == 0x01 || fc == 0x02;
+}
+
+// Add a poll entry. Returns its index, or -1 if the table is full or the
+// arguments are invalid.
+int rtuPollAdd(uint8_t slave, uint8_t fc, uint16_t address, uint16_t count, uint32_t periodMs,
+               void* dest, RTUPollCallback onUpdate = nullptr) {
+    if (rtu_poll_entry_count >= RTU_POLL_MAX_ENTRIES) {
+        Serial.println("[MODBUS] ✗ Poll table full");
+        return -1;
+    }
+    uint16_t maxCount = rtuPollIsBitFc(fc) ? RTU_POLL_MAX_BITS : RTU_POLL_MAX_REGS;
+    if (fc < 0x01 || fc > 0x04 || count < 1 || count > maxCount || !dest || periodMs == 0) {
+        Serial.printf("[MODBUS] ✗ Invalid poll entry (slave %d FC%02X @%d x%d)\n", slave, fc, address, count);
+        return -1;
+    }
+
+    RTUPollEntry& e = rtu_poll_entries[rtu_poll_entry_count];
+    e.slave = slave;
+    e.fc = fc;
+    e.address = address;
+    e.count = count;
+    e.periodMs = periodMs;
+    e.dest = dest;
+    e.onUpdate = onUpdate;
+    rtu_poll_dirty = true;
+    return rtu_poll_entry_count++;
+}
+
+void rtuPollClear() {
+    for (uint16_t i = 0; i < rtu_poll_entry_count; i++) {
+        rtu_poll_entries[i].onUpdate = nullptr;
+    }
+    rtu_poll_entry_count = 0;
+    rtu_poll_block_count = 0;
+    rtu_poll_dirty = false;
+}
+
+// Rebuild the merged request list from the entries
+static void rtuPollBuild() {
+    rtu_poll_dirty = false;
+    rtu_poll_block_count = 0;
+
+    // Sort entry indices by slave, function, address
+    uint16_t order[RTU_POLL_MAX_ENTRIES];
+    for (size_t i = 0; i < rtu_poll_entry_count; i++) order[i] = i;
+    for (size_t i = 1; i < rtu_poll_entry_count; i++) {
+        uint16_t idx = order[i];
+        const RTUPollEntry& e = rtu_poll_entries[idx];
+        uint32_t key = ((uint32_t)e.slave << 24) | ((uint32_t)e.fc << 16) | e.address;
+        size_t j = i;
+        while (j > 0) {
+            const RTUPollEntry& p = rtu_poll_entries[order[j - 1]];
+            uint32_t pkey = ((uint32_t)p.slave << 24) | ((uint32_t)p.fc << 16) | p.address;
+            if (pkey <= key) break;
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = idx;
+    }
+
+    unsigned long now = millis();
+    for (uint16_t i = 0; i < rtu_poll_entry_count; i++) {
+        const RTUPollEntry& e = rtu_poll_entries[order[i]];
+        uint32_t end = (uint32_t)e.address + e.count;
+
+        if (rtu_poll_block_count > 0) {
+            RTUPollBlock& b = rtu_poll_blocks[rtu_poll_block_count - 1];
+            uint32_t blockEnd = (uint32_t)b.address + b.count;
+            uint16_t maxCount = rtuPollIsBitFc(b.fc) ? RTU_POLL_MAX_BITS : RTU_POLL_MAX_REGS;
+            uint32_t mergedEnd = max(blockEnd, end);
+            if (b.slave == e.slave && b.fc == e.fc && e.address <= blockEnd &&
+                mergedEnd - b.address <= maxCount) {
+                b.count = mergedEnd - b.address;
+                b.periodMs = min(b.periodMs, e.periodMs);
+                continue;
+            }
+        }
+
+        RTUPollBlock& b = rtu_poll_blocks[rtu_poll_block_count++];
+        b.slave = e.slave;
+        b.fc = e.fc;
+        b.address = e.address;
+        b.count = e.count;
+        b.periodMs = e.periodMs;
+        b.nextDue = now;
+    }
+
+    Serial.printf("[MODBUS] Poll table: %d entries -> %d requests\n", rtu_poll_entry_count, rtu_poll_block_count);
+}
+
+static RTUSlaveStats* rtuPollSlaveStats(uint8_t slave) {
+    for (uint8_t i = 0; i < rtu_slave_count; i++) {
+        if (rtu_slave_stats[i].slave == slave) return &rtu_slave_stats[i];
+    }
+    if (rtu_slave_count >= RTU_POLL_MAX_SLAVES) return nullptr;
+    RTUSlaveStats* s = &rtu_slave_stats[rtu_slave_count++];
+    memset(s, 0, sizeof(*s));
+    s->slave = slave;
+    return s;
+}
+
+// Reply (or timeout) for the in-flight request: record the round trip and
+// copy each member entry's slice out of the shared buffer
+static void rtuPollFinish(Modbus::ResultCode event) {
+    if (!rtu_poll_waiting) return;
+    rtu_poll_waiting = false;
+    rtu_poll_idle_since = millis();
+
+    const RTUPollBlock& b = rtu_poll_current;
+    bool ok = (event == Modbus::EX_SUCCESS);
+    uint32_t rtt = rtu_poll_idle_since - rtu_poll_sent_at;
+
+    RTUSlaveStats* stats = rtuPollSlaveStats(b.slave);
+    if (stats) {
+        stats->requests++;
+        stats->lastRttMs = rtt;
+        if (ok) {
+            stats->totalRttMs += rtt;
+            if (rtt > stats->maxRttMs) stats->maxRttMs = rtt;
+        } else {
+            stats->errors++;
+            stats->lastError = event;
+        }
+    }
+
+    for (uint16_t i = 0; i < rtu_poll_entry_count; i++) {
+        RTUPollEntry& e = rtu_poll_entries[i];
+        if (e.slave != b.slave || e.fc != b.fc || e.address < b.address ||
+            (uint32_t)e.address + e.count > (uint32_t)b.address + b.count) {
+            continue;
+        }
+        if (ok) {
+            uint16_t offset = e.address - b.address;
+            if (rtuPollIsBitFc(e.fc)) {
+                memcpy(e.dest, &rtu_poll_buf.bits[offset], e.count * sizeof(bool));
+            } else {
+                memcpy(e.dest, &rtu_poll_buf.regs[offset], e.count * sizeof(uint16_t));
+            }
+        }
+        if (e.onUpdate) e.onUpdate(i, ok);
+    }
+}
+
+// Library callback: completes the request only if it is the one in flight
+static bool rtuPollDone(Modbus::ResultCode event, uint16_t, void*) {
+    uint32_t seq = rtu_poll_lib_seq;
+    rtu_poll_lib_seq = 0;
+    if (!rtu_poll_waiting || seq == 0 || seq != rtu_poll_current.seq) {
+        rtu_poll_stale++;
+        return true;
+    }
+    rtuPollFinish(event);
+    return true;
+}
+
+// 3.5 character times (11 bits each) plus turnaround; fixed 1.75 ms above
+// 19200 baud as the spec allows
+static uint32_t rtuPollGapMs() {
+    uint32_t baud = RTUSerial.baudRate();
+    uint32_t t35 = (baud == 0 || baud > 19200) ? 2 : (35 * 11 * 1000UL / 10 + baud - 1) / baud;
+    return t35 + RTU_POLL_TURNAROUND_MS;
+}
+
+bool rtuPollBusy() {
+    return rtu_poll_waiting;
+}
+
+// Other users of mb (e.g. the TCP gateway) share the bus with the
+// scheduler: submit only when rtuBusReady(), and call rtuBusReleased() when
+// the reply or timeout arrives so the inter-frame gap is kept.
+bool rtuBusReady() {
+    return !rtu_poll_waiting && millis() - rtu_poll_idle_since >= rtuPollGapMs();
+}
+
+void rtuBusReleased() {
+    rtu_poll_idle_since = millis();
+}
+
+// Runs from modbusLoop() before the scheduler, so it gets the bus first
+std::function<void()> rtu_bus_hook = nullptr;
+
+static void rtuPollLoop() {
+    if (rtu_poll_dirty) rtuPollBuild();
+    if (rtu_poll_block_count == 0) return;
+
+    unsigned long now = millis();
+    if (rtu_poll_waiting) {
+        if (now - rtu_poll_sent_at < RTU_POLL_STUCK_MS) return;
+        rtu_poll_current.seq = 0;      // The library may still answer; that reply is now stale
+        rtuPollFinish(Modbus::EX_TIMEOUT);
+    }
+    if (now - rtu_poll_idle_since < rtuPollGapMs()) return;
+
+    // Most overdue request first
+    int next = -1;
+    long mostLate = -1;
+    for (uint16_t i = 0; i < rtu_poll_block_count; i++) {
+        long late = (long)(now - rtu_poll_blocks[i].nextDue);
+        if (late > mostLate) {
+            mostLate = late;
+            next = i;
+        }
+    }
+    if (next < 0) return;
+
+    RTUPollBlock& b = rtu_poll_blocks[next];
+    rtu_poll_current = b;
+    rtu_poll_waiting = true;
+    rtu_poll_sent_at = now;
+
+    // Numbered before submitting, in case the library calls back at once
+    if (++rtu_poll_seq == 0) rtu_poll_seq = 1;
+    rtu_poll_current.seq = rtu_poll_seq;
+    uint32_t prevLibSeq = rtu_poll_lib_seq;
+    rtu_poll_lib_seq = rtu_poll_seq;
+
+    uint16_t tid = 0;
+    switch (b.fc) {
+        case 0x01: tid = mb.readCoil(b.slave, b.address, rtu_poll_buf.bits, b.count, rtuPollDone); break;
+        case 0x02: tid = mb.readIsts(b.slave, b.address, rtu_poll_buf.bits, b.count, rtuPollDone); break;
+        case 0x03: tid = mb.readHreg(b.slave, b.address, rtu_poll_buf.regs, b.count, rtuPollDone); break;
+        case 0x04: tid = mb.readIreg(b.slave, b.address, rtu_poll_buf.regs, b.count, rtuPollDone); break;
+    }
+    if (!tid) {
+        // Someone else's transaction holds the bus; try again next pass
+        rtu_poll_waiting = false;
+        rtu_poll_current.seq = 0;
+        rtu_poll_lib_seq = prevLibSeq;
+        return;
+    }
+
+    b.nextDue += b.periodMs;
+    if ((long)(now - b.nextDue) > 0) b.nextDue = now + b.periodMs;  // Drop missed cycles
+}
+
+void rtuPollPrintStatus() {
+    Serial.println("=== RTU Poll Scheduler ===");
+    Serial.printf("Entries: %d, merged requests: %d, gap: %lu ms, stale replies: %lu\n",
+                  rtu_poll_entry_count, rtu_poll_block_count, (unsigned long)rtuPollGapMs(),
+                  (unsigned long)rtu_poll_stale);
+    for (uint16_t i = 0; i < rtu_poll_block_count; i++) {
+        const RTUPollBlock& b = rtu_poll_blocks[i];
+        Serial.printf("  slave %3d FC%02X %5u x%-4u every %lu ms\n", b.slave, b.fc, b.address, b.count,
+                      (unsigned long)b.periodMs);
+    }
+    for (uint8_t i = 0; i < rtu_slave_count; i++) {
+        const RTUSlaveStats& s = rtu_slave_stats[i];
+        uint32_t okCount = s.requests - s.errors;
+        Serial.printf("  slave %3d: %lu req, %lu err (last 0x%02X), rtt last %lu avg %lu max %lu ms\n",
+                      s.slave, (unsigned long)s.requests, (unsigned long)s.errors, s.lastError,
+                      (unsigned long)s.lastRttMs, (unsigned long)(okCount ? s.totalRttMs / okCount : 0),
+                      (unsigned long)s.maxRttMs);
+    }
+    Serial.println("==========================");
+}
+
 void modbusLoop() {
   if (!modbusInitialized) {
     return; // Don't run if not initialized
   }
   mb.task();
+  if (rtu_bus_hook) rtu_bus_hook();
+  rtuPollLoop();
   yield();
-}
\ No newline at end of file
+}
+
+#endif // RS485_MODBUS_RTU_H
@@ -235,6 +235,20 @@ unsigned long RTCManager::getEpoch() {
     return internalRTC.getEpoch();
 }
 
+/**
+ * @brief Get Unix time in milliseconds
+ */
+uint64_t RTCManager::getEpochMs() {
+    unsigned long epoch = internalRTC.getEpoch();
+    unsigned long ms = internalRTC.getMillis();
+    if (internalRTC.getEpoch() != epoch) {
+        // Second rolled over between the reads
+        epoch++;
+        ms = internalRTC.getMillis();
+    }
+    return (uint64_t)epoch * 1000 + ms;
+}
+
 /**
  * @brief Set time from Unix timestamp
  */
@@ -128,6 +128,12 @@ public:
      * @return unsigned long Unix timestamp
      */
     unsigned long getEpoch();
+
+    /**
+     * @brief Get Unix time in milliseconds
+     * @return uint64_t Milliseconds since 1970-01-01
+     */
+    uint64_t getEpochMs();
     
     /**
      * @brief Set time from Unix timestamp
@@ -0,0 +1,27 @@
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+// Report-by-exception rule shared by the Modbus bridge tags, MQTTPublisher
+// keys and MQTTAliasPublisher metrics.
+//
+// deadband is in the value's units, or a percent of the last reported
+// value when percent is set; 0 reports any change. A percent deadband
+// against a last value of 0 also reports any change.
+
+#include <math.h>
+
+inline bool exceedsDeadband(double value, double last, float deadband, bool percent = false) {
+    // NaN compares false with everything: report entering or leaving NaN,
+    // and any change to or from infinity
+    if (isnan(value) || isnan(last)) return isnan(value) != isnan(last);
+    if (isinf(value) || isinf(last)) return value != last;
+    double delta = fabs(value - last);
+    if (deadband <= 0) return delta > 0;
+    if (percent) {
+        if (last == 0) return delta > 0;
+        return delta >= fabs(last) * deadband / 100.0;
+    }
+    return delta >= deadband;
+}
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * @file bench.cpp
+ * @brief Host throughput of the Modbus TCP server per function code
+ *
+ * Two numbers per frame:
+ * - build: tcpModbusBuildResponse() alone (dispatch and register access)
+ * - reader: the same frame pipelined through the MBAP reader and an
+ *   in-memory client, as tcpModbusServiceClient() sees a socket
+ *
+ * Host figures are for comparing changes, not for predicting the ESP32;
+ * modbus_frame_bench.ino measures the board itself.
+ */
+
+#include <Preferences.h>
+
+Preferences tcpModbusPref;
+
+#include "bench_frames.h"
+#include <chrono>
+#include <vector>
+
+#define BENCH_ITERATIONS    200000
+#define BENCH_PIPELINE      64      // Frames per fed stream in the reader run
+
+static uint8_t responseBuf[MB_TCP_MAX_ADU];
+
+static double nsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double benchBuild(const BenchFrame& frame) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        tcpModbusBuildResponse(frame.adu, frame.len, responseBuf);
+    }
+    return nsSince(start) / BENCH_ITERATIONS;
+}
+
+static double benchReader(const BenchFrame& frame) {
+    std::vector<uint8_t> stream;
+    for (uint16_t i = 0; i < BENCH_PIPELINE; i++) stream.insert(stream.end(), frame.adu, frame.adu + frame.len);
+
+    TCPModbusClientSlot& slot = mb_clients[0];
+    tcpModbusClaimSlot(0);
+    slot.eth.keepWrites = false;
+    uint32_t rounds = BENCH_ITERATIONS / BENCH_PIPELINE;
+    uint32_t frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        slot.eth.feed(stream.data(), stream.size());
+        frames += tcpModbusServiceClient(0);
+    }
+    double ns = nsSince(start);
+    tcpModbusReleaseSlot(0, "bench done");
+    return frames ? ns / frames : 0;
+}
+
+int main() {
+    mb_use_ethernet = true;
+    for (uint16_t i = 0; i < MB_REG_HOLDING_COUNT; i++) {
+        tcpModbusSetHoldingRegister(i, i * 3);
+        tcpModbusSetInputRegister(i, i * 7);
+    }
+    benchBuildFrames();
+
+    Serial.quiet = true;    // Slot accept/release messages
+    printf("%-22s %12s %10s %12s %10s\n", "Frame", "build f/s", "build ns", "reader f/s", "reader ns");
+    for (uint8_t f = 0; f < benchFrameCount; f++) {
+        double build = benchBuild(benchFrames[f]);
+        double reader = benchReader(benchFrames[f]);
+        printf("%-22s %12.0f %10.1f %12.0f %10.1f\n", benchFrames[f].name, 1e9 / build, build, 1e9 / reader, reader);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+// One request ADU per built-in function code, shared by the benchmark and
+// the fuzz driver's seed corpus (same set as modbus_frame_bench.ino)
+#pragma once
+
+#include <tcp_modbus_simple.h>
+
+struct BenchFrame {
+    const char* name;
+    uint8_t adu[MB_TCP_MAX_ADU];
+    uint16_t len;
+};
+
+static BenchFrame benchFrames[10];
+static uint8_t benchFrameCount = 0;
+
+static void benchAddFrame(const char* name, const uint8_t* pdu, uint16_t pduLen) {
+    BenchFrame& f = benchFrames[benchFrameCount++];
+    f.name = name;
+    f.adu[0] = 0x00;
+    f.adu[1] = benchFrameCount;
+    f.adu[2] = 0x00;
+    f.adu[3] = 0x00;
+    f.adu[4] = (pduLen + 1) >> 8;
+    f.adu[5] = (pduLen + 1) & 0xFF;
+    f.adu[6] = 0x01;
+    memcpy(&f.adu[MB_MBAP_HEADER_LEN], pdu, pduLen);
+    f.len = MB_MBAP_HEADER_LEN + pduLen;
+}
+
+static void benchBuildFrames() {
+    if (benchFrameCount) return;
+    const uint8_t fc01[] = { 0x01, 0x00, 0x00, 0x00, 0x40 };
+    const uint8_t fc02[] = { 0x02, 0x00, 0x00, 0x00, 0x40 };
+    const uint8_t fc03[] = { 0x03, 0x00, 0x00, 0x00, 0x64 };
+    const uint8_t fc04[] = { 0x04, 0x00, 0x00, 0x00, 0x64 };
+    const uint8_t fc05[] = { 0x05, 0x00, 0x03, 0xFF, 0x00 };
+    const uint8_t fc06[] = { 0x06, 0x00, 0x05, 0x12, 0x34 };
+    benchAddFrame("FC01 read 64 coils", fc01, sizeof(fc01));
+    benchAddFrame("FC02 read 64 inputs", fc02, sizeof(fc02));
+    benchAddFrame("FC03 read 100 regs", fc03, sizeof(fc03));
+    benchAddFrame("FC04 read 100 regs", fc04, sizeof(fc04));
+    benchAddFrame("FC05 write coil", fc05, sizeof(fc05));
+    benchAddFrame("FC06 write reg", fc06, sizeof(fc06));
+
+    uint8_t fc15[6 + 8] = { 0x0F, 0x00, 0x00, 0x00, 0x40, 0x08 };
+    memset(&fc15[6], 0x55, 8);
+    benchAddFrame("FC15 write 64 coils", fc15, sizeof(fc15));
+
+    uint8_t fc16[6 + 100 * 2] = { 0x10, 0x00, 0x00, 0x00, 0x64, 0xC8 };
+    for (uint16_t i = 0; i < 100; i++) {
+        fc16[6 + i * 2] = i >> 8;
+        fc16[7 + i * 2] = i & 0xFF;
+    }
+    benchAddFrame("FC16 write 100 regs", fc16, sizeof(fc16));
+
+    uint8_t fc23[10 + 20 * 2] = { 0x17, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0x14, 0x28 };
+    benchAddFrame("FC23 r100/w20 regs", fc23, sizeof(fc23));
+
+    const uint8_t bad[] = { 0x03, 0x7F, 0x00, 0x00, 0x10 };
+    benchAddFrame("FC03 bad address", bad, sizeof(bad));
+}
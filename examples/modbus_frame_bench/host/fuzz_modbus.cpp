@@ -0,0 +1,80 @@
+/**
+ * @file fuzz_modbus.cpp
+ * @brief libFuzzer target for the Modbus TCP server's request path
+ *
+ * Each input drives both halves of tcp_modbus_simple.h:
+ * - tcpModbusBuildResponse() on the input as one ADU; the response must
+ *   stay inside its 260-byte buffer and carry a consistent MBAP header
+ * - the MBAP reader (tcpModbusServiceClient()) on the input as a TCP byte
+ *   stream, split into reads of 1-15 bytes (or whole) by the first input
+ *   byte; every reply written must be a well-formed ADU
+ *
+ * Any violation aborts, which libFuzzer and the sanitizers report.
+ */
+
+#include <Preferences.h>
+
+Preferences tcpModbusPref;
+
+#include <tcp_modbus_simple.h>
+
+#define FUZZ_GUARD_BYTE     0xA5
+#define FUZZ_GUARD_LEN      32
+
+static uint8_t responseBuf[MB_TCP_MAX_ADU + FUZZ_GUARD_LEN];
+
+static void fuzzCheck(bool ok, const char* what) {
+    if (ok) return;
+    fprintf(stderr, "Modbus fuzz check failed: %s\n", what);
+    abort();
+}
+
+// A reply is [MBAP(6)][unit][PDU] with the length covering unit + PDU
+static void checkReplies(const std::vector<uint8_t>& tx) {
+    size_t pos = 0;
+    while (pos < tx.size()) {
+        fuzzCheck(tx.size() - pos >= MB_MBAP_HEADER_LEN + 1, "reply shorter than MBAP + FC");
+        uint16_t protocolId = (tx[pos + 2] << 8) | tx[pos + 3];
+        uint16_t length = (tx[pos + 4] << 8) | tx[pos + 5];
+        fuzzCheck(protocolId == 0, "reply protocol id");
+        fuzzCheck(length >= MB_MBAP_MIN_LENGTH && length <= MB_MBAP_MAX_LENGTH, "reply MBAP length");
+        fuzzCheck(pos + 6 + length <= tx.size(), "reply MBAP length past the data written");
+        pos += 6 + length;
+    }
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+    Serial.quiet = true;
+    mb_use_ethernet = true;
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 1) return 0;
+    size_t chunk = (data[0] & 0x0F) ? (data[0] & 0x0F) : SIZE_MAX;
+    data++;
+    size--;
+
+    if (size <= MB_TCP_MAX_ADU) {
+        memset(&responseBuf[MB_TCP_MAX_ADU], FUZZ_GUARD_BYTE, FUZZ_GUARD_LEN);
+        uint16_t n = tcpModbusBuildResponse(data, size, responseBuf);
+        for (uint16_t i = 0; i < FUZZ_GUARD_LEN; i++) {
+            fuzzCheck(responseBuf[MB_TCP_MAX_ADU + i] == FUZZ_GUARD_BYTE, "response buffer overrun");
+        }
+        fuzzCheck(n == 0 || (n >= MB_MBAP_HEADER_LEN + 2 && n <= MB_TCP_MAX_ADU), "response length");
+        if (n) fuzzCheck(((responseBuf[4] << 8) | responseBuf[5]) == n - 6, "response MBAP length");
+    }
+
+    TCPModbusClientSlot& slot = mb_clients[0];
+    tcpModbusClaimSlot(0);
+    slot.eth.tx.clear();
+    slot.eth.feed(data, size, chunk);
+    for (size_t pass = 0; slot.active && slot.eth.unread() > 0; pass++) {
+        fuzzCheck(pass <= size, "reader made no progress");
+        tcpModbusServiceClient(0);
+        fuzzCheck(slot.rxLen <= MB_TCP_MAX_ADU, "reader buffered more than one ADU");
+    }
+    checkReplies(slot.eth.tx);
+    tcpModbusReleaseSlot(0, "fuzz input done");
+    return 0;
+}
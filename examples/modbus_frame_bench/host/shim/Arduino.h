@@ -0,0 +1,221 @@
+// Host (Linux) stand-in for the parts of the ESP32 Arduino core that the
+// Modbus TCP server uses. Enough to compile tcp_modbus_simple.h and run its
+// framing and dispatch code; tasks, locks and the watchdog are no-ops.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_ATTR
+#define ARDUINO_RUNNING_CORE 1
+
+// ==================== TIME ====================
+
+inline int64_t hostMicros() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+inline unsigned long millis() { return (unsigned long)(hostMicros() / 1000); }
+inline unsigned long micros() { return (unsigned long)hostMicros(); }
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned) {}
+inline void yield() {}
+inline long random(long max) { return max > 0 ? rand() % max : 0; }
+inline long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+inline bool psramFound() { return false; }
+
+// ==================== STRING ====================
+
+class String {
+    public:
+        std::string s;
+
+        String() {}
+        String(const char* c) : s(c ? c : "") {}
+        String(int v) : s(std::to_string(v)) {}
+        String(unsigned v) : s(std::to_string(v)) {}
+        String(long v) : s(std::to_string(v)) {}
+        String(unsigned long v) : s(std::to_string(v)) {}
+        String(double v) : s(std::to_string(v)) {}
+
+        const char* c_str() const { return s.c_str(); }
+        unsigned length() const { return s.size(); }
+        bool isEmpty() const { return s.empty(); }
+        char charAt(unsigned i) const { return s[i]; }
+        String& operator+=(const String& o) { s += o.s; return *this; }
+        String& operator+=(const char* o) { s += o; return *this; }
+        String& operator+=(char c) { s += c; return *this; }
+        friend String operator+(const String& a, const String& b) { String r; r.s = a.s + b.s; return r; }
+        friend String operator+(const String& a, const char* b) { String r; r.s = a.s + b; return r; }
+        friend String operator+(const char* a, const String& b) { String r; r.s = std::string(a) + b.s; return r; }
+        bool operator==(const char* o) const { return s == o; }
+        bool operator==(const String& o) const { return s == o.s; }
+        bool operator!=(const char* o) const { return s != o; }
+        bool equalsIgnoreCase(const String& o) const { return strcasecmp(s.c_str(), o.s.c_str()) == 0; }
+        bool startsWith(const String& p) const { return s.rfind(p.s, 0) == 0; }
+        int indexOf(char c, unsigned from = 0) const { size_t p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+        int indexOf(const char* c, unsigned from = 0) const { size_t p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+        String substring(unsigned a) const { String r; r.s = s.substr(a); return r; }
+        String substring(unsigned a, unsigned b) const { String r; r.s = s.substr(a, b - a); return r; }
+        long toInt() const { return atol(s.c_str()); }
+        float toFloat() const { return atof(s.c_str()); }
+        void toCharArray(char* b, unsigned n) const { strncpy(b, s.c_str(), n); }
+        void trim() {
+            size_t a = s.find_first_not_of(" \t\r\n");
+            size_t b = s.find_last_not_of(" \t\r\n");
+            s = (a == std::string::npos) ? "" : s.substr(a, b - a + 1);
+        }
+        void toLowerCase() { for (char& c : s) c = tolower(c); }
+};
+
+// ==================== STREAMS ====================
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t) = 0;
+        virtual size_t write(const uint8_t* b, size_t n) {
+            size_t r = 0;
+            while (n--) r += write(*b++);
+            return r;
+        }
+        virtual void flush() {}
+
+        size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+        size_t print(const String& s) { return print(s.c_str()); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int v) { return printf("%d", v); }
+        size_t print(unsigned long v) { return printf("%lu", v); }
+        size_t print(unsigned v, int base) { return printf(base == 16 ? "%X" : "%u", v); }
+        size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+        size_t println() { return print("\n"); }
+        size_t println(const char* s) { return print(s) + println(); }
+        size_t println(const String& s) { return print(s) + println(); }
+        size_t println(int v) { return print(v) + println(); }
+        size_t println(unsigned long v) { return print(v) + println(); }
+        size_t println(double v, int digits = 2) { return print(v, digits) + println(); }
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+            char buffer[512];
+            va_list args;
+            va_start(args, format);
+            vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            return print(buffer);
+        }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        size_t readBytes(uint8_t* b, size_t n) {
+            size_t k = 0;
+            while (k < n && available() > 0) b[k++] = read();
+            return k;
+        }
+        void setTimeout(unsigned long) {}
+        String readStringUntil(char) { return String(); }
+};
+
+// Console; quiet drops output (the fuzzer turns it on)
+class HardwareSerial : public Stream {
+    public:
+        bool quiet = false;
+
+        HardwareSerial(int = 0) {}
+        void begin(unsigned long, int = 0, int = 0, int = 0) {}
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        size_t write(uint8_t c) override {
+            if (!quiet) putchar(c);
+            return 1;
+        }
+        using Print::write;
+        void setRxTimeout(int) {}
+        uint32_t baudRate() { return 9600; }
+};
+
+#define SERIAL_8N1 0
+extern HardwareSerial Serial;
+
+class IPAddress {
+    public:
+        uint8_t bytes[4] = { 0, 0, 0, 0 };
+
+        IPAddress() {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{ a, b, c, d } {}
+        IPAddress(uint32_t v) { memcpy(bytes, &v, 4); }
+        bool fromString(const char* s) { return sscanf(s, "%hhu.%hhu.%hhu.%hhu", &bytes[0], &bytes[1], &bytes[2], &bytes[3]) == 4; }
+        bool fromString(const String& s) { return fromString(s.c_str()); }
+        String toString() const {
+            char b[16];
+            snprintf(b, sizeof(b), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+            return String(b);
+        }
+        operator uint32_t() const { uint32_t v; memcpy(&v, bytes, 4); return v; }
+        uint8_t operator[](int i) const { return bytes[i]; }
+        bool operator==(const IPAddress& o) const { return memcmp(bytes, o.bytes, 4) == 0; }
+};
+
+struct EspClass {
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getMinFreeHeap() { return 0; }
+    uint32_t getFreePsram() { return 0; }
+    const char* getChipModel() { return "host"; }
+};
+extern EspClass ESP;
+
+// ==================== FREERTOS ====================
+// Single-threaded host: tasks never start, locks always succeed
+
+#define pdMS_TO_TICKS(x) (x)
+#define portMAX_DELAY 0xffffffff
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portYIELD_FROM_ISR() do {} while (0)
+
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t) { return pdFALSE; }
+inline void vTaskDelay(TickType_t) {}
+inline void vTaskDelete(TaskHandle_t) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline void xTaskNotifyGive(TaskHandle_t) {}
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+inline TickType_t xTaskGetTickCount() { return millis(); }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return nullptr; }
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return nullptr; }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return nullptr; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) { return pdTRUE; }
+inline TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t) { return nullptr; }
+inline int xPortInIsrContext() { return 0; }
+inline uint32_t esp_random() { return rand(); }
+
+#include "Client.h"
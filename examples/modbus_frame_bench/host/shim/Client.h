@@ -0,0 +1,71 @@
+// Arduino Client interface plus MemoryClient, an in-memory socket: reads
+// come from a buffer handed to feed(), writes are counted and kept.
+#pragma once
+
+#include "Arduino.h"
+#include <vector>
+
+class Client : public Stream {
+    public:
+        virtual int connect(IPAddress ip, uint16_t port) = 0;
+        virtual int connect(const char* host, uint16_t port) = 0;
+        virtual size_t write(uint8_t) = 0;
+        virtual size_t write(const uint8_t* buf, size_t size) = 0;
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int read(uint8_t* buf, size_t size) = 0;
+        virtual int peek() = 0;
+        virtual void flush() = 0;
+        virtual void stop() = 0;
+        virtual uint8_t connected() = 0;
+        virtual operator bool() = 0;
+};
+
+class MemoryClient : public Client {
+    private:
+        const uint8_t* rx = nullptr;
+        size_t rxLen = 0;
+        size_t rxPos = 0;
+        size_t maxRead = SIZE_MAX;      // Bytes per available()/read(), to split frames like TCP does
+        bool open = false;
+
+    public:
+        std::vector<uint8_t> tx;        // Everything written, unless keepWrites is off
+        bool keepWrites = true;
+        size_t txBytes = 0;
+
+        // Serve these bytes (not copied) as the inbound stream
+        void feed(const uint8_t* data, size_t len, size_t chunk = SIZE_MAX) {
+            rx = data;
+            rxLen = len;
+            rxPos = 0;
+            maxRead = chunk ? chunk : 1;
+            open = true;
+        }
+
+        size_t unread() const { return rxLen - rxPos; }
+
+        int connect(IPAddress, uint16_t) override { open = true; return 1; }
+        int connect(const char*, uint16_t) override { open = true; return 1; }
+        size_t write(uint8_t b) override { return write(&b, 1); }
+        size_t write(const uint8_t* buf, size_t size) override {
+            if (keepWrites) tx.insert(tx.end(), buf, buf + size);
+            txBytes += size;
+            return size;
+        }
+        int available() override { return (int)std::min(unread(), maxRead); }
+        int read() override { return rxPos < rxLen ? rx[rxPos++] : -1; }
+        int read(uint8_t* buf, size_t size) override {
+            size_t n = std::min(std::min(size, unread()), maxRead);
+            memcpy(buf, rx + rxPos, n);
+            rxPos += n;
+            return (int)n;
+        }
+        int peek() override { return rxPos < rxLen ? rx[rxPos] : -1; }
+        void flush() override {}
+        void stop() override { open = false; }
+        uint8_t connected() override { return open; }
+        operator bool() override { return open; }
+        IPAddress remoteIP() { return IPAddress(127, 0, 0, 1); }
+        uint16_t remotePort() { return 0; }
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include "Arduino.h"
+
+enum EthernetLinkStatus { Unknown, LinkON, LinkOFF };
+
+class EthernetClient : public MemoryClient {
+    public:
+        void setConnectionTimeout(uint16_t) {}
+        uint8_t status() { return 0; }
+        int availableForWrite() { return 2048; }
+};
+
+class EthernetServer {
+    public:
+        EthernetServer(uint16_t) {}
+        void begin() {}
+        EthernetClient available() { return EthernetClient(); }
+        EthernetClient accept() { return EthernetClient(); }
+};
+
+struct EthernetClass {
+    EthernetLinkStatus linkStatus() { return LinkON; }
+    IPAddress localIP() { return IPAddress(); }
+};
+extern EthernetClass Ethernet;
@@ -0,0 +1,27 @@
+#pragma once
+#include "Arduino.h"
+
+// modbus-esp8266 master API; no serial bus on the host, so every request
+// is refused and the gateway and poller stay idle
+struct Modbus {
+    enum ResultCode { EX_SUCCESS = 0x00, EX_ILLEGAL_FUNCTION = 0x01, EX_ILLEGAL_ADDRESS = 0x02,
+                      EX_ILLEGAL_VALUE = 0x03, EX_SLAVE_FAILURE = 0x04, EX_TIMEOUT = 0xE4 };
+};
+
+typedef std::function<bool(Modbus::ResultCode, uint16_t, void*)> cbTransaction;
+
+class ModbusRTU {
+    public:
+        void begin(Stream*, int = -1) {}
+        void master() {}
+        void task() {}
+        bool slave() { return false; }
+        uint16_t readHreg(uint8_t, uint16_t, uint16_t*, uint16_t, cbTransaction = nullptr) { return 0; }
+        uint16_t readIreg(uint8_t, uint16_t, uint16_t*, uint16_t, cbTransaction = nullptr) { return 0; }
+        uint16_t readCoil(uint8_t, uint16_t, bool*, uint16_t, cbTransaction = nullptr) { return 0; }
+        uint16_t readIsts(uint8_t, uint16_t, bool*, uint16_t, cbTransaction = nullptr) { return 0; }
+        uint16_t writeHreg(uint8_t, uint16_t, uint16_t, cbTransaction = nullptr) { return 0; }
+        uint16_t writeHreg(uint8_t, uint16_t, uint16_t*, uint16_t, cbTransaction = nullptr) { return 0; }
+        uint16_t writeCoil(uint8_t, uint16_t, bool, cbTransaction = nullptr) { return 0; }
+        uint16_t writeCoil(uint8_t, uint16_t, bool*, uint16_t, cbTransaction = nullptr) { return 0; }
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include "Arduino.h"
+
+// Always empty: every getter returns its default
+class Preferences {
+    public:
+        bool begin(const char*, bool = false) { return true; }
+        void end() {}
+        bool clear() { return true; }
+        bool isKey(const char*) { return false; }
+        bool getBool(const char*, bool d = false) { return d; }
+        uint8_t getUChar(const char*, uint8_t d = 0) { return d; }
+        uint16_t getUShort(const char*, uint16_t d = 0) { return d; }
+        uint32_t getUInt(const char*, uint32_t d = 0) { return d; }
+        String getString(const char*, String d = String()) { return d; }
+        size_t putBool(const char*, bool) { return 1; }
+        size_t putUChar(const char*, uint8_t) { return 1; }
+        size_t putUShort(const char*, uint16_t) { return 1; }
+        size_t putUInt(const char*, uint32_t) { return 1; }
+        size_t putString(const char*, String) { return 1; }
+};
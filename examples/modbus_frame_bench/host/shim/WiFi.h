@@ -0,0 +1,29 @@
+#pragma once
+#include "Arduino.h"
+
+#define WL_CONNECTED 3
+
+class WiFiClient : public MemoryClient {
+    public:
+        int connect(IPAddress ip, uint16_t port, int32_t) { return MemoryClient::connect(ip, port); }
+        using MemoryClient::connect;
+        int fd() const { return -1; }
+        int setNoDelay(bool) { return 0; }
+};
+
+class WiFiServer {
+    public:
+        WiFiServer(uint16_t) {}
+        void begin() {}
+        void end() {}
+        void setNoDelay(bool) {}
+        WiFiClient available() { return WiFiClient(); }
+        WiFiClient accept() { return WiFiClient(); }
+};
+
+struct WiFiClass {
+    int status() { return 0; }
+    IPAddress localIP() { return IPAddress(); }
+    int hostByName(const char*, IPAddress&) { return 0; }
+};
+extern WiFiClass WiFi;
@@ -0,0 +1,9 @@
+// Globals the Arduino core would define
+#include "Arduino.h"
+#include "Ethernet.h"
+#include "WiFi.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+EthernetClass Ethernet;
+WiFiClass WiFi;
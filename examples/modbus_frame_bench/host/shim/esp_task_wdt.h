@@ -0,0 +1,4 @@
+#pragma once
+#include "Arduino.h"
+
+inline int esp_task_wdt_reset() { return 0; }
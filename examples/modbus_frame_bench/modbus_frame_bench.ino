@@ -0,0 +1,211 @@
+/**
+ * @file modbus_frame_bench.ino
+ * @brief Throughput and robustness check for the Modbus TCP frame processor
+ *
+ * Runs tcpModbusBuildResponse() - the pure request-to-response part of
+ * tcp_modbus_simple.h - without any network:
+ * - Benchmark: frames/s and ns/frame for every built-in function code
+ * - Truncation: every prefix of every benchmark frame, with a lying MBAP
+ *   length, must be answered with an exception or rejected
+ * - Random frames: mutated and fully random frames must never write past
+ *   the 260-byte response buffer
+ *
+ * Nothing is sent on the network; the board only needs a serial console.
+ * host/ builds the same code on Linux: a benchmark that includes the MBAP
+ * reader, and a libFuzzer target ("make check" there).
+ */
+
+#include <Preferences.h>
+
+Preferences tcpModbusPref;
+
+#include <tcp_modbus_simple.h>
+
+#define BENCH_ITERATIONS    20000
+#define RANDOM_FRAMES       200000
+#define GUARD_BYTE          0xA5
+#define GUARD_LEN           32
+
+struct BenchFrame {
+    const char* name;
+    uint8_t adu[MB_TCP_MAX_ADU];
+    uint16_t len;
+};
+
+static BenchFrame frames[10];
+static uint8_t frameCount = 0;
+
+// Response buffer with a guard zone behind it to catch overruns
+static uint8_t responseBuf[MB_TCP_MAX_ADU + GUARD_LEN];
+
+static uint32_t rngState = 0x12345678;
+
+static uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static void addFrame(const char* name, const uint8_t* pdu, uint16_t pduLen) {
+    BenchFrame& f = frames[frameCount++];
+    f.name = name;
+    f.adu[0] = 0x00;
+    f.adu[1] = frameCount;
+    f.adu[2] = 0x00;
+    f.adu[3] = 0x00;
+    f.adu[4] = (pduLen + 1) >> 8;
+    f.adu[5] = (pduLen + 1) & 0xFF;
+    f.adu[6] = 0x01;
+    memcpy(&f.adu[MB_MBAP_HEADER_LEN], pdu, pduLen);
+    f.len = MB_MBAP_HEADER_LEN + pduLen;
+}
+
+static void buildFrames() {
+    const uint8_t fc01[] = { 0x01, 0x00, 0x00, 0x00, 0x40 };
+    const uint8_t fc02[] = { 0x02, 0x00, 0x00, 0x00, 0x40 };
+    const uint8_t fc03[] = { 0x03, 0x00, 0x00, 0x00, 0x64 };
+    const uint8_t fc04[] = { 0x04, 0x00, 0x00, 0x00, 0x64 };
+    const uint8_t fc05[] = { 0x05, 0x00, 0x03, 0xFF, 0x00 };
+    const uint8_t fc06[] = { 0x06, 0x00, 0x05, 0x12, 0x34 };
+    addFrame("FC01 read 64 coils", fc01, sizeof(fc01));
+    addFrame("FC02 read 64 inputs", fc02, sizeof(fc02));
+    addFrame("FC03 read 100 regs", fc03, sizeof(fc03));
+    addFrame("FC04 read 100 regs", fc04, sizeof(fc04));
+    addFrame("FC05 write coil", fc05, sizeof(fc05));
+    addFrame("FC06 write reg", fc06, sizeof(fc06));
+
+    uint8_t fc15[6 + 8] = { 0x0F, 0x00, 0x00, 0x00, 0x40, 0x08 };
+    memset(&fc15[6], 0x55, 8);
+    addFrame("FC15 write 64 coils", fc15, sizeof(fc15));
+
+    uint8_t fc16[6 + 100 * 2] = { 0x10, 0x00, 0x00, 0x00, 0x64, 0xC8 };
+    for (uint16_t i = 0; i < 100; i++) {
+        fc16[6 + i * 2] = i >> 8;
+        fc16[7 + i * 2] = i & 0xFF;
+    }
+    addFrame("FC16 write 100 regs", fc16, sizeof(fc16));
+
+    uint8_t fc23[10 + 20 * 2] = { 0x17, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0x14, 0x28 };
+    addFrame("FC23 r100/w20 regs", fc23, sizeof(fc23));
+
+    const uint8_t bad[] = { 0x03, 0x7F, 0x00, 0x00, 0x10 };
+    addFrame("FC03 bad address", bad, sizeof(bad));
+}
+
+static bool guardIntact() {
+    for (uint16_t i = 0; i < GUARD_LEN; i++) {
+        if (responseBuf[MB_TCP_MAX_ADU + i] != GUARD_BYTE) return false;
+    }
+    return true;
+}
+
+// Process one frame and check the response is a sane Modbus TCP ADU
+static bool checkFrame(const uint8_t* adu, uint16_t len) {
+    uint16_t n = tcpModbusBuildResponse(adu, len, responseBuf);
+    if (!guardIntact()) return false;
+    if (n == 0) return len < MB_MBAP_HEADER_LEN + 1;
+    if (n < MB_MBAP_HEADER_LEN + 2 || n > MB_TCP_MAX_ADU) return false;
+    uint16_t mbapLen = (responseBuf[4] << 8) | responseBuf[5];
+    return mbapLen == n - 6 && responseBuf[0] == adu[0] && responseBuf[1] == adu[1];
+}
+
+static void runBenchmark() {
+    Serial.println("\n--- Throughput ---");
+    Serial.printf("%-22s %12s %10s\n", "Frame", "frames/s", "ns/frame");
+    for (uint8_t f = 0; f < frameCount; f++) {
+        const BenchFrame& frame = frames[f];
+        int64_t start = esp_timer_get_time();
+        for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+            tcpModbusBuildResponse(frame.adu, frame.len, responseBuf);
+        }
+        int64_t elapsedUs = esp_timer_get_time() - start;
+        if (elapsedUs <= 0) elapsedUs = 1;
+        double nsPerFrame = (double)elapsedUs * 1000.0 / BENCH_ITERATIONS;
+        Serial.printf("%-22s %12.0f %10.0f\n", frame.name, 1e9 / nsPerFrame, nsPerFrame);
+    }
+}
+
+// Every prefix of every frame, keeping the original MBAP length so the
+// header claims more data than is present
+static uint32_t runTruncation() {
+    uint32_t failures = 0;
+    for (uint8_t f = 0; f < frameCount; f++) {
+        const BenchFrame& frame = frames[f];
+        for (uint16_t len = 0; len < frame.len; len++) {
+            if (!checkFrame(frame.adu, len)) {
+                Serial.printf("✗ %s truncated to %u bytes\n", frame.name, len);
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+// Half the frames are benchmark frames with random bytes flipped, the rest
+// are random bytes of random length with a plausible MBAP header
+static uint32_t runRandom() {
+    uint8_t adu[MB_TCP_MAX_ADU];
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < RANDOM_FRAMES; i++) {
+        uint16_t len;
+        if (i & 1) {
+            const BenchFrame& frame = frames[nextRandom() % frameCount];
+            memcpy(adu, frame.adu, frame.len);
+            len = frame.len;
+            uint8_t flips = 1 + nextRandom() % 4;
+            for (uint8_t k = 0; k < flips; k++) {
+                adu[MB_MBAP_HEADER_LEN + nextRandom() % (len - MB_MBAP_HEADER_LEN)] = nextRandom();
+            }
+            if (nextRandom() % 4 == 0) len = MB_MBAP_HEADER_LEN + nextRandom() % (len - MB_MBAP_HEADER_LEN + 1);
+        } else {
+            len = nextRandom() % (MB_TCP_MAX_ADU + 1);
+            for (uint16_t k = 0; k < len; k++) adu[k] = nextRandom();
+            if (len >= 6) {
+                adu[2] = 0x00;
+                adu[3] = 0x00;
+                adu[4] = 0x00;
+                adu[5] = len - 6;
+            }
+        }
+
+        if (!checkFrame(adu, len)) {
+            Serial.printf("✗ Random frame %lu (len %u, FC 0x%02X)\n", (unsigned long)i, len,
+                          len > MB_MBAP_HEADER_LEN ? adu[MB_MBAP_HEADER_LEN] : 0);
+            failures++;
+            memset(&responseBuf[MB_TCP_MAX_ADU], GUARD_BYTE, GUARD_LEN);
+        }
+        if ((i & 0x3FFF) == 0) yield();
+    }
+    return failures;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.println("\n=== Modbus TCP Frame Processor Bench ===");
+    memset(responseBuf, 0, sizeof(responseBuf));
+    memset(&responseBuf[MB_TCP_MAX_ADU], GUARD_BYTE, GUARD_LEN);
+
+    // Map the default layout and give the registers some content
+    for (uint16_t i = 0; i < MB_REG_HOLDING_COUNT; i++) {
+        tcpModbusSetHoldingRegister(i, i * 3);
+        tcpModbusSetInputRegister(i, i * 7);
+    }
+    buildFrames();
+
+    runBenchmark();
+
+    Serial.println("\n--- Robustness ---");
+    uint32_t truncated = runTruncation();
+    Serial.printf("Truncated frames: %s (%lu failures)\n", truncated ? "FAIL" : "pass", (unsigned long)truncated);
+    uint32_t random = runRandom();
+    Serial.printf("Random frames (%d): %s (%lu failures)\n", RANDOM_FRAMES, random ? "FAIL" : "pass", (unsigned long)random);
+
+    Serial.println("\n=== Done ===");
+}
+
+void loop() {
+    delay(1000);
+}
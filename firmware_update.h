@@ -54,6 +54,7 @@ size_t getTotalBytes() { return total_firmware_size; }
 String getOTAStatus() { return current_ota_status; }
 bool isOTAInProgress() { return ota_in_progress; }
 
+// Sent at QoS 1 so a dropped connection before the PUBACK resends it
 void sendOTAStatusToMQTT(const String& status, const String& message, const String& version = "") {
   if (!mqtt_obj.connected()) {
     Serial.println("✗ MQTT not connected, cannot send OTA status");
@@ -90,8 +91,8 @@ void sendOTAStatusToMQTT(const String& status, const String& message, const Stri
   
   String otaStatusTopic = mqtt_obj.getMacTopic("ota/status");
   
-  if (mqtt_obj.publish(otaStatusTopic.c_str(), otaStatusPayload.c_str(), true)) {
-    Serial.println("✓ OTA status sent to MQTT successfully");
+  if (mqtt_obj.publishQos1To(otaStatusTopic.c_str(), (const uint8_t*)otaStatusPayload.c_str(), otaStatusPayload.length(), true)) {
+    Serial.println("✓ OTA status queued for MQTT (QoS 1)");
     Serial.println("Topic: " + otaStatusTopic);
     Serial.println("Status: " + status);
     Serial.println("Message: " + message);
@@ -362,8 +363,8 @@ void publishOTAStatus(const String& status, const String& message) {
     String payload;
     serializeJson(doc, payload);
     
-    // Publish to update/status topic
-    bool published = mqtt_obj.publish(mqtt_obj.getTopic("update/status").c_str(), payload.c_str());
+    // Publish to update/status topic at QoS 1 so the result is not lost
+    bool published = mqtt_obj.publishQos1("update/status", payload.c_str());
     Serial.print("[OTA] Status published: "); 
     Serial.print(payload);
     Serial.println(published ? " OK" : " FAIL");
@@ -52,6 +52,8 @@ RTCManager rtc(0);
 #include "FilesystemManager.h"
 #include "jsonoperation.h"
 #include "MQTT_Lib.h"
+#include "mqtt_spool.h"
+#include "mqtt_topic_router.h"
 #include "PCF8574_Input.h"
 #include "PCF8574_Output.h"
 #include "pindefinition.h"
@@ -173,6 +175,8 @@ DynamicJsonDocument subtopic(512);
 FilesystemManager fsManagerFFat(FilesystemType::FFAT);
 
 MQTT_Lib mqtt_obj;
+MQTTSpool mqttSpool;    // FFat store-and-forward queue ("mqtt spool on")
+MQTTPublishQueue mqttQueue; // Lock-free outbound ring drained by the MQTT task
 
 unsigned long execution_timer = 0;
 
@@ -186,6 +190,7 @@ extern void IRAM_ATTR inputISR();
 WebServer syncServer(80);
 
 std::function<void(char*, uint8_t*, unsigned int)> mqtt_callback = nullptr;
+MQTTTopicRouter mqttRouter;     // Filter routes, tried before mqtt_callback
 
 
 
@@ -199,6 +204,10 @@ void mqttcallbackmain(char *topic, byte *payload, unsigned int length)
         length = 4096;
     }
 
+    if (mqttRouter.dispatch(topic, payload, length) > 0) {
+        return;
+    }
+
     if (mqtt_callback) {
         mqtt_callback(topic, payload, length);
     }else{
@@ -222,6 +231,13 @@ void mqtt_setcallback(std::function<void(char*, uint8_t*, unsigned int)> callbac
     mqtt_callback = callback;
 }
 
+// Handle topics matching an MQTT filter (+ and # wildcards); messages no
+// route matches still go to the mqtt_setcallback() handler
+bool mqtt_route(const char* filter, MQTTRouteHandler handler)
+{
+    return mqttRouter.on(filter, handler);
+}
+
 void setupSyncWebServer() {
     syncServer.on("/", HTTP_GET, []() {
         syncServer.send(200, "text/html", "<h1>Ethernet Web Server Working!</h1>");
@@ -405,13 +421,68 @@ void publishPeripheralStatus() {
     doc["timestamp"] = String(rtc.getDateTime());
 
     // Publish as retained message
-    String topic = mqtt_obj.getTopic("metadata/status");
-    String payload;
-    serializeJson(doc, payload);
-    mqtt_obj.publish(topic.c_str(), payload.c_str(), true);  // retained = true
+    mqtt_obj.publishJson("metadata/status", doc, true);  // retained = true
     Serial.println("[MQTT] Published peripheral status to metadata/status");
 }
 
+// ==================== MODBUS STATISTICS PUBLISHER ====================
+#define MODBUS_STATS_PUBLISH_MS     60000   // metadata/modbus_stats interval
+
+// Histogram buckets are log2 microseconds: bucket b counts replies under
+// 2^b us, the last one everything slower
+static void addModbusHistogram(JsonObject obj, const TCPModbusHistogram& hist) {
+    obj["requests"] = hist.count;
+    obj["exceptions"] = hist.exceptions;
+    obj["p50_us"] = tcpModbusHistPercentile(hist, 50);
+    obj["p99_us"] = tcpModbusHistPercentile(hist, 99);
+    obj["max_us"] = hist.maxUs;
+    JsonArray buckets = obj.createNestedArray("hist");
+    for (uint8_t b = 0; b < TCP_MODBUS_HIST_BUCKETS; b++) {
+        buckets.add(hist.buckets[b]);
+    }
+}
+
+void publishModbusStats() {
+    if (mqtt_obj.connectionStatus() != MQTT_CONNECTED || !tcpModbusIsRunning()) return;
+
+    DynamicJsonDocument doc(6144);
+    TCPModbusCounters counters;
+    tcpModbusGetStats(&counters);
+    doc["requests"] = counters.requests;
+    doc["exceptions"] = counters.exceptions;
+    doc["malformed"] = counters.malformed;
+    doc["bytes_in"] = counters.bytesIn;
+    doc["bytes_out"] = counters.bytesOut;
+
+    JsonObject fcs = doc.createNestedObject("fc");
+    for (uint8_t i = 0; i < TCP_MODBUS_STATS_FCS; i++) {
+        uint8_t fc;
+        TCPModbusHistogram hist;
+        tcpModbusGetFcStats(i, &fc, &hist);
+        if (hist.count == 0) continue;
+        addModbusHistogram(fcs.createNestedObject(fc ? String(fc) : String("other")), hist);
+    }
+
+    JsonArray clients = doc.createNestedArray("clients");
+    for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+        IPAddress ip;
+        TCPModbusHistogram hist;
+        uint32_t bytesIn, bytesOut;
+        if (!tcpModbusGetClientStats(i, &ip, &hist, &bytesIn, &bytesOut)) continue;
+        JsonObject client = clients.createNestedObject();
+        client["slot"] = i;
+        client["ip"] = ip.toString();
+        client["bytes_in"] = bytesIn;
+        client["bytes_out"] = bytesOut;
+        addModbusHistogram(client, hist);
+    }
+
+    doc["uptime_sec"] = millis() / 1000;
+    doc["timestamp"] = String(rtc.getDateTime());
+
+    mqtt_obj.publishJson("metadata/modbus_stats", doc);
+}
+
 void boardinit(){
 
     Serial.begin(115200);
@@ -651,6 +722,36 @@ void boardinit(){
         // mqtt_obj.setsubtopic(subtopic);
         mqtt_obj.setCallback(mqttcallbackmain);
         mqtt_obj.setMacAddress(mac_str);
+
+        if (mqttPref.getBool("spool", false)) {
+            if (filesystemReady && mqttSpool.begin(FFat, mqttPref.getUInt("spoolkb", MQTT_SPOOL_BUDGET_BYTES / 1024) * 1024)) {
+                mqttSpool.setReplayRate(mqttPref.getUShort("spoolrate", MQTT_SPOOL_REPLAY_RATE));
+                mqtt_obj.setSpool(&mqttSpool);
+            } else {
+                Serial.println("[MQTT] Spool enabled but filesystem not ready - messages are not kept offline");
+            }
+        }
+
+        if (mqttPref.getUShort("qslots", MQTT_QUEUE_SLOTS) > 0 &&
+            mqttQueue.begin(mqttPref.getUShort("qslots", MQTT_QUEUE_SLOTS), mqttPref.getUShort("qbytes", MQTT_QUEUE_PAYLOAD_MAX))) {
+            mqttQueue.setOverflowPolicy((MQTTQueueOverflow)mqttPref.getUChar("qpolicy", MQTT_QUEUE_DROP_OLDEST),
+                                        mqttPref.getUInt("qblockms", MQTT_QUEUE_BLOCK_MS));
+            mqtt_obj.setQueue(&mqttQueue);
+        }
+
+        // QoS 1 window. Clean session unless "mqtt session persistent":
+        // a broker-side session keeps unacknowledged messages across a
+        // reconnect but changes what the broker stores for this client
+        mqtt_obj.setInflightWindow(mqttPref.getUChar("inflight", MQTT_INFLIGHT_WINDOW));
+        mqtt_obj.setCleanSession(!mqttPref.getBool("persist", false));
+
+        // Connection management runs from boardloop() unless "mqtt task on".
+        // On the task, message callbacks run on MQTTTask (MQTT_TASK_STACK)
+        // alongside boardloop(), so handlers must not touch loop-owned state.
+        mqtt_obj.setNetworkLock(tcpModbusNetworkLock());
+        if (mqttPref.getBool("taskmode", false)) {
+            mqtt_obj.startTask();
+        }
     }
     mqttPref.end();
     yield();
@@ -758,8 +859,9 @@ void boardloop(){
             Serial.println("[Web] Sync server started for Ethernet");
         }
     }
-    if(syncServerStarted) {
+    if(syncServerStarted && tcpModbusTryLockNetwork(5)) {
         syncServer.handleClient();
+        tcpModbusUnlockNetwork();
     }
     
     yield(); // Feed watchdog after web server
@@ -818,18 +920,31 @@ void boardloop(){
     if(ms_100loop.ontime()){
         yield(); // Feed before mqtt operations
         // Place 100-millisecond interval tasks here
+        if(mqttEnabled){
+            mqtt_obj.setNetworkReady(conn_status > 0 || wifi_connected);
+        }
         if (conn_status > 0 || wifi_connected){
             execution_timer = millis();
             if(mqttEnabled){
                 static bool prev_mqtt_connected = false;
-                mqtt_obj.loop();
+                mqtt_obj.loop();    // No-op when the MQTT task runs the connection
                 mqtt_connected = (mqtt_obj.connectionStatus() == MQTT_CONNECTED);
-                // Publish peripheral status on fresh MQTT connection
-                if (mqtt_connected && !prev_mqtt_connected) {
-                    Serial.println("[MQTT] Connected - publishing peripheral status...");
-                    publishPeripheralStatus();
+                if (!mqtt_connected) {
+                    prev_mqtt_connected = false;
+                } else if (mqtt_obj.lockNetwork(MQTT_LOCK_WAIT_MS)) {  // Busy: try again next tick
+                    // Publish peripheral status on fresh MQTT connection
+                    if (!prev_mqtt_connected) {
+                        Serial.println("[MQTT] Connected - publishing peripheral status...");
+                        publishPeripheralStatus();
+                    }
+                    static unsigned long last_modbus_stats = 0;
+                    if (tcpModbusEnabled && millis() - last_modbus_stats >= MODBUS_STATS_PUBLISH_MS) {
+                        last_modbus_stats = millis();
+                        publishModbusStats();
+                    }
+                    mqtt_obj.unlockNetwork();
+                    prev_mqtt_connected = true;
                 }
-                prev_mqtt_connected = mqtt_connected;
             }
             unsigned long mqtt_time = millis() - execution_timer;
             if(mqtt_time > 500){
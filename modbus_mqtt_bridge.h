@@ -0,0 +1,276 @@
+#ifndef MODBUS_MQTT_BRIDGE_H
+#define MODBUS_MQTT_BRIDGE_H
+
+// Report-by-exception bridge from the Modbus register map to MQTT.
+//
+// Each tag names a register (or register pair), coil or discrete input in
+// the map. Every scan interval the bridge reads all tags and publishes
+// only those that moved beyond their deadband since they were last
+// reported; every integrity interval (and on each reconnect) it publishes
+// all of them. Works with either TCP Modbus backend since both store their
+// registers in the shared map. Changes that do not fit one JSON document
+// go out as several messages, each with its own timestamp.
+//
+//   ModbusMqttBridge bridge(&mqtt_obj, "modbus/values", 1024);
+//   bridge.addTag("temperature", MB_TYPE_INPUT, 0, TAG_FLOAT, 0.5);    // +-0.5 absolute
+//   bridge.addTag("pressure", MB_TYPE_HOLDING, 10, TAG_U16, 2, true);   // +-2 %
+//   bridge.addTag("pump", MB_TYPE_COIL, 3, TAG_BOOL);
+//   ...
+//   bridge.loop();
+
+#include "MQTT_Lib.h"
+#include "RTCManager.h"
+#include "deadband.h"
+#include "modbus_register_map.h"
+
+extern RTCManager rtc;
+
+#define MODBUS_BRIDGE_MAX_TAGS          64
+#define MODBUS_BRIDGE_SCAN_MS           1000    // Default change scan interval
+#define MODBUS_BRIDGE_INTEGRITY_MS      300000  // Default full snapshot interval (5 min)
+#define MODBUS_BRIDGE_ERROR_LOG_MS      60000   // Minimum gap between repeated error logs
+
+enum ModbusTagFormat {
+    TAG_U16 = 0,
+    TAG_S16,
+    TAG_U32,        // Two registers, high word first
+    TAG_S32,
+    TAG_FLOAT,      // Two registers, high word first
+    TAG_BOOL        // Coils and discrete inputs
+};
+
+struct ModbusTag {
+    const char* name;
+    ModbusRegType type;
+    uint16_t address;
+    ModbusTagFormat format;
+    float scale;            // Published value = raw * scale
+    float deadband;         // Absolute units, or percent of the last report
+    bool percent;
+    bool reported;          // lastReported is valid
+    double lastReported;
+};
+
+class ModbusMqttBridge {
+    private:
+        MQTT_Lib* mqttClient;
+        const char* topic;
+        DynamicJsonDocument* doc;
+        bool retained;
+        ModbusTag tags[MODBUS_BRIDGE_MAX_TAGS];
+        uint8_t tagCount = 0;
+        uint32_t scanMs = MODBUS_BRIDGE_SCAN_MS;
+        uint32_t integrityMs = MODBUS_BRIDGE_INTEGRITY_MS;
+        unsigned long lastScan = 0;
+        unsigned long lastIntegrity = 0;
+        bool snapshotPending = true;
+        uint32_t reports = 0;
+        uint32_t snapshots = 0;
+        uint32_t valuesSent = 0;
+        uint32_t messages = 0;
+        uint32_t overflows = 0;     // Tags too large for the document on their own
+        unsigned long lastErrorLog = 0;
+        bool errorLogged = false;
+
+        // Raw value of a tag, read under the map seqlock so a 32-bit pair
+        // is never split
+        bool readTag(const ModbusTag& tag, double* value) {
+            if (tag.format == TAG_BOOL) {
+                *value = modbusMapGetBit(tag.type, tag.address) ? 1.0 : 0.0;
+                return modbusMapFind(tag.type, tag.address) != nullptr;
+            }
+
+            uint8_t words = (tag.format == TAG_U32 || tag.format == TAG_S32 || tag.format == TAG_FLOAT) ? 2 : 1;
+            const uint16_t* regs = modbusMapRegisters(tag.type, tag.address, words);
+            if (!regs) return false;
+            uint16_t raw[2] = {0, 0};
+            uint32_t seq;
+            do {
+                seq = modbusMapReadBegin();
+                raw[0] = regs[0];
+                if (words == 2) raw[1] = regs[1];
+            } while (modbusMapReadRetry(seq));
+
+            uint32_t u32 = ((uint32_t)raw[0] << 16) | raw[1];
+            switch (tag.format) {
+                case TAG_U16: *value = raw[0]; break;
+                case TAG_S16: *value = (int16_t)raw[0]; break;
+                case TAG_U32: *value = u32; break;
+                case TAG_S32: *value = (int32_t)u32; break;
+                case TAG_FLOAT: {
+                    float f;
+                    memcpy(&f, &u32, sizeof(f));
+                    *value = f;
+                    break;
+                }
+                default: return false;
+            }
+            *value *= tag.scale;
+            return true;
+        }
+
+        bool exceedsDeadband(const ModbusTag& tag, double value) {
+            if (!tag.reported) return true;
+            return ::exceedsDeadband(value, tag.lastReported, tag.deadband, tag.percent);
+        }
+
+        void addValue(const ModbusTag& tag, double value) {
+            if (tag.format == TAG_BOOL) {
+                (*doc)[tag.name] = value != 0;
+            } else if (tag.format == TAG_FLOAT || tag.scale != 1.0f) {
+                (*doc)[tag.name] = value;
+            } else {
+                (*doc)[tag.name] = (long long)value;
+            }
+        }
+
+        void beginDoc(bool snapshot) {
+            doc->clear();
+            (*doc)["timestamp"] = rtc.getDateTime();
+            if (snapshot) (*doc)["integrity"] = true;
+        }
+
+        void logOverflow(const ModbusTag& tag) {
+            overflows++;
+            unsigned long now = millis();
+            if (errorLogged && now - lastErrorLog < MODBUS_BRIDGE_ERROR_LOG_MS) return;
+            errorLogged = true;
+            lastErrorLog = now;
+            Serial.printf("[ModbusBridge] ✗ Tag %s does not fit the JSON document (%lu skipped)\n",
+                          tag.name, (unsigned long)overflows);
+        }
+
+    public:
+        ModbusMqttBridge(MQTT_Lib* client, const char* pub_topic, int json_size, bool retain_msg = false)
+            : mqttClient(client), topic(pub_topic), retained(retain_msg) {
+            doc = new DynamicJsonDocument(json_size);
+        }
+
+        ~ModbusMqttBridge() {
+            delete doc;
+        }
+
+        // Add a tag. deadband is in published units (after scale), or a
+        // percentage of the last reported value when percent is true; 0
+        // reports every change. Returns the tag index, or -1 if full.
+        int addTag(const char* name, ModbusRegType type, uint16_t address, ModbusTagFormat format = TAG_U16,
+                   float deadband = 0, bool percent = false, float scale = 1.0f) {
+            if (tagCount >= MODBUS_BRIDGE_MAX_TAGS) {
+                Serial.println("[ModbusBridge] ✗ Too many tags");
+                return -1;
+            }
+            if (modbusMapIsBitType(type) != (format == TAG_BOOL)) {
+                Serial.printf("[ModbusBridge] ✗ Tag %s: format does not match register type\n", name);
+                return -1;
+            }
+            ModbusTag& tag = tags[tagCount];
+            tag.name = name;
+            tag.type = type;
+            tag.address = address;
+            tag.format = format;
+            tag.scale = scale;
+            tag.deadband = deadband;
+            tag.percent = percent;
+            tag.reported = false;
+            tag.lastReported = 0;
+            return tagCount++;
+        }
+
+        void setScanInterval(uint32_t ms) {
+            scanMs = ms;
+        }
+
+        // 0 disables periodic snapshots (one is still sent on connect)
+        void setIntegrityInterval(uint32_t ms) {
+            integrityMs = ms;
+        }
+
+        void requestSnapshot() {
+            snapshotPending = true;
+        }
+
+        void loop() {
+            if (mqttClient->connectionStatus() != MQTT_CONNECTED) {
+                snapshotPending = true;     // Resend everything after reconnect
+                return;
+            }
+
+            unsigned long now = millis();
+            if (integrityMs > 0 && now - lastIntegrity >= integrityMs) snapshotPending = true;
+            if (!snapshotPending && now - lastScan < scanMs) return;
+            lastScan = now;
+
+            bool snapshot = snapshotPending;
+            double values[MODBUS_BRIDGE_MAX_TAGS];
+            uint8_t changed[MODBUS_BRIDGE_MAX_TAGS];
+            uint8_t count = 0;
+
+            for (uint8_t i = 0; i < tagCount; i++) {
+                if (!readTag(tags[i], &values[i])) continue;
+                if (snapshot || exceedsDeadband(tags[i], values[i])) changed[count++] = i;
+            }
+            if (count == 0) return;
+
+            // Fill a document until it overflows, drop the tag that did not
+            // fit and publish the rest; that tag starts the next message
+            uint8_t first = 0;
+            while (first < count) {
+                beginDoc(snapshot);
+                uint8_t end = first;
+                while (end < count) {
+                    addValue(tags[changed[end]], values[changed[end]]);
+                    if (doc->overflowed()) break;
+                    end++;
+                }
+                if (end == first) {
+                    // Too big on its own; mark it reported so it is not retried every scan
+                    ModbusTag& tag = tags[changed[first]];
+                    logOverflow(tag);
+                    tag.lastReported = values[changed[first]];
+                    tag.reported = true;
+                    first++;
+                    continue;
+                }
+                if (end < count) {
+                    beginDoc(snapshot);
+                    for (uint8_t j = first; j < end; j++) addValue(tags[changed[j]], values[changed[j]]);
+                }
+
+                if (!mqttClient->publishJson(topic, *doc, retained)) return;   // Rest retried next scan
+
+                for (uint8_t j = first; j < end; j++) {
+                    tags[changed[j]].lastReported = values[changed[j]];
+                    tags[changed[j]].reported = true;
+                }
+                valuesSent += end - first;
+                messages++;
+                first = end;
+            }
+
+            if (snapshot) {
+                snapshotPending = false;
+                lastIntegrity = now;
+                snapshots++;
+            } else {
+                reports++;
+            }
+        }
+
+        void printStatus() {
+            Serial.println("=== Modbus MQTT Bridge ===");
+            Serial.printf("Tags: %d, scan %lu ms, integrity %lu ms\n", tagCount,
+                          (unsigned long)scanMs, (unsigned long)integrityMs);
+            Serial.printf("Reports: %lu, snapshots: %lu, messages: %lu, values sent: %lu\n",
+                          (unsigned long)reports, (unsigned long)snapshots, (unsigned long)messages,
+                          (unsigned long)valuesSent);
+            if (overflows > 0) Serial.printf("Tags too large for the document: %lu\n", (unsigned long)overflows);
+            for (uint8_t i = 0; i < tagCount; i++) {
+                const ModbusTag& tag = tags[i];
+                Serial.printf("  %-16s %-8s %5u db %.2f%s last %.3f\n", tag.name, modbusMapTypeName(tag.type),
+                              tag.address, tag.deadband, tag.percent ? "%" : "", tag.lastReported);
+            }
+            Serial.println("==========================");
+        }
+};
+
+#endif // MODBUS_MQTT_BRIDGE_H
@@ -0,0 +1,366 @@
+#ifndef MODBUS_REGISTER_MAP_H
+#define MODBUS_REGISTER_MAP_H
+
+// Runtime-sized Modbus register map shared by the TCP Modbus backends.
+//
+// Each table (holding, input, coil, discrete) is a sorted list of address
+// blocks declared at init time, e.g. holding 40001-40100 plus 41000-43000.
+// Blocks larger than MB_MAP_PSRAM_THRESHOLD bytes go to PSRAM when present.
+// Lookups are a binary search over the blocks of one table, so a map of a
+// few blocks costs the same as the old fixed arrays.
+//
+// Declare blocks before the first register access. If nothing has been
+// declared by then, the legacy layout (MB_REG_*_COUNT at address 0) is
+// installed so existing sketches keep working.
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include "esp_heap_caps.h"
+
+#ifndef MB_REG_HOLDING_COUNT
+#define MB_REG_HOLDING_COUNT        100
+#endif
+#ifndef MB_REG_INPUT_COUNT
+#define MB_REG_INPUT_COUNT          100
+#endif
+#ifndef MB_REG_COIL_COUNT
+#define MB_REG_COIL_COUNT           64
+#endif
+#ifndef MB_REG_DISCRETE_COUNT
+#define MB_REG_DISCRETE_COUNT       64
+#endif
+
+#define MB_MAP_MAX_BLOCKS           8       // Blocks per table
+#define MB_MAP_PSRAM_THRESHOLD      1024    // Blocks at least this many bytes prefer PSRAM
+
+enum ModbusRegType {
+    MB_TYPE_HOLDING = 0,
+    MB_TYPE_INPUT = 1,
+    MB_TYPE_COIL = 2,
+    MB_TYPE_DISCRETE = 3,
+    MB_TYPE_COUNT = 4
+};
+
+struct ModbusRegBlock {
+    uint16_t start;     // First protocol address (0-based)
+    uint16_t count;     // Registers or bits
+    void* data;         // uint16_t[count] for registers, packed bits for coils/discretes
+    uint8_t* dirty;     // One bit per address, set by remote writes
+    bool psram;
+};
+
+struct ModbusRegTable {
+    ModbusRegBlock blocks[MB_MAP_MAX_BLOCKS];   // Sorted by start, non-overlapping
+    uint8_t count;
+};
+
+static ModbusRegTable mb_map[MB_TYPE_COUNT];
+static bool mb_map_ready = false;
+
+// Seqlock over the whole map. Writers (application setters and network
+// write requests) serialise on a recursive mutex and bump the sequence to
+// odd while they write; readers never lock, they copy and retry if the
+// sequence moved. Nested write sections only bump it once, which is what
+// lets a batch of setters publish as one consistent update.
+static std::atomic<uint32_t> mb_map_seq(0);
+static SemaphoreHandle_t mb_map_write_lock = nullptr;
+static uint8_t mb_map_write_depth = 0;
+
+// Called once per remote write request with the range it changed
+typedef std::function<void(ModbusRegType type, uint16_t start, uint16_t count)> ModbusWriteCallback;
+static ModbusWriteCallback mb_map_write_callback = nullptr;
+
+static inline bool modbusMapIsBitType(ModbusRegType type) {
+    return type == MB_TYPE_COIL || type == MB_TYPE_DISCRETE;
+}
+
+static size_t modbusMapBlockBytes(ModbusRegType type, uint16_t count) {
+    return modbusMapIsBitType(type) ? (count + 7) / 8 : count * sizeof(uint16_t);
+}
+
+const char* modbusMapTypeName(ModbusRegType type) {
+    switch (type) {
+        case MB_TYPE_HOLDING: return "holding";
+        case MB_TYPE_INPUT: return "input";
+        case MB_TYPE_COIL: return "coil";
+        case MB_TYPE_DISCRETE: return "discrete";
+        default: return "unknown";
+    }
+}
+
+// Declare a block of count addresses starting at start. Fails if the block
+// overlaps an existing one, the table is full or allocation fails.
+bool modbusMapAddBlock(ModbusRegType type, uint16_t start, uint16_t count) {
+    if (type >= MB_TYPE_COUNT || count == 0 || (uint32_t)start + count > 0x10000) return false;
+    if (!mb_map_write_lock) mb_map_write_lock = xSemaphoreCreateRecursiveMutex();
+    mb_map_ready = true;
+
+    ModbusRegTable& table = mb_map[type];
+    if (table.count >= MB_MAP_MAX_BLOCKS) {
+        Serial.printf("[ModbusMap] ✗ Too many %s blocks (max %d)\n", modbusMapTypeName(type), MB_MAP_MAX_BLOCKS);
+        return false;
+    }
+
+    // Find insertion point and reject overlaps with neighbours
+    uint8_t pos = 0;
+    while (pos < table.count && table.blocks[pos].start < start) pos++;
+    if (pos > 0) {
+        const ModbusRegBlock& prev = table.blocks[pos - 1];
+        if ((uint32_t)prev.start + prev.count > start) return false;
+    }
+    if (pos < table.count && (uint32_t)start + count > table.blocks[pos].start) return false;
+
+    size_t bytes = modbusMapBlockBytes(type, count);
+    void* data = nullptr;
+    bool inPsram = false;
+    if (bytes >= MB_MAP_PSRAM_THRESHOLD && psramFound()) {
+        data = heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        inPsram = (data != nullptr);
+    }
+    if (!data) {
+        data = heap_caps_calloc(1, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    uint8_t* dirty = data ? (uint8_t*)heap_caps_calloc(1, (count + 7) / 8, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) : nullptr;
+    if (!data || !dirty) {
+        Serial.printf("[ModbusMap] ✗ Out of memory for %s block %u+%u\n", modbusMapTypeName(type), start, count);
+        heap_caps_free(data);
+        return false;
+    }
+
+    for (uint8_t i = table.count; i > pos; i--) {
+        table.blocks[i] = table.blocks[i - 1];
+    }
+    table.blocks[pos].start = start;
+    table.blocks[pos].count = count;
+    table.blocks[pos].data = data;
+    table.blocks[pos].dirty = dirty;
+    table.blocks[pos].psram = inPsram;
+    table.count++;
+    return true;
+}
+
+// Declare a block by Modbus reference numbers, e.g. 40001-40100 or
+// 41000-43000 (5-digit) and 400001-465536 (6-digit). The leading digit
+// selects the table: 0 coils, 1 discrete inputs, 3 input, 4 holding.
+bool modbusMapAddRange(uint32_t firstRef, uint32_t lastRef) {
+    if (lastRef < firstRef) return false;
+    uint32_t base = (firstRef >= 100000) ? 100000 : 10000;
+    uint8_t prefix = firstRef / base;
+    if (lastRef / base != prefix || firstRef % base == 0) return false;
+
+    ModbusRegType type;
+    switch (prefix) {
+        case 0: type = MB_TYPE_COIL; break;
+        case 1: type = MB_TYPE_DISCRETE; break;
+        case 3: type = MB_TYPE_INPUT; break;
+        case 4: type = MB_TYPE_HOLDING; break;
+        default: return false;
+    }
+    uint32_t start = firstRef % base - 1;
+    return modbusMapAddBlock(type, start, lastRef - firstRef + 1);
+}
+
+// Free every block. Only call while the server is stopped.
+void modbusMapClear() {
+    for (uint8_t t = 0; t < MB_TYPE_COUNT; t++) {
+        ModbusRegTable& table = mb_map[t];
+        for (uint8_t i = 0; i < table.count; i++) {
+            heap_caps_free(table.blocks[i].data);
+            heap_caps_free(table.blocks[i].dirty);
+        }
+        table.count = 0;
+    }
+    mb_map_ready = true;
+}
+
+// Install the legacy layout if no block has been declared yet
+static void modbusMapEnsure() {
+    if (mb_map_ready) return;
+    modbusMapAddBlock(MB_TYPE_HOLDING, 0, MB_REG_HOLDING_COUNT);
+    modbusMapAddBlock(MB_TYPE_INPUT, 0, MB_REG_INPUT_COUNT);
+    modbusMapAddBlock(MB_TYPE_COIL, 0, MB_REG_COIL_COUNT);
+    modbusMapAddBlock(MB_TYPE_DISCRETE, 0, MB_REG_DISCRETE_COUNT);
+}
+
+// Block holding [address, address + count), or nullptr if the range is not
+// fully inside one declared block.
+const ModbusRegBlock* modbusMapFind(ModbusRegType type, uint16_t address, uint16_t count = 1) {
+    modbusMapEnsure();
+    if (type >= MB_TYPE_COUNT || count == 0) return nullptr;
+
+    const ModbusRegTable& table = mb_map[type];
+    int lo = 0;
+    int hi = (int)table.count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const ModbusRegBlock& block = table.blocks[mid];
+        if (address < block.start) {
+            hi = mid - 1;
+        } else if ((uint32_t)address >= (uint32_t)block.start + block.count) {
+            lo = mid + 1;
+        } else {
+            return ((uint32_t)address + count <= (uint32_t)block.start + block.count) ? &block : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+// Contiguous register storage for [address, address + count) of a holding
+// or input table, or nullptr if unmapped.
+uint16_t* modbusMapRegisters(ModbusRegType type, uint16_t address, uint16_t count = 1) {
+    if (modbusMapIsBitType(type)) return nullptr;
+    const ModbusRegBlock* block = modbusMapFind(type, address, count);
+    if (!block) return nullptr;
+    return (uint16_t*)block->data + (address - block->start);
+}
+
+bool modbusMapGetBit(ModbusRegType type, uint16_t address) {
+    const ModbusRegBlock* block = modbusMapFind(type, address);
+    if (!block || !modbusMapIsBitType(type)) return false;
+    uint16_t bit = address - block->start;
+    return (((const uint8_t*)block->data)[bit / 8] >> (bit % 8)) & 0x01;
+}
+
+bool modbusMapSetBit(ModbusRegType type, uint16_t address, bool value) {
+    const ModbusRegBlock* block = modbusMapFind(type, address);
+    if (!block || !modbusMapIsBitType(type)) return false;
+    uint16_t bit = address - block->start;
+    uint8_t* bytes = (uint8_t*)block->data;
+    if (value) {
+        bytes[bit / 8] |= (1 << (bit % 8));
+    } else {
+        bytes[bit / 8] &= ~(1 << (bit % 8));
+    }
+    return true;
+}
+
+// ==================== CONSISTENT READ / WRITE SECTIONS ====================
+
+void modbusMapWriteBegin() {
+    modbusMapEnsure();
+    if (mb_map_write_lock) xSemaphoreTakeRecursive(mb_map_write_lock, portMAX_DELAY);
+    if (mb_map_write_depth++ == 0) {
+        mb_map_seq.store(mb_map_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+}
+
+void modbusMapWriteEnd() {
+    if (mb_map_write_depth == 0) return;
+    if (--mb_map_write_depth == 0) {
+        mb_map_seq.store(mb_map_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    if (mb_map_write_lock) xSemaphoreGiveRecursive(mb_map_write_lock);
+}
+
+// Start a lock-free read. Waits while a write is in progress; after a few
+// spins it sleeps a tick so a lower-priority writer on the same core can
+// finish.
+uint32_t modbusMapReadBegin() {
+    uint32_t seq;
+    uint8_t spins = 0;
+    while ((seq = mb_map_seq.load(std::memory_order_acquire)) & 1) {
+        // Reading inside our own write section: the data is already ours
+        if (xSemaphoreGetMutexHolder(mb_map_write_lock) == xTaskGetCurrentTaskHandle()) break;
+        if (++spins > 8) vTaskDelay(1);
+    }
+    return seq;
+}
+
+// True if a write overlapped the read started with seq; copy again.
+bool modbusMapReadRetry(uint32_t seq) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return mb_map_seq.load(std::memory_order_relaxed) != seq;
+}
+
+// ==================== REMOTE WRITE TRACKING ====================
+// Every Modbus write request marks the addresses it touched in the block's
+// dirty bitmap and fires the write callback once for the whole range, so
+// the application can react to new setpoints without scanning the map.
+
+void modbusMapSetWriteCallback(ModbusWriteCallback callback) {
+    mb_map_write_callback = callback;
+}
+
+// Mark [start, start + count) dirty and notify. Call after the data has
+// been written and outside any write section.
+void modbusMapNotifyWrite(ModbusRegType type, uint16_t start, uint16_t count) {
+    const ModbusRegBlock* block = modbusMapFind(type, start, count);
+    if (!block) return;
+
+    if (mb_map_write_lock) xSemaphoreTakeRecursive(mb_map_write_lock, portMAX_DELAY);
+    uint16_t first = start - block->start;
+    for (uint16_t bit = first; bit < first + count; bit++) {
+        block->dirty[bit / 8] |= (1 << (bit % 8));
+    }
+    if (mb_map_write_lock) xSemaphoreGiveRecursive(mb_map_write_lock);
+
+    if (mb_map_write_callback) mb_map_write_callback(type, start, count);
+}
+
+bool modbusMapIsDirty(ModbusRegType type, uint16_t address) {
+    const ModbusRegBlock* block = modbusMapFind(type, address);
+    if (!block) return false;
+    uint16_t bit = address - block->start;
+    return (block->dirty[bit / 8] >> (bit % 8)) & 0x01;
+}
+
+// Take the lowest run of dirty addresses in a table and clear it. Returns
+// false when nothing is dirty. Whole clean bytes are skipped, so polling
+// this every loop costs little.
+bool modbusMapTakeDirty(ModbusRegType type, uint16_t* start, uint16_t* count) {
+    modbusMapEnsure();
+    if (type >= MB_TYPE_COUNT) return false;
+    bool found = false;
+
+    if (mb_map_write_lock) xSemaphoreTakeRecursive(mb_map_write_lock, portMAX_DELAY);
+    const ModbusRegTable& table = mb_map[type];
+    for (uint8_t b = 0; b < table.count && !found; b++) {
+        const ModbusRegBlock& block = table.blocks[b];
+        uint16_t bytes = (block.count + 7) / 8;
+        for (uint16_t i = 0; i < bytes && !found; i++) {
+            if (block.dirty[i] == 0) continue;
+            uint16_t bit = i * 8;
+            while (!((block.dirty[bit / 8] >> (bit % 8)) & 0x01)) bit++;
+            uint16_t first = bit;
+            while (bit < block.count && ((block.dirty[bit / 8] >> (bit % 8)) & 0x01)) {
+                block.dirty[bit / 8] &= ~(1 << (bit % 8));
+                bit++;
+            }
+            *start = block.start + first;
+            *count = bit - first;
+            found = true;
+        }
+    }
+    if (mb_map_write_lock) xSemaphoreGiveRecursive(mb_map_write_lock);
+    return found;
+}
+
+void modbusMapClearDirty(ModbusRegType type) {
+    modbusMapEnsure();
+    if (type >= MB_TYPE_COUNT) return;
+    if (mb_map_write_lock) xSemaphoreTakeRecursive(mb_map_write_lock, portMAX_DELAY);
+    const ModbusRegTable& table = mb_map[type];
+    for (uint8_t b = 0; b < table.count; b++) {
+        memset(table.blocks[b].dirty, 0, (table.blocks[b].count + 7) / 8);
+    }
+    if (mb_map_write_lock) xSemaphoreGiveRecursive(mb_map_write_lock);
+}
+
+void modbusMapPrint() {
+    modbusMapEnsure();
+    Serial.println("=== Modbus Register Map ===");
+    for (uint8_t t = 0; t < MB_TYPE_COUNT; t++) {
+        const ModbusRegTable& table = mb_map[t];
+        for (uint8_t i = 0; i < table.count; i++) {
+            const ModbusRegBlock& block = table.blocks[i];
+            Serial.printf("%-9s %5u-%-5u (%u) %s\n", modbusMapTypeName((ModbusRegType)t),
+                          block.start, block.start + block.count - 1, block.count,
+                          block.psram ? "PSRAM" : "internal");
+        }
+    }
+    Serial.println("===========================");
+}
+
+#endif // MODBUS_REGISTER_MAP_H
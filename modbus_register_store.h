@@ -0,0 +1,184 @@
+#ifndef MODBUS_REGISTER_STORE_H
+#define MODBUS_REGISTER_STORE_H
+
+// Application-side register API shared by every TCP Modbus backend.
+//
+// tcp_modbus_simple.h (EthernetServer/WiFiServer), tcp_modbus.h (esp-modbus)
+// and tcp_modbus_w5500.h (ModbusIP) all keep their registers in the runtime
+// register map and include this file for tcpModbusSet*/Get*, so a sketch
+// can switch backend without touching its register code. The backend is
+// picked by which header the sketch includes; the calls below go straight
+// to the map with no per-backend indirection.
+
+#include <Arduino.h>
+#include "modbus_register_map.h"
+
+// Transport type enum
+enum TCPModbusTransport {
+    TRANSPORT_WIFI = 0,
+    TRANSPORT_ETHERNET = 1,
+    TRANSPORT_AUTO = 2
+};
+
+// ==================== REMOTE WRITE TRACKING ====================
+
+// Called once per client write request with the range it changed. Runs on
+// the backend's context (the server task when the simple backend runs one).
+void setRangeWriteCallback(ModbusWriteCallback callback) {
+    modbusMapSetWriteCallback(callback);
+}
+
+// Next run of client-written addresses since the last call, e.g.
+//   while (tcpModbusTakeDirty(MB_TYPE_HOLDING, &start, &count)) { ... }
+bool tcpModbusTakeDirty(ModbusRegType type, uint16_t* start, uint16_t* count) {
+    return modbusMapTakeDirty(type, start, count);
+}
+
+// ==================== REGISTER ACCESS FUNCTIONS ====================
+// Setters run inside a map write section and getters copy under the map
+// seqlock, so a Modbus client never sees half of a multi-register value.
+// Wrap several setters in tcpModbusBeginUpdate()/tcpModbusCommitUpdate() to
+// publish them as one snapshot.
+
+void tcpModbusBeginUpdate() {
+    modbusMapWriteBegin();
+}
+
+void tcpModbusCommitUpdate() {
+    modbusMapWriteEnd();
+}
+
+static bool tcpModbusWriteRegs(ModbusRegType type, uint16_t address, const uint16_t* values, uint16_t count) {
+    uint16_t* regs = modbusMapRegisters(type, address, count);
+    if (!regs) return false;
+    modbusMapWriteBegin();
+    memcpy(regs, values, count * sizeof(uint16_t));
+    modbusMapWriteEnd();
+    return true;
+}
+
+static bool tcpModbusReadRegs(ModbusRegType type, uint16_t address, uint16_t* values, uint16_t count) {
+    const uint16_t* regs = modbusMapRegisters(type, address, count);
+    if (!regs) return false;
+    uint32_t seq;
+    do {
+        seq = modbusMapReadBegin();
+        memcpy(values, regs, count * sizeof(uint16_t));
+    } while (modbusMapReadRetry(seq));
+    return true;
+}
+
+bool tcpModbusSetHoldingRegister(uint16_t address, uint16_t value) {
+    return tcpModbusWriteRegs(MB_TYPE_HOLDING, address, &value, 1);
+}
+
+uint16_t tcpModbusGetHoldingRegister(uint16_t address) {
+    uint16_t value = 0;
+    tcpModbusReadRegs(MB_TYPE_HOLDING, address, &value, 1);
+    return value;
+}
+
+bool tcpModbusSetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
+    return tcpModbusWriteRegs(MB_TYPE_HOLDING, startAddress, values, count);
+}
+
+bool tcpModbusGetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
+    return tcpModbusReadRegs(MB_TYPE_HOLDING, startAddress, values, count);
+}
+
+bool tcpModbusSetInputRegister(uint16_t address, uint16_t value) {
+    return tcpModbusWriteRegs(MB_TYPE_INPUT, address, &value, 1);
+}
+
+uint16_t tcpModbusGetInputRegister(uint16_t address) {
+    uint16_t value = 0;
+    tcpModbusReadRegs(MB_TYPE_INPUT, address, &value, 1);
+    return value;
+}
+
+bool tcpModbusSetInputRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
+    return tcpModbusWriteRegs(MB_TYPE_INPUT, startAddress, values, count);
+}
+
+bool tcpModbusGetInputRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
+    return tcpModbusReadRegs(MB_TYPE_INPUT, startAddress, values, count);
+}
+
+bool tcpModbusSetCoil(uint16_t address, bool value) {
+    modbusMapWriteBegin();
+    bool ok = modbusMapSetBit(MB_TYPE_COIL, address, value);
+    modbusMapWriteEnd();
+    return ok;
+}
+
+bool tcpModbusGetCoil(uint16_t address) {
+    return modbusMapGetBit(MB_TYPE_COIL, address);
+}
+
+bool tcpModbusSetDiscreteInput(uint16_t address, bool value) {
+    modbusMapWriteBegin();
+    bool ok = modbusMapSetBit(MB_TYPE_DISCRETE, address, value);
+    modbusMapWriteEnd();
+    return ok;
+}
+
+bool tcpModbusGetDiscreteInput(uint16_t address) {
+    return modbusMapGetBit(MB_TYPE_DISCRETE, address);
+}
+
+// 32-bit helpers, high word first (ABCD order)
+static bool tcpModbusSetU32(ModbusRegType type, uint16_t address, uint32_t value) {
+    uint16_t regs[2] = { (uint16_t)(value >> 16), (uint16_t)(value & 0xFFFF) };
+    return tcpModbusWriteRegs(type, address, regs, 2);
+}
+
+static uint32_t tcpModbusGetU32(ModbusRegType type, uint16_t address) {
+    uint16_t regs[2] = {0, 0};
+    tcpModbusReadRegs(type, address, regs, 2);
+    return ((uint32_t)regs[0] << 16) | regs[1];
+}
+
+bool tcpModbusSetHoldingUInt32(uint16_t address, uint32_t value) {
+    return tcpModbusSetU32(MB_TYPE_HOLDING, address, value);
+}
+
+uint32_t tcpModbusGetHoldingUInt32(uint16_t address) {
+    return tcpModbusGetU32(MB_TYPE_HOLDING, address);
+}
+
+bool tcpModbusSetInputUInt32(uint16_t address, uint32_t value) {
+    return tcpModbusSetU32(MB_TYPE_INPUT, address, value);
+}
+
+uint32_t tcpModbusGetInputUInt32(uint16_t address) {
+    return tcpModbusGetU32(MB_TYPE_INPUT, address);
+}
+
+// Float helpers
+bool tcpModbusSetHoldingFloat(uint16_t address, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return tcpModbusSetU32(MB_TYPE_HOLDING, address, bits);
+}
+
+float tcpModbusGetHoldingFloat(uint16_t address) {
+    uint32_t bits = tcpModbusGetU32(MB_TYPE_HOLDING, address);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool tcpModbusSetInputFloat(uint16_t address, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return tcpModbusSetU32(MB_TYPE_INPUT, address, bits);
+}
+
+float tcpModbusGetInputFloat(uint16_t address) {
+    uint32_t bits = tcpModbusGetU32(MB_TYPE_INPUT, address);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#endif // MODBUS_REGISTER_STORE_H
@@ -0,0 +1,342 @@
+#ifndef MQTT_ALIAS_PUBLISHER_H
+#define MQTT_ALIAS_PUBLISHER_H
+
+// Sparkplug-B-style telemetry: metric names are sent once, in a birth
+// message, and data messages carry only [alias, value] pairs.
+//
+//   <prefix><name>/birth   retained, QoS 1, on every (re)connect and on request
+//     {"timestamp":..., "bdSeq":3, "seq":0,
+//      "metrics":[{"name":"spindle_speed","alias":0,"type":"Float","value":1200.5}, ...]}
+//   <prefix><name>/data    changed metrics only
+//     {"timestamp":..., "seq":1, "metrics":[[0,1210.0],[2,true]]}
+//
+// seq counts data messages 1..255 and wraps to 0; the birth is seq 0.
+// A consumer that sees a jump in seq has missed a message and can ask for
+// a rebirth on "<prefix><name>/rebirth" (any payload). bdSeq changes with
+// each birth so data can be matched to the alias table it refers to.
+//
+// Data is only sent while connected: it is never spooled, since it would
+// be replayed after a new birth. Values that change offline go out in the
+// birth that follows the reconnect.
+//
+//   MQTTAliasPublisher telemetry(&mqtt_obj, "telemetry", 2048);
+//   uint8_t speed = telemetry.addMetric("spindle_speed", MQTT_METRIC_FLOAT, 5.0);   // 5 rpm deadband
+//   telemetry.listen(mqttRouter);
+//   ...
+//   telemetry.set(speed, 1210.0f);
+//   telemetry.loop();
+
+#include "MQTT_Lib.h"
+#include "RTCManager.h"
+#include "deadband.h"
+#include "mqtt_topic_router.h"
+
+extern RTCManager rtc;
+
+#define MQTT_ALIAS_MAX_METRICS      32
+#define MQTT_ALIAS_STRING_MAX       32      // String metric value, including the terminator
+#define MQTT_ALIAS_TOPIC_MAX        64      // "<name>/rebirth" plus encoding suffix
+#define MQTT_ALIAS_INTERVAL_MS      1000    // Default minimum time between data messages
+
+enum MQTTMetricType : uint8_t {
+    MQTT_METRIC_BOOL = 0,
+    MQTT_METRIC_INT32,
+    MQTT_METRIC_UINT32,
+    MQTT_METRIC_FLOAT,
+    MQTT_METRIC_DOUBLE,
+    MQTT_METRIC_STRING
+};
+
+struct MQTTAliasMetric {
+    const char* name;
+    MQTTMetricType type;
+    float deadband;         // Numeric types, in the metric's units
+    bool valid;             // Has a value
+    bool dirty;             // Changed since the last message
+    double value;
+    double lastSent;
+    char text[MQTT_ALIAS_STRING_MAX];
+};
+
+class MQTTAliasPublisher {
+    private:
+        MQTT_Lib* mqttClient;
+        const char* name;
+        DynamicJsonDocument* doc;
+        MQTTPayloadEncoding encoding;
+        MQTTAliasMetric metrics[MQTT_ALIAS_MAX_METRICS];
+        uint8_t metricCount = 0;
+        char birthTopic[MQTT_ALIAS_TOPIC_MAX];
+        char dataTopic[MQTT_ALIAS_TOPIC_MAX];
+        char rebirthTopic[MQTT_ALIAS_TOPIC_MAX];
+
+        uint8_t seq = 0;
+        uint8_t bdSeq = 0;
+        bool born = false;                  // Birth accepted on the current connection
+        volatile bool rebirthRequested = false;
+        uint32_t lastConnect = 0;
+        uint32_t intervalMs = MQTT_ALIAS_INTERVAL_MS;
+        unsigned long lastData = 0;
+
+        uint32_t births = 0;
+        uint32_t dataMessages = 0;
+        uint32_t rebirthRequests = 0;
+
+        static const char* typeName(MQTTMetricType type) {
+            static const char* const names[] = { "Boolean", "Int32", "UInt32", "Float", "Double", "String" };
+            return type <= MQTT_METRIC_STRING ? names[type] : "Unknown";
+        }
+
+        void buildTopics() {
+            const char* suffix = (encoding == MQTT_PAYLOAD_MSGPACK) ? MQTT_MSGPACK_TOPIC_SUFFIX : "";
+            snprintf(birthTopic, sizeof(birthTopic), "%s/birth%s", name, suffix);
+            snprintf(dataTopic, sizeof(dataTopic), "%s/data%s", name, suffix);
+            snprintf(rebirthTopic, sizeof(rebirthTopic), "%s/rebirth", name);
+        }
+
+        // One + per level of the client's prefix, so a later setsubtopic()
+        // with new names still routes here; isRebirthTopic() checks the names
+        bool buildRebirthFilter(char* filter, size_t size) {
+            const char* prefix = mqttClient->getTopicPrefix();
+            size_t len = 0;
+            for (const char* c = prefix; *c; c++) {
+                if (*c != '/') continue;
+                if (len + 2 >= size) return false;
+                filter[len++] = '+';
+                filter[len++] = '/';
+            }
+            int written = snprintf(&filter[len], size - len, "%s", rebirthTopic);
+            return written >= 0 && (size_t)written < size - len;
+        }
+
+        bool isRebirthTopic(const char* topic) {
+            char expected[MQTT_TOPIC_MAX_LEN];
+            return mqttClient->getTopic(rebirthTopic, expected, sizeof(expected)) && strcmp(topic, expected) == 0;
+        }
+
+        // out is a JsonVariant or an object member
+        template <typename TVariant>
+        void addValue(TVariant out, const MQTTAliasMetric& metric) {
+            switch (metric.type) {
+                case MQTT_METRIC_BOOL: out.set(metric.value != 0); break;
+                case MQTT_METRIC_INT32: out.set((int32_t)metric.value); break;
+                case MQTT_METRIC_UINT32: out.set((uint32_t)metric.value); break;
+                case MQTT_METRIC_FLOAT: out.set((float)metric.value); break;
+                case MQTT_METRIC_DOUBLE: out.set(metric.value); break;
+                case MQTT_METRIC_STRING: out.set((const char*)metric.text); break;
+            }
+        }
+
+        bool changed(const MQTTAliasMetric& metric, double value) {
+            if (!metric.valid) return true;
+            return exceedsDeadband(value, metric.lastSent, metric.deadband);
+        }
+
+        bool setNumber(uint8_t alias, double value) {
+            if (alias >= metricCount || metrics[alias].type == MQTT_METRIC_STRING) return false;
+            MQTTAliasMetric& metric = metrics[alias];
+            bool moved = changed(metric, value);
+            metric.value = value;
+            if (!metric.valid) metric.lastSent = value;
+            metric.valid = true;
+            if (moved) metric.dirty = true;
+            return true;
+        }
+
+        // Full alias table with current values; resets seq
+        bool publishBirth() {
+            doc->clear();
+            (*doc)["timestamp"] = rtc.getEpochMs();
+            (*doc)["bdSeq"] = (uint8_t)(bdSeq + 1);
+            (*doc)["seq"] = 0;
+            JsonArray list = doc->createNestedArray("metrics");
+            for (uint8_t i = 0; i < metricCount; i++) {
+                JsonObject entry = list.createNestedObject();
+                entry["name"] = metrics[i].name;
+                entry["alias"] = i;
+                entry["type"] = typeName(metrics[i].type);
+                if (metrics[i].valid) addValue(entry["value"], metrics[i]);
+            }
+            if (doc->overflowed()) {
+                Serial.printf("[MQTT Alias] ✗ %s: JSON document too small for the birth message\n", name);
+                return false;
+            }
+            // QoS 1 and retained: a consumer must never miss the alias table
+            if (!mqttClient->publishQos1Json(birthTopic, *doc, true, encoding)) return false;
+
+            bdSeq++;
+            seq = 0;
+            for (uint8_t i = 0; i < metricCount; i++) {
+                metrics[i].dirty = false;
+                metrics[i].lastSent = metrics[i].value;
+            }
+            births++;
+            Serial.printf("[MQTT Alias] ✓ %s birth, bdSeq %u, %u metrics\n", name, bdSeq, metricCount);
+            return true;
+        }
+
+        bool publishData() {
+            doc->clear();
+            uint8_t next = seq + 1;     // 255 wraps to 0
+            (*doc)["timestamp"] = rtc.getEpochMs();
+            (*doc)["seq"] = next;
+            JsonArray list = doc->createNestedArray("metrics");
+            for (uint8_t i = 0; i < metricCount; i++) {
+                if (!metrics[i].dirty) continue;
+                JsonArray pair = list.createNestedArray();
+                pair.add(i);
+                addValue(pair.add(), metrics[i]);
+            }
+            if (doc->overflowed()) {
+                Serial.printf("[MQTT Alias] ✗ %s: JSON document too small for the data message\n", name);
+                return false;
+            }
+            if (!mqttClient->publishJson(dataTopic, *doc, false, encoding)) return false;
+
+            seq = next;
+            for (uint8_t i = 0; i < metricCount; i++) {
+                if (!metrics[i].dirty) continue;
+                metrics[i].dirty = false;
+                metrics[i].lastSent = metrics[i].value;
+            }
+            dataMessages++;
+            return true;
+        }
+
+    public:
+        // name is the topic suffix and must stay valid (a literal)
+        MQTTAliasPublisher(MQTT_Lib* client, const char* metric_group, int json_size,
+                           MQTTPayloadEncoding payload_encoding = MQTT_PAYLOAD_JSON)
+            : mqttClient(client), name(metric_group), encoding(payload_encoding) {
+            doc = new DynamicJsonDocument(json_size);
+            buildTopics();
+        }
+
+        ~MQTTAliasPublisher() {
+            delete doc;
+        }
+
+        // Returns the alias (index in the birth message), or -1 if full. Add
+        // metrics at setup; adding one later triggers a rebirth.
+        int addMetric(const char* metric_name, MQTTMetricType type, float deadband = 0) {
+            if (metricCount >= MQTT_ALIAS_MAX_METRICS) {
+                Serial.printf("[MQTT Alias] ✗ Too many metrics, %s not added\n", metric_name);
+                return -1;
+            }
+            MQTTAliasMetric& metric = metrics[metricCount];
+            metric.name = metric_name;
+            metric.type = type;
+            metric.deadband = deadband;
+            metric.valid = false;
+            metric.dirty = false;
+            metric.value = 0;
+            metric.lastSent = 0;
+            metric.text[0] = '\0';
+            if (born) rebirthRequested = true;
+            return metricCount++;
+        }
+
+        bool set(uint8_t alias, bool value) {
+            return setNumber(alias, value ? 1 : 0);
+        }
+
+        // Plain integer types so literals and int32_t resolve on every core
+        bool set(uint8_t alias, int value) {
+            return setNumber(alias, value);
+        }
+
+        bool set(uint8_t alias, long value) {
+            return setNumber(alias, value);
+        }
+
+        bool set(uint8_t alias, unsigned int value) {
+            return setNumber(alias, value);
+        }
+
+        bool set(uint8_t alias, unsigned long value) {
+            return setNumber(alias, value);
+        }
+
+        bool set(uint8_t alias, float value) {
+            return setNumber(alias, value);
+        }
+
+        bool set(uint8_t alias, double value) {
+            return setNumber(alias, value);
+        }
+
+        bool set(uint8_t alias, const char* value) {
+            if (alias >= metricCount || metrics[alias].type != MQTT_METRIC_STRING) return false;
+            MQTTAliasMetric& metric = metrics[alias];
+            if (metric.valid && strncmp(metric.text, value, sizeof(metric.text) - 1) == 0) return true;
+            strncpy(metric.text, value, sizeof(metric.text) - 1);
+            metric.text[sizeof(metric.text) - 1] = '\0';
+            metric.valid = true;
+            metric.dirty = true;
+            return true;
+        }
+
+        // Minimum time between data messages; changes in between are merged
+        void setInterval(uint32_t ms) {
+            intervalMs = ms;
+        }
+
+        void requestRebirth() {
+            rebirthRequested = true;
+        }
+
+        // Route "<prefix><name>/rebirth" commands to requestRebirth()
+        bool listen(MQTTTopicRouter& router) {
+            char filter[MQTT_TOPIC_MAX_LEN];
+            if (!buildRebirthFilter(filter, sizeof(filter))) {
+                Serial.printf("[MQTT Alias] ✗ %s: rebirth filter too long\n", name);
+                return false;
+            }
+            return router.on(filter, [this](const MQTTTopicMatch& match, const uint8_t*, unsigned int) {
+                if (!isRebirthTopic(match.topic)) return;      // Another device's rebirth
+                rebirthRequests++;
+                rebirthRequested = true;
+            });
+        }
+
+        void loop() {
+            if (mqttClient->connectionStatus() != MQTT_CONNECTED) {
+                born = false;
+                return;
+            }
+
+            // Every new connection starts with a birth
+            uint32_t connects = mqttClient->connectCount();
+            if (connects != lastConnect) {
+                lastConnect = connects;
+                born = false;
+            }
+            if (!born || rebirthRequested) {
+                rebirthRequested = false;
+                born = publishBirth();
+                if (!born) return;          // Retried next loop; no data before the birth
+                lastData = millis();
+                return;
+            }
+
+            unsigned long now = millis();
+            if (now - lastData < intervalMs) return;
+            bool any = false;
+            for (uint8_t i = 0; i < metricCount && !any; i++) any = metrics[i].dirty;
+            if (!any) return;
+            if (publishData()) lastData = now;
+        }
+
+        void printStatus() {
+            Serial.printf("Alias publisher %s: %u metrics, bdSeq %u, seq %u, %s\n", name, metricCount, bdSeq, seq,
+                          born ? "born" : "awaiting birth");
+            Serial.printf("  Births: %lu, data messages: %lu, rebirth requests: %lu\n", (unsigned long)births,
+                          (unsigned long)dataMessages, (unsigned long)rebirthRequests);
+            for (uint8_t i = 0; i < metricCount; i++) {
+                Serial.printf("  %3u %-24s %-7s %s\n", i, metrics[i].name, typeName(metrics[i].type),
+                              metrics[i].dirty ? "(changed)" : "");
+            }
+        }
+};
+
+#endif // MQTT_ALIAS_PUBLISHER_H
@@ -0,0 +1,246 @@
+#ifndef MQTT_CLIENT_TAP_H
+#define MQTT_CLIENT_TAP_H
+
+// Client wrapper that sits between PubSubClient and the real socket
+// (EthernetClient or WiFiClient).
+//
+// - Passes everything through, but watches the inbound byte stream and
+//   decodes MQTT fixed headers, so MQTT_Lib can see acknowledgements
+//   (SUBACK, PUBACK) that PubSubClient reads and throws away.
+// - Can serve a few preloaded bytes before the socket and swallow writes.
+//   MQTT_Lib uses this to finish its own non-blocking CONNECT handshake:
+//   PubSubClient::connect() is replayed against the CONNACK that already
+//   arrived, so it never waits on the socket.
+//
+// - Opens W5500 connections in short steps (w5500_connect.h):
+//   beginConnect() records the address and each pollConnect() makes one
+//   bounded connect attempt, so the network lock shared with Modbus is
+//   never held for a full connect timeout.
+//
+// The target can be swapped at runtime (Ethernet <-> WiFi) with attach().
+
+#include <Arduino.h>
+#include <Client.h>
+#include <Ethernet.h>
+#include "w5500_connect.h"
+
+#define MQTT_TAP_PRELOAD_MAX    8
+
+// MQTT control packet types (upper nibble of the fixed header)
+#define MQTT_PKT_CONNACK        2
+#define MQTT_PKT_PUBLISH        3
+#define MQTT_PKT_PUBACK         4
+#define MQTT_PKT_SUBACK         9
+#define MQTT_PKT_PINGRESP       13
+
+// Called for every inbound packet with its type and first body bytes
+// (packet id, then the first SUBACK return code)
+typedef void (*MQTTPacketHook)(void* ctx, uint8_t type, const uint8_t* head, uint8_t headLen);
+
+class MQTTClientTap : public Client {
+    private:
+        Client* target = nullptr;
+        EthernetClient* eth = nullptr;  // Same object as target on a W5500
+        W5500Connect pending;           // W5500 connect in progress
+        int8_t connectResult = 0;       // Other targets: 1 connected, -1 failed
+        MQTTPacketHook hook = nullptr;
+        void* hookCtx = nullptr;
+        uint8_t preload[MQTT_TAP_PRELOAD_MAX];
+        uint8_t preloadLen = 0;
+        uint8_t preloadPos = 0;
+        bool swallow = false;
+
+        // Inbound frame decoder
+        uint8_t rxPhase = 0;        // 0: type byte, 1: remaining length, 2: body
+        uint8_t rxType = 0;
+        uint32_t rxRemaining = 0;
+        uint8_t rxShift = 0;
+        uint8_t rxHead[3];          // First body bytes: packet id and first return code
+        uint8_t rxHeadLen = 0;
+
+        void packetDone() {
+            rxPhase = 0;
+            packetsIn++;
+            if (rxType == MQTT_PKT_SUBACK) {
+                subacks++;
+                if (rxHeadLen == 3 && rxHead[2] == 0x80) subackFailures++;
+            }
+            if (hook) hook(hookCtx, rxType, rxHead, rxHeadLen);
+        }
+
+        void sniff(uint8_t b) {
+            switch (rxPhase) {
+                case 0:
+                    rxType = b >> 4;
+                    rxRemaining = 0;
+                    rxShift = 0;
+                    rxHeadLen = 0;
+                    rxPhase = 1;
+                    break;
+                case 1:
+                    rxRemaining |= (uint32_t)(b & 0x7F) << rxShift;
+                    rxShift += 7;
+                    if (b & 0x80) {
+                        if (rxShift > 21) rxPhase = 0;     // Malformed, resync on the next byte
+                        break;
+                    }
+                    if (rxRemaining == 0) packetDone();
+                    else rxPhase = 2;
+                    break;
+                default:
+                    if (rxHeadLen < sizeof(rxHead)) rxHead[rxHeadLen++] = b;
+                    if (--rxRemaining == 0) packetDone();
+                    break;
+            }
+        }
+
+    public:
+        uint32_t packetsIn = 0;
+        uint32_t subacks = 0;
+        uint32_t subackFailures = 0;
+
+        // ethernet: the same client when it is a W5500 EthernetClient, so
+        // connects can be polled instead of blocking
+        void attach(Client* client, EthernetClient* ethernet = nullptr) {
+            abortConnect();
+            target = client;
+            eth = ethernet;
+            reset();
+        }
+
+        // true when connects are non-blocking and must run under the network
+        // lock; false when beginConnect() blocks and needs no lock (WiFi)
+        bool isW5500() {
+            return eth != nullptr;
+        }
+
+        Client* client() {
+            return target;
+        }
+
+        void setPacketHook(MQTTPacketHook packetHook, void* ctx) {
+            hook = packetHook;
+            hookCtx = ctx;
+        }
+
+        // Forget any half-decoded frame and preloaded bytes (new connection)
+        void reset() {
+            rxPhase = 0;
+            preloadLen = 0;
+            preloadPos = 0;
+            swallow = false;
+        }
+
+        // Serve these bytes to read() before the socket's own data
+        void setPreload(const uint8_t* data, uint8_t len) {
+            if (len > MQTT_TAP_PRELOAD_MAX) len = MQTT_TAP_PRELOAD_MAX;
+            memcpy(preload, data, len);
+            preloadLen = len;
+            preloadPos = 0;
+        }
+
+        // Report writes as sent without sending them
+        void setSwallowWrites(bool on) {
+            swallow = on;
+        }
+
+        // Start a connection; pollConnect() reports when it is up. On a W5500
+        // the attempts are made from pollConnect(). Other targets connect
+        // here, blocking.
+        bool beginConnect(IPAddress ip, uint16_t port) {
+            abortConnect();
+            if (!eth) {
+                connectResult = (target && target->connect(ip, port) == 1) ? 1 : -1;
+                return connectResult == 1;
+            }
+            eth->stop();
+            pending.begin(ip, port);
+            return true;
+        }
+
+        // By name: blocking targets only; a W5500 needs the address resolved
+        bool beginConnect(const char* host, uint16_t port) {
+            abortConnect();
+            if (eth) return false;
+            connectResult = (target && target->connect(host, port) == 1) ? 1 : -1;
+            return connectResult == 1;
+        }
+
+        // 1 connected, 0 still connecting, -1 failed
+        int8_t pollConnect() {
+            if (!eth) return connectResult;
+            return pending.poll(*eth);
+        }
+
+        // Give up on a connect that has not finished
+        void abortConnect() {
+            connectResult = 0;
+            pending.abort();
+        }
+
+        int connect(IPAddress ip, uint16_t port) override {
+            return target ? target->connect(ip, port) : 0;
+        }
+
+        int connect(const char* host, uint16_t port) override {
+            return target ? target->connect(host, port) : 0;
+        }
+
+        size_t write(uint8_t b) override {
+            if (swallow) return 1;
+            return target ? target->write(b) : 0;
+        }
+
+        size_t write(const uint8_t* buf, size_t size) override {
+            if (swallow) return size;
+            return target ? target->write(buf, size) : 0;
+        }
+
+        int available() override {
+            if (preloadPos < preloadLen) return preloadLen - preloadPos;
+            return target ? target->available() : 0;
+        }
+
+        int read() override {
+            if (preloadPos < preloadLen) return preload[preloadPos++];
+            if (!target) return -1;
+            int b = target->read();
+            if (b >= 0) sniff(b);
+            return b;
+        }
+
+        int read(uint8_t* buf, size_t size) override {
+            size_t n = 0;
+            while (n < size && preloadPos < preloadLen) buf[n++] = preload[preloadPos++];
+            if (n == size || !target) return n;
+            int got = target->read(buf + n, size - n);
+            if (got <= 0) return n ? n : got;
+            for (int i = 0; i < got; i++) sniff(buf[n + i]);
+            return n + got;
+        }
+
+        int peek() override {
+            if (preloadPos < preloadLen) return preload[preloadPos];
+            return target ? target->peek() : -1;
+        }
+
+        void flush() override {
+            if (target) target->flush();
+        }
+
+        void stop() override {
+            abortConnect();
+            if (target) target->stop();
+            reset();
+        }
+
+        uint8_t connected() override {
+            return target ? target->connected() : 0;
+        }
+
+        operator bool() override {
+            return target && (bool)*target;
+        }
+};
+
+#endif // MQTT_CLIENT_TAP_H
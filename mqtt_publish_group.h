@@ -0,0 +1,252 @@
+#ifndef MQTT_PUBLISH_GROUP_H
+#define MQTT_PUBLISH_GROUP_H
+
+// Publish groups: several MQTTPublishers sent as one message per period.
+//
+// Each member's document goes in under its name, next to a single shared
+// timestamp, so N small packets with N copies of the topic prefix and
+// timestamp become one. Only members with a change (or a due heartbeat)
+// are included. A message that would pass the size cap is split; a member
+// too large for the cap on its own is published on its own topic.
+//
+// Member documents can come from one MQTTDocArena block instead of a heap
+// allocation each:
+//
+//   MQTTDocArena arena;                 // arena.begin(2048) in setup
+//   MQTTPublishGroup machine(&mqtt_obj, "machine/status", 1000);
+//   MQTTPublisher temp(&mqtt_obj, "temp", arena.allocate(128));
+//   MQTTPublisher count(&mqtt_obj, "count", arena.allocate(128));
+//   machine.add(&temp);
+//   machine.add(&count);
+//   ...
+//   temp.setData("value", 21.5);
+//   machine.loop();     // {"timestamp":"...","temp":{"value":21.5}}
+//
+// Combined messages are JSON; a member's own encoding applies only when it
+// is published on its own.
+
+#include <new>
+#include "mqtt_publisher.h"
+
+extern RTCManager rtc;
+
+#define MQTT_GROUP_MAX_MEMBERS  16
+#define MQTT_GROUP_MAX_BYTES    1024    // Default cap on one combined message
+#define MQTT_ARENA_ALIGN        8
+
+// JsonDocument over a caller-provided buffer (the way StaticJsonDocument
+// works, but the buffer lives in the arena)
+class MQTTArenaDocument : public JsonDocument {
+    public:
+        MQTTArenaDocument(char* buffer, size_t capacity) : JsonDocument(buffer, capacity) {}
+};
+
+// One allocation carved into documents at setup; never freed piecemeal
+class MQTTDocArena {
+    private:
+        uint8_t* pool = nullptr;
+        size_t poolSize = 0;
+        size_t used = 0;
+        uint8_t documents = 0;
+
+        static size_t align(size_t n) {
+            return (n + MQTT_ARENA_ALIGN - 1) & ~(size_t)(MQTT_ARENA_ALIGN - 1);
+        }
+
+    public:
+        ~MQTTDocArena() {
+            free(pool);     // Documents are trivially destructible views of the pool
+        }
+
+        bool begin(size_t bytes) {
+            if (pool) return true;
+            bytes = align(bytes);
+#ifdef BOARD_HAS_PSRAM
+            if (psramFound()) pool = (uint8_t*)ps_malloc(bytes);
+#endif
+            if (!pool) pool = (uint8_t*)malloc(bytes);
+            if (!pool) {
+                Serial.printf("[MQTT Arena] ✗ Cannot allocate %u bytes\n", (unsigned)bytes);
+                return false;
+            }
+            poolSize = bytes;
+            used = 0;
+            Serial.printf("[MQTT Arena] ✓ %u bytes\n", (unsigned)bytes);
+            return true;
+        }
+
+        // A document with this much JSON capacity; nullptr when the arena is
+        // exhausted (size it with bytesFor())
+        JsonDocument* allocate(size_t capacity) {
+            size_t header = align(sizeof(MQTTArenaDocument));
+            capacity = align(capacity);
+            if (!pool || used + header + capacity > poolSize) {
+                Serial.printf("[MQTT Arena] ✗ No room for a %u byte document\n", (unsigned)capacity);
+                return nullptr;
+            }
+            uint8_t* block = pool + used;
+            used += header + capacity;
+            documents++;
+            return new (block) MQTTArenaDocument((char*)(block + header), capacity);
+        }
+
+        // Arena bytes needed for one document of this capacity
+        static size_t bytesFor(size_t capacity) {
+            return align(sizeof(MQTTArenaDocument)) + align(capacity);
+        }
+
+        size_t available() {
+            return poolSize - used;
+        }
+
+        void printStatus() {
+            Serial.printf("Arena: %u documents, %u/%u bytes used\n", documents, (unsigned)used, (unsigned)poolSize);
+        }
+};
+
+class MQTTPublishGroup {
+    private:
+        struct Member {
+            MQTTPublisher* publisher;
+            const char* name;
+        };
+
+        MQTT_Lib* mqttClient;
+        const char* topic;
+        uint32_t periodMs;
+        size_t maxBytes;
+        bool retained;
+        int qos;
+        bool epochMs = false;
+        Member members[MQTT_GROUP_MAX_MEMBERS];
+        uint8_t memberCount = 0;
+        char* buffer = nullptr;
+        unsigned long lastTick = 0;
+
+        uint32_t messages = 0;
+        uint32_t splits = 0;
+        uint32_t oversize = 0;
+        uint32_t failures = 0;
+
+        // Start a message: the shared timestamp, members follow with a
+        // leading comma
+        size_t open() {
+            if (epochMs) {
+                return snprintf(buffer, maxBytes, "{\"timestamp\":%llu", (unsigned long long)rtc.getEpochMs());
+            }
+            return snprintf(buffer, maxBytes, "{\"timestamp\":\"%s\"", rtc.getDateTime());
+        }
+
+        // Same routes as MQTTPublisher::sendDoc()
+        bool send(size_t length) {
+            if (qos > 0) return mqttClient->publishQos1(topic, (const uint8_t*)buffer, length, retained);
+            MQTTPublishQueue* queue = mqttClient->getQueue();
+            if (queue && queue->isReady() && length < queue->slotBytes() &&
+                mqttClient->enqueue(topic, (const uint8_t*)buffer, length, retained)) {
+                return true;
+            }
+            if (mqttClient->connectionStatus() != MQTT_CONNECTED && !mqttClient->hasSpool()) return false;
+            return mqttClient->publishSpooled(topic, buffer, retained);
+        }
+
+        // Close and send; the included members are committed only if it went
+        void flush(const uint8_t* batch, uint8_t count, size_t length, unsigned long now) {
+            buffer[length++] = '}';
+            buffer[length] = '\0';
+            if (!send(length)) {
+                failures++;
+                return;     // Members stay due and are retried next period
+            }
+            messages++;
+            for (uint8_t i = 0; i < count; i++) members[batch[i]].publisher->markPublished(now);
+        }
+
+    public:
+        MQTTPublishGroup(MQTT_Lib* client, const char* pub_topic, uint32_t period_ms, size_t max_bytes = MQTT_GROUP_MAX_BYTES,
+                         bool retain_msg = false, int quality_of_service = 0)
+            : mqttClient(client), topic(pub_topic), periodMs(period_ms), maxBytes(max_bytes), retained(retain_msg),
+              qos(quality_of_service) {}
+
+        ~MQTTPublishGroup() {
+            for (uint8_t i = 0; i < memberCount; i++) members[i].publisher->group = nullptr;
+            free(buffer);
+        }
+
+        // The member's document goes in under name (its topic by default).
+        // The name must stay valid; its own loop() no longer publishes.
+        bool add(MQTTPublisher* publisher, const char* name = nullptr) {
+            if (memberCount >= MQTT_GROUP_MAX_MEMBERS || publisher->group) {
+                Serial.printf("[MQTT Group] ✗ Cannot add %s to %s\n", name ? name : publisher->topic, topic);
+                return false;
+            }
+            if (!buffer) {
+                buffer = (char*)malloc(maxBytes);
+                if (!buffer) {
+                    Serial.printf("[MQTT Group] ✗ Cannot allocate %u byte buffer\n", (unsigned)maxBytes);
+                    return false;
+                }
+            }
+            members[memberCount].publisher = publisher;
+            members[memberCount].name = name ? name : publisher->topic;
+            memberCount++;
+            publisher->group = this;
+            publisher->doc->remove("timestamp");
+            return true;
+        }
+
+        void setPeriod(uint32_t ms) {
+            periodMs = ms;
+        }
+
+        // Numeric milliseconds since 1970 instead of "YYYY-MM-DD HH:MM:SS"
+        void setEpochTimestamps(bool on) {
+            epochMs = on;
+        }
+
+        void loop() {
+            if (!buffer) return;
+            unsigned long now = millis();
+            if (now - lastTick < periodMs) return;
+            lastTick = now;
+
+            uint8_t batch[MQTT_GROUP_MAX_MEMBERS];
+            uint8_t count = 0;
+            size_t length = open();
+            bool split = false;
+            for (uint8_t i = 0; i < memberCount; i++) {
+                MQTTPublisher* publisher = members[i].publisher;
+                if (!publisher->due(now)) continue;
+
+                // ,"name":{...} plus the closing brace and terminator
+                size_t need = 4 + strlen(members[i].name) + measureJson(*publisher->doc) + 2;
+                if (length + need > maxBytes && count > 0) {
+                    flush(batch, count, length, now);
+                    count = 0;
+                    length = open();
+                    split = true;
+                }
+                if (length + need > maxBytes) {
+                    // Too large to share a message: send it as a plain publisher
+                    oversize++;
+                    publisher->stamp(true);
+                    if (publisher->sendDoc()) publisher->markPublished(now);
+                    publisher->doc->remove("timestamp");
+                    continue;
+                }
+                length += snprintf(buffer + length, maxBytes - length, ",\"%s\":", members[i].name);
+                length += serializeJson(*publisher->doc, buffer + length, maxBytes - length);
+                batch[count++] = i;
+            }
+            if (count > 0) flush(batch, count, length, now);
+            if (split) splits++;
+        }
+
+        void printStatus() {
+            Serial.printf("Group %s: %u members, every %lu ms, cap %u bytes\n", topic, memberCount,
+                          (unsigned long)periodMs, (unsigned)maxBytes);
+            Serial.printf("  Messages: %lu, split ticks: %lu, oversize members: %lu, failed: %lu\n",
+                          (unsigned long)messages, (unsigned long)splits, (unsigned long)oversize, (unsigned long)failures);
+        }
+};
+
+#endif // MQTT_PUBLISH_GROUP_H
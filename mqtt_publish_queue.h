@@ -0,0 +1,378 @@
+#ifndef MQTT_PUBLISH_QUEUE_H
+#define MQTT_PUBLISH_QUEUE_H
+
+// Lock-free outbound queue between application code and the MQTT task.
+//
+// A bounded ring of preallocated slots (Vyukov's sequence-numbered queue).
+// Any task, or an interrupt handler through pushFromISR() (not one that
+// runs with the flash cache disabled), claims a slot with one CAS,
+// copies the topic id and payload in and publishes it by bumping the slot's
+// sequence number; no lock is taken and nothing touches the socket. The
+// MQTT task drains the ring from service() and does the actual publish.
+//
+// Topics are registered once as suffixes (appended to the device prefix)
+// and referred to by a small id, so a slot holds no strings. The queue
+// keeps its own copy of each suffix; when the table is full, addTopic()
+// fails and callers publish directly instead.
+//
+// When the ring is full the overflow policy decides:
+//   MQTT_QUEUE_DROP_OLDEST - discard the oldest queued message (default)
+//   MQTT_QUEUE_DROP_NEWEST - reject the new message
+//   MQTT_QUEUE_BLOCK       - wait up to the block timeout for space, then
+//                            reject (never waits in an ISR)
+//
+//   mqttQueue.begin(32, 512);
+//   mqtt_obj.setQueue(&mqttQueue);
+//   int8_t id = mqttQueue.addTopic("scanner/barcode");
+//   mqttQueue.push(id, data, len);
+
+#include <Arduino.h>
+#include <atomic>
+
+#define MQTT_QUEUE_SLOTS            32      // Default ring size, rounded up to a power of two
+#define MQTT_QUEUE_PAYLOAD_MAX      512     // Default payload bytes per slot
+#define MQTT_QUEUE_MAX_TOPICS       32
+#define MQTT_QUEUE_TOPIC_LEN        96      // Longest suffix, with terminator
+#define MQTT_QUEUE_BLOCK_MS         20      // Default wait for MQTT_QUEUE_BLOCK
+
+enum MQTTQueueOverflow : uint8_t {
+    MQTT_QUEUE_DROP_OLDEST = 0,
+    MQTT_QUEUE_DROP_NEWEST,
+    MQTT_QUEUE_BLOCK
+};
+
+struct MQTTQueueSlot {
+    std::atomic<uint32_t> seq;
+    uint8_t topicId;
+    bool retained;
+    uint16_t length;
+    uint8_t* payload;       // Points into the shared payload block
+};
+
+struct MQTTQueueStats {
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t droppedOldest;
+    uint32_t droppedNewest;     // Full (drop-newest, or block timed out)
+    uint32_t oversize;          // Payload larger than a slot
+    uint32_t highWater;         // Most messages queued at once
+};
+
+class MQTTPublishQueue {
+    private:
+        MQTTQueueSlot* slots = nullptr;
+        uint8_t* payloads = nullptr;
+        uint32_t mask = 0;
+        uint16_t payloadMax = 0;
+        // Producer and consumer positions on separate cache lines' worth of
+        // padding so pushes do not keep invalidating the drain side
+        alignas(32) std::atomic<uint32_t> enqueuePos{0};
+        alignas(32) std::atomic<uint32_t> dequeuePos{0};
+
+        // Entries below topicCount never change, so lookups read them
+        // without a lock; adding one takes topicLock
+        char topics[MQTT_QUEUE_MAX_TOPICS][MQTT_QUEUE_TOPIC_LEN];
+        std::atomic<uint8_t> topicCount{0};
+        SemaphoreHandle_t topicLock = nullptr;
+
+        MQTTQueueOverflow policy = MQTT_QUEUE_DROP_OLDEST;
+        uint32_t blockMs = MQTT_QUEUE_BLOCK_MS;
+        TaskHandle_t consumer = nullptr;
+
+        std::atomic<uint32_t> pushed{0};
+        std::atomic<uint32_t> popped{0};
+        std::atomic<uint32_t> droppedOldest{0};
+        std::atomic<uint32_t> droppedNewest{0};
+        std::atomic<uint32_t> oversize{0};
+        std::atomic<uint32_t> highWater{0};
+
+        // Claim the slot at the head, or nullptr if empty. Uses a CAS so a
+        // drop-oldest producer and the MQTT task can both take from the head.
+        MQTTQueueSlot* claimHead(uint32_t* pos) {
+            uint32_t p = dequeuePos.load(std::memory_order_relaxed);
+            for (;;) {
+                MQTTQueueSlot* slot = &slots[p & mask];
+                uint32_t seq = slot->seq.load(std::memory_order_acquire);
+                int32_t diff = (int32_t)(seq - (p + 1));
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(p, p + 1, std::memory_order_relaxed)) {
+                        *pos = p;
+                        return slot;
+                    }
+                } else if (diff < 0) {
+                    return nullptr;
+                } else {
+                    p = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void releaseHead(MQTTQueueSlot* slot, uint32_t pos) {
+            slot->seq.store(pos + mask + 1, std::memory_order_release);
+        }
+
+        // Claim a free slot at the tail, or nullptr if full
+        MQTTQueueSlot* claimTail(uint32_t* pos) {
+            uint32_t p = enqueuePos.load(std::memory_order_relaxed);
+            for (;;) {
+                MQTTQueueSlot* slot = &slots[p & mask];
+                uint32_t seq = slot->seq.load(std::memory_order_acquire);
+                int32_t diff = (int32_t)(seq - p);
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(p, p + 1, std::memory_order_relaxed)) {
+                        *pos = p;
+                        return slot;
+                    }
+                } else if (diff < 0) {
+                    return nullptr;
+                } else {
+                    p = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Free tail slot for a producer, applying the overflow policy when
+        // the ring is full; nullptr if the message has to be dropped
+        MQTTQueueSlot* claimSlot(uint32_t* pos, bool fromISR) {
+            MQTTQueueSlot* slot = claimTail(pos);
+            if (!slot && policy == MQTT_QUEUE_DROP_OLDEST) {
+                // Discard from the head until a tail slot frees up
+                for (uint8_t tries = 0; !slot && tries < 4; tries++) {
+                    uint32_t oldPos;
+                    MQTTQueueSlot* old = claimHead(&oldPos);
+                    if (old) {
+                        releaseHead(old, oldPos);
+                        droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    slot = claimTail(pos);
+                }
+            } else if (!slot && policy == MQTT_QUEUE_BLOCK && !fromISR) {
+                uint32_t start = millis();
+                while (!slot && millis() - start < blockMs) {
+                    if (consumer) xTaskNotifyGive(consumer);
+                    vTaskDelay(1);
+                    slot = claimTail(pos);
+                }
+            }
+            if (!slot) droppedNewest.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+
+        // Make a filled slot visible to the consumer
+        void commitSlot(MQTTQueueSlot* slot, uint32_t pos) {
+            slot->seq.store(pos + 1, std::memory_order_release);
+            pushed.fetch_add(1, std::memory_order_relaxed);
+            uint32_t depth = size();
+            uint32_t high = highWater.load(std::memory_order_relaxed);
+            while (depth > high && !highWater.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {
+            }
+        }
+
+        bool pushInternal(uint8_t topicId, const uint8_t* payload, uint16_t length, bool retained, bool fromISR) {
+            if (!slots || topicId >= topicCount.load(std::memory_order_acquire)) return false;
+            if (length > payloadMax) {
+                oversize.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            uint32_t pos;
+            MQTTQueueSlot* slot = claimSlot(&pos, fromISR);
+            if (!slot) return false;
+            slot->topicId = topicId;
+            slot->retained = retained;
+            slot->length = length;
+            memcpy(slot->payload, payload, length);
+            commitSlot(slot, pos);
+            return true;
+        }
+
+    public:
+        // Allocate the ring once; slots is rounded up to a power of two
+        bool begin(uint16_t slotCount = MQTT_QUEUE_SLOTS, uint16_t payloadBytes = MQTT_QUEUE_PAYLOAD_MAX) {
+            if (slots) return true;
+            uint32_t n = 2;
+            while (n < slotCount) n <<= 1;
+            slots = new MQTTQueueSlot[n];
+            size_t bytes = (size_t)n * payloadBytes;
+            payloads = (uint8_t*)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+            if (!payloads) {
+                delete[] slots;
+                slots = nullptr;
+                Serial.println("[MQTTQueue] ✗ Out of memory");
+                return false;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                slots[i].seq.store(i, std::memory_order_relaxed);
+                slots[i].payload = &payloads[i * payloadBytes];
+            }
+            topicLock = xSemaphoreCreateMutex();
+            mask = n - 1;
+            payloadMax = payloadBytes;
+            enqueuePos.store(0);
+            dequeuePos.store(0);
+            Serial.printf("[MQTTQueue] ✓ %lu slots x %u bytes\n", (unsigned long)n, payloadBytes);
+            return true;
+        }
+
+        bool isReady() {
+            return slots != nullptr;
+        }
+
+        int8_t findTopic(const char* suffix) {
+            uint8_t count = topicCount.load(std::memory_order_acquire);
+            for (uint8_t i = 0; i < count; i++) {
+                if (strcmp(topics[i], suffix) == 0) return i;
+            }
+            return -1;
+        }
+
+        // Register a topic suffix (copied) and return its id, the same id if
+        // already registered; -1 if the table is full or the suffix too
+        // long. Not for ISRs.
+        int8_t addTopic(const char* suffix) {
+            int8_t id = findTopic(suffix);
+            if (id >= 0 || !topicLock) return id;
+            if (strlen(suffix) >= MQTT_QUEUE_TOPIC_LEN) return -1;
+
+            xSemaphoreTake(topicLock, portMAX_DELAY);
+            uint8_t count = topicCount.load(std::memory_order_relaxed);
+            id = findTopic(suffix);     // Another task may have added it meanwhile
+            if (id < 0 && count < MQTT_QUEUE_MAX_TOPICS) {
+                strcpy(topics[count], suffix);
+                topicCount.store(count + 1, std::memory_order_release);
+                id = count;
+            }
+            xSemaphoreGive(topicLock);
+            return id;
+        }
+
+        const char* topicSuffix(uint8_t topicId) {
+            return topicId < topicCount.load(std::memory_order_acquire) ? topics[topicId] : nullptr;
+        }
+
+        uint8_t topicsUsed() {
+            return topicCount.load(std::memory_order_relaxed);
+        }
+
+        void setOverflowPolicy(MQTTQueueOverflow overflow, uint32_t waitMs = MQTT_QUEUE_BLOCK_MS) {
+            policy = overflow;
+            blockMs = waitMs;
+        }
+
+        MQTTQueueOverflow getOverflowPolicy() {
+            return policy;
+        }
+
+        // Task to wake when a message is queued (the MQTT task)
+        void setConsumer(TaskHandle_t task) {
+            consumer = task;
+        }
+
+        bool push(uint8_t topicId, const uint8_t* payload, uint16_t length, bool retained = false) {
+            bool ok = pushInternal(topicId, payload, length, retained, false);
+            if (ok && consumer) xTaskNotifyGive(consumer);
+            return ok;
+        }
+
+        // Reserve length bytes and let fill(uint8_t* slot) write them in
+        // place, e.g. serializeJson() straight into the ring. The slot has
+        // slotBytes() of room, so a writer's terminator may follow.
+        template <typename Fn>
+        bool pushWith(uint8_t topicId, uint16_t length, bool retained, Fn fill) {
+            if (!slots || topicId >= topicCount.load(std::memory_order_acquire)) return false;
+            if (length > payloadMax) {
+                oversize.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            uint32_t pos;
+            MQTTQueueSlot* slot = claimSlot(&pos, false);
+            if (!slot) return false;
+            slot->topicId = topicId;
+            slot->retained = retained;
+            slot->length = length;
+            fill(slot->payload);
+            commitSlot(slot, pos);
+            if (consumer) xTaskNotifyGive(consumer);
+            return true;
+        }
+
+        bool push(uint8_t topicId, const char* payload, bool retained = false) {
+            return push(topicId, (const uint8_t*)payload, strlen(payload), retained);
+        }
+
+        bool pushFromISR(uint8_t topicId, const uint8_t* payload, uint16_t length, bool retained = false) {
+            bool ok = pushInternal(topicId, payload, length, retained, true);
+            if (ok && consumer) {
+                BaseType_t woken = pdFALSE;
+                vTaskNotifyGiveFromISR(consumer, &woken);
+                if (woken) portYIELD_FROM_ISR();
+            }
+            return ok;
+        }
+
+        // Consumer side: hand the oldest message to fn(topicSuffix, payload,
+        // length, retained) straight from its slot, then free the slot.
+        // Returns false if the queue was empty.
+        template <typename Fn>
+        bool pop(Fn fn) {
+            if (!slots) return false;
+            uint32_t pos;
+            MQTTQueueSlot* slot = claimHead(&pos);
+            if (!slot) return false;
+            fn(topics[slot->topicId], slot->payload, slot->length, slot->retained);
+            releaseHead(slot, pos);
+            popped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        uint32_t size() {
+            int32_t n = (int32_t)(enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed));
+            return n > 0 ? n : 0;
+        }
+
+        uint16_t slotBytes() {
+            return payloadMax;
+        }
+
+        uint32_t capacity() {
+            return slots ? mask + 1 : 0;
+        }
+
+        void getStats(MQTTQueueStats* stats) {
+            stats->pushed = pushed.load();
+            stats->popped = popped.load();
+            stats->droppedOldest = droppedOldest.load();
+            stats->droppedNewest = droppedNewest.load();
+            stats->oversize = oversize.load();
+            stats->highWater = highWater.load();
+        }
+
+        void resetStats() {
+            pushed = 0;
+            popped = 0;
+            droppedOldest = 0;
+            droppedNewest = 0;
+            oversize = 0;
+            highWater = 0;
+        }
+
+        void printStatus() {
+            static const char* const policyNames[] = { "drop-oldest", "drop-newest", "block" };
+            if (!slots) {
+                Serial.println("Queue: not started");
+                return;
+            }
+            MQTTQueueStats s;
+            getStats(&s);
+            Serial.printf("Queue: %lu/%lu slots x %u bytes, %s", (unsigned long)size(), (unsigned long)capacity(),
+                          payloadMax, policyNames[policy]);
+            if (policy == MQTT_QUEUE_BLOCK) Serial.printf(" %lu ms", (unsigned long)blockMs);
+            Serial.println();
+            Serial.printf("Pushed: %lu, sent: %lu, high water: %lu\n", (unsigned long)s.pushed, (unsigned long)s.popped,
+                          (unsigned long)s.highWater);
+            Serial.printf("Dropped: oldest %lu, newest %lu, oversize %lu\n", (unsigned long)s.droppedOldest,
+                          (unsigned long)s.droppedNewest, (unsigned long)s.oversize);
+            Serial.printf("Topics: %u/%d\n", topicsUsed(), MQTT_QUEUE_MAX_TOPICS);
+        }
+};
+
+#endif // MQTT_PUBLISH_QUEUE_H
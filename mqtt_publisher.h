@@ -1,61 +1,268 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
 #include "mqtt_lib.h"
 #include "RTCManager.h"
+#include "deadband.h"
+
+#define MQTT_PUBLISHER_TOPIC_MAX 96     // Topic plus encoding suffix
+#define MQTT_PUBLISHER_MAX_KEYS 16      // Keys with change tracking; others count as always changed
+
+// Last published value of one setData() key. Keys are stored by hash so
+// temporary strings can be passed.
+struct MQTTPublisherKey {
+    uint32_t hash;
+    double current;         // Latest setData() value (a hash for strings)
+    double lastSent;
+    float deadband;         // Absolute units, or percent of the last sent value
+    bool percent;
+    bool text;              // Strings: any change counts
+    bool sent;              // lastSent is valid
+};
+
+class MQTTPublishGroup;
 
 class MQTTPublisher {
+    friend class MQTTPublishGroup;
     private:
         MQTT_Lib* mqttClient;
         bool send_flag;    
-        DynamicJsonDocument* doc; 
+        JsonDocument* doc; 
+        bool ownsDoc = true;
+        MQTTPublishGroup* group = nullptr;  // Published by the group instead of loop()
         const char* topic; 
         bool retained; 
         int qos = 0;
+        MQTTPayloadEncoding encoding = MQTT_PAYLOAD_JSON;
+        bool epochMs = false;
+        char encodedTopic[MQTT_PUBLISHER_TOPIC_MAX];   // topic + MQTT_MSGPACK_TOPIC_SUFFIX
+
+        // Change detection
+        MQTTPublisherKey keys[MQTT_PUBLISHER_MAX_KEYS];
+        uint8_t keyCount = 0;
+        bool changeDetection = true;
+        bool untrackedSet = false;      // A key beyond MQTT_PUBLISHER_MAX_KEYS was set
+        bool forceSend = false;         // setJson(): the whole document changed
+        uint32_t minIntervalMs = 0;
+        uint32_t maxSilenceMs = 0;
+        unsigned long lastPublish = 0;
+        bool published = false;
+        uint32_t suppressed = 0;
+
+        static uint32_t hashText(const char* text) {
+            uint32_t hash = 2166136261UL;  // FNV-1a
+            while (*text) {
+                hash ^= (uint8_t)*text++;
+                hash *= 16777619UL;
+            }
+            return hash;
+        }
+
+        MQTTPublisherKey* findKey(const char* key, bool create) {
+            uint32_t hash = hashText(key);
+            for (uint8_t i = 0; i < keyCount; i++) {
+                if (keys[i].hash == hash) return &keys[i];
+            }
+            if (!create || keyCount >= MQTT_PUBLISHER_MAX_KEYS) return nullptr;
+            MQTTPublisherKey& entry = keys[keyCount++];
+            entry.hash = hash;
+            entry.current = 0;
+            entry.lastSent = 0;
+            entry.deadband = 0;
+            entry.percent = false;
+            entry.text = false;
+            entry.sent = false;
+            return &entry;
+        }
+
+        void track(const char* key, double value, bool text) {
+            MQTTPublisherKey* entry = findKey(key, true);
+            if (entry) {
+                entry->current = value;
+                entry->text = text;
+            } else {
+                untrackedSet = true;
+            }
+            send_flag = true;
+        }
+
+        bool exceedsDeadband(const MQTTPublisherKey& entry) {
+            if (!entry.sent) return true;
+            // Strings carry a hash: any change counts
+            if (entry.text) return entry.current != entry.lastSent;
+            return ::exceedsDeadband(entry.current, entry.lastSent, entry.deadband, entry.percent);
+        }
+
+        bool anyChanged() {
+            if (untrackedSet) return true;
+            for (uint8_t i = 0; i < keyCount; i++) {
+                if (exceedsDeadband(keys[i])) return true;
+            }
+            return false;
+        }
+
+        // Document handed to MQTT_Lib: values in it are now the reference
+        void commitKeys() {
+            for (uint8_t i = 0; i < keyCount; i++) {
+                keys[i].lastSent = keys[i].current;
+                keys[i].sent = true;
+            }
+            untrackedSet = false;
+        }
+
+        bool sendDoc() {
+            // QoS 1 goes into the in-flight window, which keeps it until
+            // the broker acknowledges it; retried here while the window is full
+            if (qos > 0) {
+                return mqttClient->publishQos1Json(publishTopic(), *doc, retained, encoding);
+            }
+
+            // With a publish queue the MQTT task does the sending; the
+            // document is serialised straight into a ring slot. If the queue
+            // refuses it (topic table full, ring full) it is published below.
+            MQTTPublishQueue* queue = mqttClient->getQueue();
+            if (queue && queue->isReady() && measurePayload(*doc, encoding) < queue->slotBytes() &&
+                mqttClient->enqueueJson(publishTopic(), *doc, retained, encoding)) {
+                return true;
+            }
+
+            // Otherwise streamed into the socket, so the size is not capped
+            // by the PubSubClient buffer. With a spool every sample is kept
+            // while offline; without one only the latest document waits.
+            if (mqttClient->connectionStatus() != MQTT_CONNECTED && !mqttClient->hasSpool()) return false;
+            yield(); // Feed watchdog before MQTT operations
+            bool ok = mqttClient->publishSpooledJson(publishTopic(), *doc, retained, encoding);
+            yield(); // Feed watchdog after MQTT operations
+            return ok;
+        }
+
+        // Binary payloads go to their own topic so consumers know how to decode
+        void buildTopic() {
+            encodedTopic[0] = '\0';
+            if (encoding == MQTT_PAYLOAD_JSON) return;
+            int len = snprintf(encodedTopic, sizeof(encodedTopic), "%s%s", topic, MQTT_MSGPACK_TOPIC_SUFFIX);
+            if (len < 0 || len >= (int)sizeof(encodedTopic)) {
+                Serial.printf("[MQTT PUBLISH] ✗ Topic too long for %s suffix: %s\n", MQTT_MSGPACK_TOPIC_SUFFIX, topic);
+                encodedTopic[0] = '\0';
+            }
+        }
+
+        const char* publishTopic() {
+            return encodedTopic[0] ? encodedTopic : topic;
+        }
+
+        // Group members carry no timestamp of their own; the combined
+        // message has one
+        void stamp(bool force = false) {
+            if (group && !force) return;
+            if (epochMs) (*doc)["timestamp"] = rtc.getEpochMs();
+            else (*doc)["timestamp"] = rtc.getDateTime();
+        }
     public:
         MQTTPublisher(MQTT_Lib* client, const char* pub_topic, int json_size ,bool retain_msg = false, int quality_of_service = 0)
             : mqttClient(client), topic(pub_topic), retained(retain_msg), qos(quality_of_service) {
             send_flag = false;
             doc = new DynamicJsonDocument(json_size);
+            encodedTopic[0] = '\0';
+        }
+
+        // Document from an MQTTDocArena (or any caller-owned document)
+        MQTTPublisher(MQTT_Lib* client, const char* pub_topic, JsonDocument* shared_doc, bool retain_msg = false, int quality_of_service = 0)
+            : mqttClient(client), doc(shared_doc), ownsDoc(false), topic(pub_topic), retained(retain_msg), qos(quality_of_service) {
+            send_flag = false;
+            encodedTopic[0] = '\0';
         }
 
         ~MQTTPublisher() {
-            delete doc;
+            if (ownsDoc) delete (DynamicJsonDocument*)doc;
         }
 
         void settopic(const char* pub_topic) {
             topic = pub_topic;
+            buildTopic();
+        }
+
+        // MessagePack is about half the size of the JSON text and cheaper
+        // to produce; it is published on "<topic>/msgpack"
+        void setEncoding(MQTTPayloadEncoding enc) {
+            encoding = enc;
+            buildTopic();
+        }
+
+        MQTTPayloadEncoding getEncoding() {
+            return encoding;
+        }
+
+        // Numeric milliseconds since 1970 instead of "YYYY-MM-DD HH:MM:SS"
+        void setEpochTimestamps(bool on) {
+            epochMs = on;
+        }
+
+        // Only publish a key's change once it moves by more than this
+        // (absolute units, or percent of the last published value)
+        void setDeadband(const char* key, float deadband, bool percent = false) {
+            MQTTPublisherKey* entry = findKey(key, true);
+            if (!entry) {
+                Serial.printf("[MQTT PUBLISH] ✗ Too many tracked keys, no deadband for %s\n", key);
+                return;
+            }
+            entry->deadband = deadband;
+            entry->percent = percent;
+        }
+
+        // At most one publish per interval; changes in between are merged
+        void setMinInterval(uint32_t ms) {
+            minIntervalMs = ms;
+        }
+
+        // Republish the current document after this long without a change
+        // (heartbeat); 0 disables
+        void setMaxSilence(uint32_t ms) {
+            maxSilenceMs = ms;
+        }
+
+        // Off: every setData() publishes, as before change tracking
+        void setChangeDetection(bool on) {
+            changeDetection = on;
+        }
+
+        uint32_t getSuppressed() {
+            return suppressed;
         }
 
         void setJson(const DynamicJsonDocument &jsonDoc) {
             doc->clear();
             doc->set(jsonDoc);
             send_flag = true;
+            forceSend = true;
         }
 
         void setData(const char* key, const char* value) {
             (*doc)[key] = value;
-            (*doc)["timestamp"] = rtc.getDateTime();
-            send_flag = true;
+            stamp();
+            track(key, hashText(value), true);
         }
 
         void setData(const char* key, int value) {
             (*doc)[key] = value;
-            (*doc)["timestamp"] = rtc.getDateTime();
-            send_flag = true;
+            stamp();
+            track(key, value, false);
         }
         void setData(const char* key, float value) {
             (*doc)[key] = value;
-            (*doc)["timestamp"] = rtc.getDateTime();
-            send_flag = true;
+            stamp();
+            track(key, value, false);
         }
         void setData(const char* key, uint32_t value) {
             (*doc)[key] = value;
-            (*doc)["timestamp"] = rtc.getDateTime();
-            send_flag = true;
+            stamp();
+            track(key, value, false);
         }
         
         void setData(const char* key, double value) {
             (*doc)[key] = value;
-            (*doc)["timestamp"] = rtc.getDateTime();
-            send_flag = true;
+            stamp();
+            track(key, value, false);
         }
         
         const char * getdata(const char* topic) {
@@ -76,15 +283,36 @@ class MQTTPublisher {
             return true;
         }
 
-        void loop() {
-            if (send_flag && mqttClient->connectionStatus() == MQTT_CONNECTED) {
-                yield(); // Feed watchdog before MQTT operations
-                String fullTopic = mqttClient->getTopic(topic); // Call getTopic only once
-                String payload;
-                serializeJson(*doc, payload);
-                Serial.println("[MQTT PUBLISH] Topic: " + fullTopic);
-                send_flag = !mqttClient->publish(fullTopic.c_str(), payload.c_str(), retained);
-                yield(); // Feed watchdog after MQTT operations
+        // Something changed beyond its deadband, or a heartbeat is due
+        bool due(unsigned long now) {
+            bool heartbeat = maxSilenceMs > 0 && published && now - lastPublish >= maxSilenceMs;
+            if (!send_flag && !heartbeat) return false;
+            if (published && minIntervalMs > 0 && now - lastPublish < minIntervalMs) return false;
+
+            if (!heartbeat && !forceSend && changeDetection && !anyChanged()) {
+                send_flag = false;      // Nothing moved beyond its deadband
+                suppressed++;
+                return false;
             }
+            return true;
+        }
+
+        void markPublished(unsigned long now) {
+            commitKeys();
+            send_flag = false;
+            forceSend = false;
+            published = true;
+            lastPublish = now;
         }
-};
\ No newline at end of file
+
+        void loop() {
+            if (group) return;          // MQTTPublishGroup::loop() sends it
+            unsigned long now = millis();
+            if (!due(now)) return;
+            if (!send_flag) stamp();    // Heartbeat carries the current time
+            if (!sendDoc()) return;     // Retried next loop
+            markPublished(now);
+        }
+};
+
+#endif // MQTT_PUBLISHER_H
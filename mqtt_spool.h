@@ -0,0 +1,375 @@
+#ifndef MQTT_SPOOL_H
+#define MQTT_SPOOL_H
+
+// Store-and-forward queue for outbound MQTT messages.
+//
+// While the broker is unreachable, messages are appended to segment files
+// on FFat (/mqttq/00000001.q, 00000002.q, ...). Once connected, MQTT_Lib
+// replays them oldest first at a limited rate, deleting each segment when
+// it has been sent. The total size is bounded by a disk budget; when a new
+// segment would exceed it, the oldest segment is dropped.
+//
+// Record: [magic(2)][flags(1)][topic len(1)][payload len(2)][crc32(4)][topic][payload]
+// The CRC covers flags, both lengths, topic and payload, so a record torn
+// by a power cut is detected and the rest of its segment skipped.
+//
+// The read position is saved every MQTT_SPOOL_HEAD_EVERY records and at
+// each segment boundary, so after a reset a few records may be sent twice
+// (at-least-once delivery).
+//
+//   mqttSpool.begin(FFat, 512 * 1024);
+//   mqtt_obj.setSpool(&mqttSpool);
+//   mqtt_obj.publishSpooled("production/count", payload);
+
+#include <Arduino.h>
+#include <FS.h>
+#include <PubSubClient.h>
+#include "esp_rom_crc.h"
+
+#define MQTT_SPOOL_DIR              "/mqttq"
+#define MQTT_SPOOL_SEGMENT_BYTES    (32 * 1024)
+#define MQTT_SPOOL_BUDGET_BYTES     (512 * 1024)    // Default disk budget
+#define MQTT_SPOOL_MAX_PAYLOAD      4096            // Record limit; the client's buffer may allow less
+#define MQTT_SPOOL_REPLAY_RATE      20              // Default records per second
+#define MQTT_SPOOL_REPLAY_BURST     10              // Records per replay() call at most
+#define MQTT_SPOOL_HEAD_EVERY       32              // Save the read position every N records
+#define MQTT_SPOOL_MAGIC            0x5153
+
+struct __attribute__((packed)) MQTTSpoolRecord {
+    uint16_t magic;
+    uint8_t flags;          // Bit 0: retained
+    uint8_t topicLen;
+    uint16_t payloadLen;
+    uint32_t crc;
+};
+
+class MQTTSpool {
+    private:
+        fs::FS* fs = nullptr;
+        uint32_t budget = MQTT_SPOOL_BUDGET_BYTES;
+        uint32_t rate = MQTT_SPOOL_REPLAY_RATE;
+        uint32_t firstSeg = 1;          // Segments on disk are [firstSeg, nextSeg)
+        uint32_t nextSeg = 1;
+        uint32_t readOffset = 0;        // In firstSeg
+        uint32_t writeSize = 0;         // Size of segment nextSeg - 1
+        uint32_t totalBytes = 0;        // All segments on disk
+        File wfile;                     // Append handle on nextSeg - 1
+        File rfile;                     // Read handle on firstSeg
+        uint8_t* buf = nullptr;         // One record's topic + payload
+        uint32_t credit = 0;            // Replay tokens, 1000 per record
+        unsigned long lastReplay = 0;
+        uint16_t sinceHeadSave = 0;
+        uint32_t stored = 0;
+        uint32_t replayed = 0;
+        uint32_t dropped = 0;           // Too large or not written
+        uint32_t tooLarge = 0;          // Records that do not fit one client packet
+        uint16_t packetLimit = 0;       // PubSubClient buffer size, 0 until known
+        uint32_t evicted = 0;           // Segments deleted unsent to stay in budget
+        uint32_t corrupt = 0;           // Segments cut short by a bad record
+
+        void segPath(uint32_t seg, char* path) {
+            snprintf(path, 32, MQTT_SPOOL_DIR "/%08lx.q", (unsigned long)seg);
+        }
+
+        // A PUBLISH packet is built whole in the client's buffer: fixed
+        // header, topic length, topic, payload
+        static bool fitsPacket(size_t topicLen, size_t length, uint16_t bufferSize) {
+            return MQTT_MAX_HEADER_SIZE + 2 + topicLen + length <= bufferSize;
+        }
+
+        uint32_t crcOf(const MQTTSpoolRecord& rec, const uint8_t* data) {
+            uint32_t crc = esp_rom_crc32_le(0, &rec.flags, 4);
+            return esp_rom_crc32_le(crc, data, rec.topicLen + rec.payloadLen);
+        }
+
+        void saveHead() {
+            File f = fs->open(MQTT_SPOOL_DIR "/head", "w");
+            if (!f) return;
+            uint32_t head[2] = { firstSeg, readOffset };
+            f.write((const uint8_t*)head, sizeof(head));
+            f.close();
+            sinceHeadSave = 0;
+        }
+
+        // Delete firstSeg and move on to the next one
+        void dropFirst() {
+            char path[32];
+            segPath(firstSeg, path);
+            if (rfile) rfile.close();
+            if (firstSeg == nextSeg - 1) {
+                if (wfile) wfile.close();
+                writeSize = 0;
+            }
+            File f = fs->open(path, "r");
+            uint32_t size = f ? f.size() : 0;
+            if (f) f.close();
+            fs->remove(path);
+            totalBytes = (totalBytes > size) ? totalBytes - size : 0;
+            firstSeg++;
+            readOffset = 0;
+            saveHead();
+        }
+
+        // Open (or start) the segment to append a record of len bytes to
+        bool openWrite(uint32_t len) {
+            if (firstSeg == nextSeg || writeSize + len > MQTT_SPOOL_SEGMENT_BYTES) {
+                if (wfile) wfile.close();
+                // Oldest first: make room for a whole new segment
+                while (firstSeg != nextSeg && totalBytes + MQTT_SPOOL_SEGMENT_BYTES > budget) {
+                    char path[32];
+                    segPath(firstSeg, path);
+                    File f = fs->open(path, "r");
+                    uint32_t unsent = f ? f.size() - readOffset : 0;
+                    if (f) f.close();
+                    if (unsent > 0) evicted++;
+                    dropFirst();
+                }
+                nextSeg++;
+                writeSize = 0;
+            }
+            if (!wfile) {
+                if (rfile && firstSeg == nextSeg - 1) rfile.close();
+                char path[32];
+                segPath(nextSeg - 1, path);
+                wfile = fs->open(path, "a");
+            }
+            return (bool)wfile;
+        }
+
+    public:
+        ~MQTTSpool() {
+            end();
+        }
+
+        // Mount on a filesystem that is already initialised. Existing
+        // segments from before a reset are picked up and replayed.
+        bool begin(fs::FS& filesystem, uint32_t budgetBytes = MQTT_SPOOL_BUDGET_BYTES) {
+            end();
+            fs = &filesystem;
+            budget = (budgetBytes < 2 * MQTT_SPOOL_SEGMENT_BYTES) ? 2 * MQTT_SPOOL_SEGMENT_BYTES : budgetBytes;
+            if (!fs->exists(MQTT_SPOOL_DIR)) fs->mkdir(MQTT_SPOOL_DIR);
+            buf = (uint8_t*)malloc(255 + MQTT_SPOOL_MAX_PAYLOAD);
+            if (!buf) {
+                Serial.println("[MQTTSpool] ✗ Out of memory");
+                fs = nullptr;
+                return false;
+            }
+
+            // Find the segment range left on disk
+            uint32_t minSeg = 0, maxSeg = 0;
+            totalBytes = 0;
+            File dir = fs->open(MQTT_SPOOL_DIR);
+            if (dir) {
+                File entry = dir.openNextFile();
+                while (entry) {
+                    String name = entry.name();
+                    name = name.substring(name.lastIndexOf('/') + 1);
+                    if (!entry.isDirectory() && name.endsWith(".q")) {
+                        uint32_t seg = strtoul(name.c_str(), nullptr, 16);
+                        if (seg > 0) {
+                            if (minSeg == 0 || seg < minSeg) minSeg = seg;
+                            if (seg > maxSeg) maxSeg = seg;
+                            totalBytes += entry.size();
+                        }
+                    }
+                    entry.close();
+                    entry = dir.openNextFile();
+                }
+                dir.close();
+            }
+
+            // Never append to a segment from before the reset: its tail may
+            // be a torn record
+            firstSeg = nextSeg = 1;
+            readOffset = 0;
+            writeSize = MQTT_SPOOL_SEGMENT_BYTES;
+            if (minSeg > 0) {
+                firstSeg = minSeg;
+                nextSeg = maxSeg + 1;
+                File head = fs->open(MQTT_SPOOL_DIR "/head", "r");
+                uint32_t saved[2];
+                if (head && head.read((uint8_t*)saved, sizeof(saved)) == sizeof(saved) && saved[0] == firstSeg) {
+                    readOffset = saved[1];
+                }
+                if (head) head.close();
+            }
+            Serial.printf("[MQTTSpool] ✓ Ready: %lu segment(s), %lu bytes queued, budget %lu KB\n",
+                          (unsigned long)(nextSeg - firstSeg), (unsigned long)pendingBytes(), (unsigned long)(budget / 1024));
+            return true;
+        }
+
+        void end() {
+            if (wfile) wfile.close();
+            if (rfile) rfile.close();
+            if (fs && sinceHeadSave > 0) saveHead();
+            free(buf);
+            buf = nullptr;
+            fs = nullptr;
+        }
+
+        bool isReady() {
+            return fs != nullptr;
+        }
+
+        // Buffer size of the client records are replayed through; push()
+        // refuses messages that could never be sent. Set by MQTT_Lib.
+        void setPacketLimit(uint16_t bufferSize) {
+            packetLimit = bufferSize;
+        }
+
+        void setReplayRate(uint32_t recordsPerSecond) {
+            rate = recordsPerSecond > 0 ? recordsPerSecond : 1;
+        }
+
+        uint32_t pendingBytes() {
+            return (totalBytes > readOffset) ? totalBytes - readOffset : 0;
+        }
+
+        bool pending() {
+            return fs && pendingBytes() > 0;
+        }
+
+        // Append one message. The record is flushed before returning so it
+        // survives a power cut.
+        bool push(const char* topic, const uint8_t* payload, unsigned int length, bool retained = false) {
+            if (!fs) return false;
+            size_t topicLen = strlen(topic);
+            if (topicLen == 0 || topicLen > 255 || length > MQTT_SPOOL_MAX_PAYLOAD) {
+                dropped++;
+                return false;
+            }
+            if (packetLimit > 0 && !fitsPacket(topicLen, length, packetLimit)) {
+                tooLarge++;
+                dropped++;
+                return false;
+            }
+
+            MQTTSpoolRecord rec;
+            rec.magic = MQTT_SPOOL_MAGIC;
+            rec.flags = retained ? 0x01 : 0x00;
+            rec.topicLen = topicLen;
+            rec.payloadLen = length;
+            uint32_t crc = esp_rom_crc32_le(0, &rec.flags, 4);
+            crc = esp_rom_crc32_le(crc, (const uint8_t*)topic, topicLen);
+            rec.crc = esp_rom_crc32_le(crc, payload, length);
+
+            uint32_t len = sizeof(rec) + topicLen + length;
+            if (!openWrite(len)) {
+                Serial.println("[MQTTSpool] ✗ Cannot open segment");
+                dropped++;
+                return false;
+            }
+            size_t written = wfile.write((const uint8_t*)&rec, sizeof(rec));
+            written += wfile.write((const uint8_t*)topic, topicLen);
+            written += wfile.write(payload, length);
+            wfile.flush();
+            writeSize += written;
+            totalBytes += written;
+            if (written != len) {
+                // Disk full: the torn record is skipped on replay
+                wfile.close();
+                writeSize = MQTT_SPOOL_SEGMENT_BYTES;
+                dropped++;
+                return false;
+            }
+            stored++;
+            return true;
+        }
+
+        // Send queued records through client, oldest first, at the replay
+        // rate. Stops at the first failed publish and retries it next call.
+        // Returns the number of records sent.
+        uint16_t replay(PubSubClient& client) {
+            if (!pending()) return 0;
+            unsigned long now = millis();
+            credit += (now - lastReplay) * rate;
+            lastReplay = now;
+            if (credit > MQTT_SPOOL_REPLAY_BURST * 1000UL) credit = MQTT_SPOOL_REPLAY_BURST * 1000UL;
+
+            uint16_t sent = 0;
+            while (credit >= 1000 && pending()) {
+                if (!rfile) {
+                    if (wfile && firstSeg == nextSeg - 1) wfile.close();
+                    char path[32];
+                    segPath(firstSeg, path);
+                    rfile = fs->open(path, "r");
+                    if (!rfile) {
+                        dropFirst();
+                        continue;
+                    }
+                    rfile.seek(readOffset);
+                }
+
+                MQTTSpoolRecord rec;
+                int got = rfile.read((uint8_t*)&rec, sizeof(rec));
+                if (got == 0 && firstSeg != nextSeg - 1) {
+                    dropFirst();        // Segment fully sent
+                    continue;
+                }
+                if (got == 0) {
+                    // Caught up with the writer: start over with fresh files
+                    dropFirst();
+                    break;
+                }
+                uint32_t dataLen = (got == sizeof(rec)) ? rec.topicLen + rec.payloadLen : 0;
+                if (got != sizeof(rec) || rec.magic != MQTT_SPOOL_MAGIC || rec.topicLen == 0 ||
+                    rec.payloadLen > MQTT_SPOOL_MAX_PAYLOAD ||
+                    rfile.read(buf, dataLen) != (int)dataLen || crcOf(rec, buf) != rec.crc) {
+                    Serial.printf("[MQTTSpool] ✗ Bad record in segment %lu at %lu, skipping rest\n",
+                                  (unsigned long)firstSeg, (unsigned long)readOffset);
+                    corrupt++;
+                    dropFirst();
+                    continue;
+                }
+
+                if (!fitsPacket(rec.topicLen, rec.payloadLen, client.getBufferSize())) {
+                    // Spooled before the limit was known or lowered; retrying would block the spool
+                    Serial.printf("[MQTTSpool] ✗ Record of %u bytes exceeds the client buffer, dropped\n",
+                                  (unsigned)(rec.topicLen + rec.payloadLen));
+                    readOffset += sizeof(rec) + dataLen;
+                    tooLarge++;
+                    dropped++;
+                    continue;
+                }
+
+                char topic[256];
+                memcpy(topic, buf, rec.topicLen);
+                topic[rec.topicLen] = '\0';
+                if (!client.publish(topic, buf + rec.topicLen, rec.payloadLen, rec.flags & 0x01)) {
+                    rfile.close();      // Re-seek to readOffset next time
+                    break;
+                }
+                readOffset += sizeof(rec) + dataLen;
+                credit -= 1000;
+                replayed++;
+                sent++;
+                if (++sinceHeadSave >= MQTT_SPOOL_HEAD_EVERY) saveHead();
+            }
+            if (sent > 0 && !pending()) saveHead();
+            return sent;
+        }
+
+        // Delete everything queued
+        void clear() {
+            if (!fs) return;
+            while (firstSeg != nextSeg) dropFirst();
+        }
+
+        void printStatus() {
+            Serial.println("=== MQTT Spool ===");
+            Serial.printf("Ready: %s\n", fs ? "Yes" : "No");
+            if (fs) {
+                Serial.printf("Queued: %lu bytes in %lu segment(s), budget %lu KB\n", (unsigned long)pendingBytes(),
+                              (unsigned long)(nextSeg - firstSeg), (unsigned long)(budget / 1024));
+                Serial.printf("Replay rate: %lu/s\n", (unsigned long)rate);
+            }
+            Serial.printf("Stored: %lu, replayed: %lu, dropped: %lu (%lu too large for the client buffer)\n",
+                          (unsigned long)stored, (unsigned long)replayed, (unsigned long)dropped,
+                          (unsigned long)tooLarge);
+            Serial.printf("Segments evicted: %lu, cut short by bad records: %lu\n", (unsigned long)evicted,
+                          (unsigned long)corrupt);
+            Serial.println("==================");
+        }
+};
+
+#endif // MQTT_SPOOL_H
@@ -0,0 +1,272 @@
+#ifndef MQTT_TOPIC_ROUTER_H
+#define MQTT_TOPIC_ROUTER_H
+
+// Inbound topic router. MQTT filters (with + and # wildcards) are compiled
+// into a trie at registration; dispatch walks the trie over the topic in
+// place, so a message costs no copies and no heap allocations. Wildcard
+// levels come back to the handler as views into the topic.
+//
+//   mqttRouter.on("devices/+/command/#", [](const MQTTTopicMatch& m, const uint8_t* payload, unsigned int len) {
+//       // m.captures[0] = device, m.captures[1] = rest of the command path
+//       if (m.captures[1].equals("restart")) ...
+//   });
+//   ...
+//   mqttRouter.dispatch(topic, payload, length);   // From the MQTT callback
+//
+// Routes are registered at setup; dispatch runs on the MQTT task.
+
+#include <Arduino.h>
+#include <functional>
+
+#define MQTT_ROUTER_MAX_NODES       64      // Distinct filter levels across all routes
+#define MQTT_ROUTER_MAX_ROUTES      32
+#define MQTT_ROUTER_TEXT_BYTES      1024    // Pool for the literal level names
+#define MQTT_ROUTER_MAX_LEVELS      16      // Topic depth considered by dispatch
+#define MQTT_ROUTER_MAX_CAPTURES    8
+
+// Non-owning slice of the topic being dispatched; only valid inside the handler
+struct MQTTTopicView {
+    const char* data;
+    uint16_t length;
+
+    bool equals(const char* text) const {
+        size_t len = strlen(text);
+        return len == length && memcmp(data, text, len) == 0;
+    }
+
+    long toInt() const {
+        long value = 0;
+        bool negative = false;
+        uint16_t i = 0;
+        if (i < length && (data[i] == '-' || data[i] == '+')) negative = (data[i++] == '-');
+        for (; i < length && data[i] >= '0' && data[i] <= '9'; i++) value = value * 10 + (data[i] - '0');
+        return negative ? -value : value;
+    }
+
+    // Copy into a caller buffer with a terminator; false if truncated
+    bool copyTo(char* buffer, size_t size) const {
+        if (size == 0) return false;
+        size_t len = (length < size) ? length : size - 1;
+        memcpy(buffer, data, len);
+        buffer[len] = '\0';
+        return len == length;
+    }
+};
+
+struct MQTTTopicMatch {
+    const char* topic;                                  // Full topic
+    MQTTTopicView captures[MQTT_ROUTER_MAX_CAPTURES];   // One per + level, then the # remainder
+    uint8_t count;
+};
+
+typedef std::function<void(const MQTTTopicMatch& match, const uint8_t* payload, unsigned int length)> MQTTRouteHandler;
+
+class MQTTTopicRouter {
+    private:
+        struct Node {
+            uint16_t text;          // Offset of the level name in the pool
+            uint8_t length;
+            int8_t child;           // First child, -1 for none
+            int8_t sibling;
+            int8_t route;           // First route ending here, -1 for none
+        };
+
+        struct Route {
+            MQTTRouteHandler handler;
+            int8_t next;            // Next route on the same node
+        };
+
+        Node nodes[MQTT_ROUTER_MAX_NODES];
+        Route routes[MQTT_ROUTER_MAX_ROUTES];
+        char text[MQTT_ROUTER_TEXT_BYTES];
+        uint8_t nodeCount = 0;
+        uint8_t routeCount = 0;
+        uint16_t textUsed = 0;
+
+        uint32_t dispatched = 0;
+        uint32_t unmatched = 0;
+        uint32_t tooDeep = 0;
+
+        bool nodeIs(const Node& node, const char* level, uint8_t length) const {
+            return node.length == length && memcmp(&text[node.text], level, length) == 0;
+        }
+
+        // Child of parent named level, created if needed; -1 when full
+        int8_t child(int8_t parent, const char* level, uint8_t length) {
+            int8_t* link = &nodes[parent].child;
+            while (*link >= 0) {
+                if (nodeIs(nodes[*link], level, length)) return *link;
+                link = &nodes[*link].sibling;
+            }
+            if (nodeCount >= MQTT_ROUTER_MAX_NODES || textUsed + length > MQTT_ROUTER_TEXT_BYTES) return -1;
+            Node& node = nodes[nodeCount];
+            memcpy(&text[textUsed], level, length);
+            node.text = textUsed;
+            node.length = length;
+            node.child = -1;
+            node.sibling = -1;
+            node.route = -1;
+            textUsed += length;
+            *link = nodeCount;
+            return nodeCount++;
+        }
+
+        // Depth-first over the trie; each wildcard level pushes a capture
+        uint8_t match(int8_t index, const MQTTTopicView* levels, uint8_t depth, uint8_t levelCount,
+                      MQTTTopicMatch& result, const uint8_t* payload, unsigned int length) {
+            uint8_t hits = 0;
+            if (depth == levelCount) {
+                for (int8_t r = nodes[index].route; r >= 0; r = routes[r].next) {
+                    routes[r].handler(result, payload, length);
+                    hits++;
+                }
+            }
+
+            // Wildcards never match a first level starting with '$' (broker topics)
+            bool wildcardOk = !(depth == 0 && levelCount > 0 && levels[0].length > 0 && levels[0].data[0] == '$');
+            for (int8_t c = nodes[index].child; c >= 0; c = nodes[c].sibling) {
+                const Node& node = nodes[c];
+                const char* name = &text[node.text];
+                if (node.length == 1 && name[0] == '#') {
+                    if (!wildcardOk || result.count >= MQTT_ROUTER_MAX_CAPTURES) continue;
+                    // Matches the parent level too ("a/#" matches "a")
+                    MQTTTopicView& rest = result.captures[result.count++];
+                    if (depth < levelCount) {
+                        rest.data = levels[depth].data;
+                        rest.length = (levels[levelCount - 1].data + levels[levelCount - 1].length) - rest.data;
+                    } else {
+                        rest.data = "";
+                        rest.length = 0;
+                    }
+                    for (int8_t r = node.route; r >= 0; r = routes[r].next) {
+                        routes[r].handler(result, payload, length);
+                        hits++;
+                    }
+                    result.count--;
+                } else if (depth < levelCount) {
+                    if (node.length == 1 && name[0] == '+') {
+                        if (!wildcardOk || result.count >= MQTT_ROUTER_MAX_CAPTURES) continue;
+                        result.captures[result.count++] = levels[depth];
+                        hits += match(c, levels, depth + 1, levelCount, result, payload, length);
+                        result.count--;
+                    } else if (nodeIs(node, levels[depth].data, levels[depth].length)) {
+                        hits += match(c, levels, depth + 1, levelCount, result, payload, length);
+                    }
+                }
+            }
+            return hits;
+        }
+
+        void printNode(int8_t index, char* path, uint16_t pathLen, uint16_t size) {
+            for (int8_t c = nodes[index].child; c >= 0; c = nodes[c].sibling) {
+                uint16_t len = pathLen;
+                if (len > 0 && len < size - 1) path[len++] = '/';
+                uint8_t copy = (len + nodes[c].length < size) ? nodes[c].length : size - 1 - len;
+                memcpy(&path[len], &text[nodes[c].text], copy);
+                path[len + copy] = '\0';
+                uint8_t handlers = 0;
+                for (int8_t r = nodes[c].route; r >= 0; r = routes[r].next) handlers++;
+                if (handlers) Serial.printf("  %s (%u)\n", path, handlers);
+                printNode(c, path, len + copy, size);
+            }
+        }
+
+    public:
+        MQTTTopicRouter() {
+            clear();
+        }
+
+        void clear() {
+            nodes[0].text = 0;
+            nodes[0].length = 0;
+            nodes[0].child = -1;
+            nodes[0].sibling = -1;
+            nodes[0].route = -1;
+            for (uint8_t i = 0; i < routeCount; i++) routes[i].handler = nullptr;
+            nodeCount = 1;          // Root
+            routeCount = 0;
+            textUsed = 0;
+        }
+
+        // Register a handler for an MQTT filter. Several handlers may share
+        // a filter; they run in registration order. false if the filter is
+        // malformed or the router is full.
+        bool on(const char* filter, MQTTRouteHandler handler) {
+            if (!filter || !handler || routeCount >= MQTT_ROUTER_MAX_ROUTES) {
+                Serial.printf("[MQTT Router] ✗ Cannot add route %s\n", filter ? filter : "(null)");
+                return false;
+            }
+            int8_t node = 0;
+            const char* level = filter;
+            while (true) {
+                const char* end = strchr(level, '/');
+                size_t length = end ? (size_t)(end - level) : strlen(level);
+                bool wildcard = (length == 1 && (level[0] == '+' || level[0] == '#'));
+                if (length > 255 || (!wildcard && (memchr(level, '+', length) || memchr(level, '#', length))) ||
+                    (length == 1 && level[0] == '#' && end)) {
+                    Serial.printf("[MQTT Router] ✗ Invalid filter: %s\n", filter);
+                    return false;
+                }
+                node = child(node, level, length);
+                if (node < 0) {
+                    Serial.printf("[MQTT Router] ✗ Router full, route %s not added\n", filter);
+                    return false;
+                }
+                if (!end) break;
+                level = end + 1;
+            }
+
+            Route& route = routes[routeCount];
+            route.handler = handler;
+            route.next = -1;
+            int8_t* link = &nodes[node].route;
+            while (*link >= 0) link = &routes[*link].next;
+            *link = routeCount++;
+            return true;
+        }
+
+        // Run every matching handler; returns how many ran
+        uint8_t dispatch(const char* topic, const uint8_t* payload, unsigned int length) {
+            MQTTTopicView levels[MQTT_ROUTER_MAX_LEVELS];
+            uint8_t levelCount = 0;
+            const char* level = topic;
+            while (true) {
+                if (levelCount >= MQTT_ROUTER_MAX_LEVELS) {
+                    tooDeep++;
+                    return 0;
+                }
+                const char* end = strchr(level, '/');
+                levels[levelCount].data = level;
+                levels[levelCount].length = end ? (uint16_t)(end - level) : (uint16_t)strlen(level);
+                levelCount++;
+                if (!end) break;
+                level = end + 1;
+            }
+
+            MQTTTopicMatch result;
+            result.topic = topic;
+            result.count = 0;
+            uint8_t hits = match(0, levels, 0, levelCount, result, payload, length);
+            if (hits) dispatched++;
+            else unmatched++;
+            return hits;
+        }
+
+        uint8_t routeTotal() {
+            return routeCount;
+        }
+
+        void printStatus() {
+            Serial.println("=== MQTT Topic Router ===");
+            Serial.printf("Routes: %u/%d, nodes: %u/%d, text: %u/%d bytes\n", routeCount, MQTT_ROUTER_MAX_ROUTES,
+                          nodeCount, MQTT_ROUTER_MAX_NODES, textUsed, MQTT_ROUTER_TEXT_BYTES);
+            Serial.printf("Dispatched: %lu, unmatched: %lu, too deep: %lu\n", (unsigned long)dispatched,
+                          (unsigned long)unmatched, (unsigned long)tooDeep);
+            char path[MQTT_ROUTER_TEXT_BYTES / 4];
+            path[0] = '\0';
+            printNode(0, path, 0, sizeof(path));
+            Serial.println("=========================");
+        }
+};
+
+#endif // MQTT_TOPIC_ROUTER_H
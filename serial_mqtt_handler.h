@@ -3,10 +3,18 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include "MQTT_Lib.h"
+#include "mqtt_spool.h"
+#include "mqtt_publish_queue.h"
+#include "mqtt_topic_router.h"
 
 // External reference to MQTT preferences (should be initialized in main code)
 extern Preferences mqttPref;
 extern bool mqtt_connected; 
+extern MQTT_Lib mqtt_obj;
+extern MQTTSpool mqttSpool;
+extern MQTTPublishQueue mqttQueue;
+extern MQTTTopicRouter mqttRouter;
 
 void printMQTTHelp() {
     Serial.println("=========== MQTT Commands ============");
@@ -22,6 +30,18 @@ void printMQTTHelp() {
     Serial.println("  mqtt show                - Show saved config");
     Serial.println("  mqtt clear               - Clear MQTT config");
     Serial.println("  mqtt test                - Test MQTT connection");
+    Serial.println("  mqtt reconnect           - Retry now instead of waiting out the backoff");
+    Serial.println("  mqtt task on|off         - Run the connection and callbacks on their own task (next boot)");
+    Serial.println("  mqtt queue               - Show publish queue depth and drop counters");
+    Serial.println("  mqtt queue slots <n> [bytes] - Queue size, 0 to disable (next boot)");
+    Serial.println("  mqtt queue policy <p> [ms]   - oldest, newest or block when full");
+    Serial.println("  mqtt routes              - Show registered topic routes and hit counters");
+    Serial.println("  mqtt inflight <n>        - QoS 1 messages awaiting PUBACK, 1-16");
+    Serial.println("  mqtt session clean|persistent - Broker-side session, clean by default (next connect)");
+    Serial.println("  mqtt spool on|off        - Keep messages on FFat while offline (next boot)");
+    Serial.println("  mqtt spool size <kb>     - Spool disk budget (next boot)");
+    Serial.println("  mqtt spool rate <n>      - Replay rate, messages per second");
+    Serial.println("  mqtt spool status|clear  - Show or discard queued messages");
     Serial.println("Examples:");
     Serial.println("  mqtt server 192.168.1.100");
     Serial.println("  mqtt port 1883");
@@ -225,6 +245,7 @@ void handleMQTTCommand(String args) {
             Serial.printf("Server: %s:%d\n", server.c_str(), port);
             Serial.printf("Transport: %s\n", transport.c_str());
             Serial.printf("Status: %s\n", mqtt_connected ? "Connected" : "Disconnected");
+            mqtt_obj.printStatus();
         } else {
             Serial.println("Server: Not configured");
         }
@@ -274,6 +295,172 @@ void handleMQTTCommand(String args) {
         Serial.println("[MQTT] Note: Actual connection test requires MQTT client implementation");
         Serial.println("[MQTT] Configuration is valid and ready to use");
     }
+    else if (subCmd == "reconnect") {
+        mqtt_obj.connect();
+        Serial.println("[MQTT] Reconnect requested");
+    }
+    else if (subCmd == "task") {
+        subArgs.toLowerCase();
+        if (subArgs != "on" && subArgs != "off") {
+            Serial.printf("[MQTT] Task mode: %s\n", mqtt_obj.taskRunning() ? "running" : (mqttPref.getBool("taskmode", false) ? "configured" : "off"));
+            Serial.println("[MQTT] Usage: mqtt task on|off");
+            return;
+        }
+        bool on = (subArgs == "on");
+        mqttPref.end();
+        mqttPref.begin("mqtt", false);
+        mqttPref.putBool("taskmode", on);
+        mqttPref.end();
+        mqttPref.begin("mqtt", true);
+        Serial.printf("[MQTT] Task mode: %s (applies on next boot)\n", on ? "ON" : "OFF");
+    }
+    else if (subCmd == "routes") {
+        mqttRouter.printStatus();
+    }
+    else if (subCmd == "inflight") {
+        int window = subArgs.toInt();
+        if (window < 1 || window > MQTT_INFLIGHT_MAX) {
+            Serial.printf("[MQTT] QoS 1 in flight: %u/%u\n", mqtt_obj.inflightCount(), mqttPref.getUChar("inflight", MQTT_INFLIGHT_WINDOW));
+            Serial.printf("[MQTT] Usage: mqtt inflight <1-%d>\n", MQTT_INFLIGHT_MAX);
+            return;
+        }
+        mqttPref.end();
+        mqttPref.begin("mqtt", false);
+        mqttPref.putUChar("inflight", window);
+        mqttPref.end();
+        mqttPref.begin("mqtt", true);
+        mqtt_obj.setInflightWindow(window);
+        Serial.printf("[MQTT] ✓ QoS 1 in-flight window: %d\n", window);
+    }
+    else if (subCmd == "session") {
+        subArgs.toLowerCase();
+        if (subArgs != "clean" && subArgs != "persistent") {
+            Serial.printf("[MQTT] Session: %s\n", mqttPref.getBool("persist", false) ? "persistent" : "clean");
+            Serial.println("[MQTT] Usage: mqtt session clean|persistent");
+            return;
+        }
+        bool persist = (subArgs == "persistent");
+        mqttPref.end();
+        mqttPref.begin("mqtt", false);
+        mqttPref.putBool("persist", persist);
+        mqttPref.end();
+        mqttPref.begin("mqtt", true);
+        mqtt_obj.setCleanSession(!persist);
+        Serial.printf("[MQTT] ✓ Session: %s (applies on next connect)\n", persist ? "persistent" : "clean");
+    }
+    else if (subCmd == "queue") {
+        int space = subArgs.indexOf(' ');
+        String action = (space > 0) ? subArgs.substring(0, space) : subArgs;
+        String value = (space > 0) ? subArgs.substring(space + 1) : "";
+        action.toLowerCase();
+        value.trim();
+        int space2 = value.indexOf(' ');
+        String value2 = (space2 > 0) ? value.substring(space2 + 1) : "";
+        if (space2 > 0) value = value.substring(0, space2);
+
+        if (action == "" || action == "status") {
+            mqttQueue.printStatus();
+        }
+        else if (action == "reset") {
+            mqttQueue.resetStats();
+            Serial.println("[MQTT] Queue counters reset");
+        }
+        else if (action == "slots") {
+            int slots = value.toInt();
+            int bytes = value2.length() > 0 ? value2.toInt() : mqttPref.getUShort("qbytes", MQTT_QUEUE_PAYLOAD_MAX);
+            if (slots < 0 || slots > 1024 || bytes < 64 || bytes > MQTT_SPOOL_MAX_PAYLOAD) {
+                Serial.printf("[MQTT] ✗ Error: slots 0-1024, bytes 64-%d\n", MQTT_SPOOL_MAX_PAYLOAD);
+                return;
+            }
+            mqttPref.end();
+            mqttPref.begin("mqtt", false);
+            mqttPref.putUShort("qslots", slots);
+            mqttPref.putUShort("qbytes", bytes);
+            mqttPref.end();
+            mqttPref.begin("mqtt", true);
+            Serial.printf("[MQTT] ✓ Queue: %d slots x %d bytes (applies on next boot)\n", slots, bytes);
+        }
+        else if (action == "policy") {
+            value.toLowerCase();
+            MQTTQueueOverflow policy;
+            if (value == "oldest") policy = MQTT_QUEUE_DROP_OLDEST;
+            else if (value == "newest") policy = MQTT_QUEUE_DROP_NEWEST;
+            else if (value == "block") policy = MQTT_QUEUE_BLOCK;
+            else {
+                Serial.println("[MQTT] ✗ Usage: mqtt queue policy oldest|newest|block [ms]");
+                return;
+            }
+            uint32_t waitMs = value2.length() > 0 ? value2.toInt() : mqttPref.getUInt("qblockms", MQTT_QUEUE_BLOCK_MS);
+            mqttPref.end();
+            mqttPref.begin("mqtt", false);
+            mqttPref.putUChar("qpolicy", policy);
+            mqttPref.putUInt("qblockms", waitMs);
+            mqttPref.end();
+            mqttPref.begin("mqtt", true);
+            mqttQueue.setOverflowPolicy(policy, waitMs);
+            Serial.printf("[MQTT] ✓ Queue overflow policy: %s\n", value.c_str());
+        }
+        else {
+            Serial.println("[MQTT] ✗ Usage: mqtt queue [status|reset|slots <n> [bytes]|policy <p> [ms]]");
+        }
+    }
+    else if (subCmd == "spool") {
+        int space = subArgs.indexOf(' ');
+        String action = (space > 0) ? subArgs.substring(0, space) : subArgs;
+        String value = (space > 0) ? subArgs.substring(space + 1) : "";
+        action.toLowerCase();
+        value.trim();
+
+        if (action == "" || action == "status") {
+            Serial.printf("Spool: %s, budget %lu KB\n", mqttPref.getBool("spool", false) ? "enabled" : "disabled",
+                          (unsigned long)mqttPref.getUInt("spoolkb", MQTT_SPOOL_BUDGET_BYTES / 1024));
+            mqttSpool.printStatus();
+        }
+        else if (action == "on" || action == "off") {
+            mqttPref.end();
+            mqttPref.begin("mqtt", false);
+            mqttPref.putBool("spool", action == "on");
+            mqttPref.end();
+            mqttPref.begin("mqtt", true);
+            Serial.printf("[MQTT] ✓ Spool %s (applies on next boot)\n", action == "on" ? "enabled" : "disabled");
+        }
+        else if (action == "size") {
+            int kb = value.toInt();
+            if (kb < (2 * MQTT_SPOOL_SEGMENT_BYTES) / 1024) {
+                Serial.printf("[MQTT] ✗ Error: Spool size must be at least %d KB\n", (2 * MQTT_SPOOL_SEGMENT_BYTES) / 1024);
+                return;
+            }
+            mqttPref.end();
+            mqttPref.begin("mqtt", false);
+            mqttPref.putUInt("spoolkb", kb);
+            mqttPref.end();
+            mqttPref.begin("mqtt", true);
+            Serial.printf("[MQTT] ✓ Spool budget: %d KB (applies on next boot)\n", kb);
+        }
+        else if (action == "rate") {
+            int rate = value.toInt();
+            if (rate < 1 || rate > 1000) {
+                Serial.println("[MQTT] ✗ Error: Rate must be 1-1000 messages per second");
+                return;
+            }
+            mqttPref.end();
+            mqttPref.begin("mqtt", false);
+            mqttPref.putUShort("spoolrate", rate);
+            mqttPref.end();
+            mqttPref.begin("mqtt", true);
+            mqttSpool.setReplayRate(rate);
+            Serial.printf("[MQTT] ✓ Spool replay rate: %d/s\n", rate);
+        }
+        else if (action == "clear") {
+            mqtt_obj.lockNetwork();     // Not while the MQTT task is replaying
+            mqttSpool.clear();
+            mqtt_obj.unlockNetwork();
+            Serial.println("[MQTT] ✓ Spool cleared");
+        }
+        else {
+            Serial.println("[MQTT] ✗ Usage: mqtt spool on|off|size <kb>|rate <n>|status|clear");
+        }
+    }
     else {
         Serial.printf("[MQTT] ✗ Unknown command: %s\n", subCmd.c_str());
         Serial.println("[MQTT] Type 'mqtt help' for available commands");
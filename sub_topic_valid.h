@@ -25,12 +25,9 @@ void publishSubtopicStatus(const String& status, const String& message, const St
         statusDoc["current_subtopic"] = subtopic;
     }
     
-    String payload;
-    serializeJson(statusDoc, payload);
-    
     // Publish to status topic using current MAC address
     String statusTopic = mqtt_obj.getMacTopic("/subtopic/status");
-    mqtt_obj.publish(statusTopic.c_str(), payload.c_str());
+    mqtt_obj.publishJsonTo(statusTopic.c_str(), statusDoc);
     
     Serial.printf("Published subtopic status: %s\n", status.c_str());
 }
@@ -419,10 +416,7 @@ void logSubtopicChange(const DynamicJsonDocument& oldData, const DynamicJsonDocu
         }
     }
     
-    String payload;
-    serializeJson(changeLog, payload);
-    
-    mqtt_obj.publish(mqtt_obj.getMacTopic("subtopic/change_log").c_str(), payload.c_str(), true);
+    mqtt_obj.publishJsonTo(mqtt_obj.getMacTopic("subtopic/change_log").c_str(), changeLog, true);
     
     Serial.println("[SUBTOPIC] Change logged to MQTT");
 }
@@ -24,13 +24,6 @@
 // External reference to preferences (should be initialized in main code)
 extern Preferences tcpModbusPref;
 
-// Transport type enum
-enum TCPModbusTransport {
-    TRANSPORT_WIFI = 0,
-    TRANSPORT_ETHERNET = 1,
-    TRANSPORT_AUTO = 2
-};
-
 // Mode enum
 enum TCPModbusMode {
     MODE_SLAVE = 0,
@@ -38,21 +31,10 @@ enum TCPModbusMode {
 };
 
 // ==================== MODBUS REGISTER DEFINITIONS ====================
-// Define the number of registers for each type
-#define MB_REG_HOLDING_START        0
-#define MB_REG_HOLDING_COUNT        100  // Number of holding registers
-#define MB_REG_INPUT_START          0
-#define MB_REG_INPUT_COUNT          100  // Number of input registers
-#define MB_REG_COIL_START           0
-#define MB_REG_COIL_COUNT           64   // Number of coils
-#define MB_REG_DISCRETE_START       0
-#define MB_REG_DISCRETE_COUNT       64   // Number of discrete inputs
-
-// Modbus register storage - use DRAM_ATTR for proper memory placement
-static DRAM_ATTR uint16_t mb_holding_registers[MB_REG_HOLDING_COUNT] = {0};
-static DRAM_ATTR uint16_t mb_input_registers[MB_REG_INPUT_COUNT] = {0};
-static DRAM_ATTR uint8_t mb_coil_registers[(MB_REG_COIL_COUNT + 7) / 8] = {0};
-static DRAM_ATTR uint8_t mb_discrete_registers[(MB_REG_DISCRETE_COUNT + 7) / 8] = {0};
+// Register storage lives in the runtime register map; each declared block is
+// handed to esp-modbus as its own area descriptor (see modbus_register_map.h).
+// Application access (tcpModbusSet*/Get*) is in modbus_register_store.h.
+#include "modbus_register_store.h"
 
 // Modbus controller state
 static bool mb_initialized = false;
@@ -398,113 +380,13 @@ String getTCPModbusTransportString() {
     }
 }
 
-// ==================== REGISTER ACCESS FUNCTIONS ====================
+// ==================== REGISTER EVENTS ====================
 
 // Set a callback for register access events
 void tcpModbusSetEventCallback(ModbusEventCallback callback) {
     mb_event_callback = callback;
 }
 
-// Holding Register functions
-bool tcpModbusSetHoldingRegister(uint16_t address, uint16_t value) {
-    if (address >= MB_REG_HOLDING_COUNT) return false;
-    mb_holding_registers[address] = value;
-    return true;
-}
-
-uint16_t tcpModbusGetHoldingRegister(uint16_t address) {
-    if (address >= MB_REG_HOLDING_COUNT) return 0;
-    return mb_holding_registers[address];
-}
-
-bool tcpModbusSetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (startAddress + count > MB_REG_HOLDING_COUNT) return false;
-    memcpy(&mb_holding_registers[startAddress], values, count * sizeof(uint16_t));
-    return true;
-}
-
-bool tcpModbusGetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (startAddress + count > MB_REG_HOLDING_COUNT) return false;
-    memcpy(values, &mb_holding_registers[startAddress], count * sizeof(uint16_t));
-    return true;
-}
-
-// Input Register functions
-bool tcpModbusSetInputRegister(uint16_t address, uint16_t value) {
-    if (address >= MB_REG_INPUT_COUNT) return false;
-    mb_input_registers[address] = value;
-    return true;
-}
-
-uint16_t tcpModbusGetInputRegister(uint16_t address) {
-    if (address >= MB_REG_INPUT_COUNT) return 0;
-    return mb_input_registers[address];
-}
-
-bool tcpModbusSetInputRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (startAddress + count > MB_REG_INPUT_COUNT) return false;
-    memcpy(&mb_input_registers[startAddress], values, count * sizeof(uint16_t));
-    return true;
-}
-
-// Coil functions
-bool tcpModbusSetCoil(uint16_t address, bool value) {
-    if (address >= MB_REG_COIL_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    if (value) {
-        mb_coil_registers[byteIndex] |= (1 << bitIndex);
-    } else {
-        mb_coil_registers[byteIndex] &= ~(1 << bitIndex);
-    }
-    return true;
-}
-
-bool tcpModbusGetCoil(uint16_t address) {
-    if (address >= MB_REG_COIL_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    return (mb_coil_registers[byteIndex] >> bitIndex) & 0x01;
-}
-
-// Discrete Input functions
-bool tcpModbusSetDiscreteInput(uint16_t address, bool value) {
-    if (address >= MB_REG_DISCRETE_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    if (value) {
-        mb_discrete_registers[byteIndex] |= (1 << bitIndex);
-    } else {
-        mb_discrete_registers[byteIndex] &= ~(1 << bitIndex);
-    }
-    return true;
-}
-
-bool tcpModbusGetDiscreteInput(uint16_t address) {
-    if (address >= MB_REG_DISCRETE_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    return (mb_discrete_registers[byteIndex] >> bitIndex) & 0x01;
-}
-
-// Float helper functions for holding registers (2 registers per float)
-bool tcpModbusSetHoldingFloat(uint16_t address, float value) {
-    if (address + 1 >= MB_REG_HOLDING_COUNT) return false;
-    uint16_t* ptr = (uint16_t*)&value;
-    mb_holding_registers[address] = ptr[1];     // High word
-    mb_holding_registers[address + 1] = ptr[0]; // Low word
-    return true;
-}
-
-float tcpModbusGetHoldingFloat(uint16_t address) {
-    if (address + 1 >= MB_REG_HOLDING_COUNT) return 0.0f;
-    float value;
-    uint16_t* ptr = (uint16_t*)&value;
-    ptr[1] = mb_holding_registers[address];     // High word
-    ptr[0] = mb_holding_registers[address + 1]; // Low word
-    return value;
-}
-
 // ==================== MODBUS SLAVE INITIALIZATION ====================
 
 // Helper function to get active network interface
@@ -675,55 +557,27 @@ esp_err_t tcpModbusSlaveInit(uint8_t slaveId, uint16_t port) {
         return err;
     }
 
-    // Setup register area descriptors
-    mb_register_area_descriptor_t reg_area;
-
-    // Holding Registers
-    reg_area.type = MB_PARAM_HOLDING;
-    reg_area.start_offset = MB_REG_HOLDING_START;
-    reg_area.address = (void*)mb_holding_registers;
-    reg_area.size = MB_REG_HOLDING_COUNT * sizeof(uint16_t);
-    err = mbc_slave_set_descriptor(reg_area);
-    if (err != ESP_OK) {
-        Serial.printf("[TCPModbus] ✗ Failed to set holding register descriptor: 0x%x\n", err);
-        mbc_slave_destroy();
-        return err;
-    }
-
-    // Input Registers
-    reg_area.type = MB_PARAM_INPUT;
-    reg_area.start_offset = MB_REG_INPUT_START;
-    reg_area.address = (void*)mb_input_registers;
-    reg_area.size = MB_REG_INPUT_COUNT * sizeof(uint16_t);
-    err = mbc_slave_set_descriptor(reg_area);
-    if (err != ESP_OK) {
-        Serial.printf("[TCPModbus] ✗ Failed to set input register descriptor: 0x%x\n", err);
-        mbc_slave_destroy();
-        return err;
-    }
-
-    // Coils
-    reg_area.type = MB_PARAM_COIL;
-    reg_area.start_offset = MB_REG_COIL_START;
-    reg_area.address = (void*)mb_coil_registers;
-    reg_area.size = sizeof(mb_coil_registers);
-    err = mbc_slave_set_descriptor(reg_area);
-    if (err != ESP_OK) {
-        Serial.printf("[TCPModbus] ✗ Failed to set coil descriptor: 0x%x\n", err);
-        mbc_slave_destroy();
-        return err;
-    }
-
-    // Discrete Inputs
-    reg_area.type = MB_PARAM_DISCRETE;
-    reg_area.start_offset = MB_REG_DISCRETE_START;
-    reg_area.address = (void*)mb_discrete_registers;
-    reg_area.size = sizeof(mb_discrete_registers);
-    err = mbc_slave_set_descriptor(reg_area);
-    if (err != ESP_OK) {
-        Serial.printf("[TCPModbus] ✗ Failed to set discrete input descriptor: 0x%x\n", err);
-        mbc_slave_destroy();
-        return err;
+    // Setup register area descriptors - one per declared map block
+    static const mb_param_type_t mb_area_types[MB_TYPE_COUNT] = {
+        MB_PARAM_HOLDING, MB_PARAM_INPUT, MB_PARAM_COIL, MB_PARAM_DISCRETE
+    };
+    modbusMapEnsure();
+    for (uint8_t t = 0; t < MB_TYPE_COUNT; t++) {
+        for (uint8_t i = 0; i < mb_map[t].count; i++) {
+            const ModbusRegBlock& block = mb_map[t].blocks[i];
+            mb_register_area_descriptor_t reg_area;
+            reg_area.type = mb_area_types[t];
+            reg_area.start_offset = block.start;
+            reg_area.address = block.data;
+            reg_area.size = modbusMapBlockBytes((ModbusRegType)t, block.count);
+            err = mbc_slave_set_descriptor(reg_area);
+            if (err != ESP_OK) {
+                Serial.printf("[TCPModbus] ✗ Failed to set %s descriptor at %u: 0x%x\n",
+                              modbusMapTypeName((ModbusRegType)t), block.start, err);
+                mbc_slave_destroy();
+                return err;
+            }
+        }
     }
 
     // Start Modbus controller
@@ -838,39 +692,32 @@ bool tcpModbusInit() {
 
 // ==================== MODBUS LOOP AND EVENT HANDLING ====================
 
-// Slave loop - check for register access events
-// Only checks every 100ms to prevent blocking, and only if callback is set
-static unsigned long mb_last_event_check = 0;
+// Slave loop - drain every queued register access event. esp-modbus
+// queues one param-info record per access; taking them all with a zero
+// timeout keeps bursts of writes from piling up between loop passes.
+// Writes also mark the map's dirty bitmap and fire the range callback
+// (modbusMapSetWriteCallback).
+#define TCP_MODBUS_MAX_EVENTS_PER_LOOP  32
 
 void tcpModbusSlaveLoop() {
     if (!mb_initialized || !mb_running) {
         return;
     }
-    
-    // Skip event checking if no callback registered
-    if (mb_event_callback == NULL) {
-        return;
-    }
-    
-    // Rate limit event checking to every 100ms
-    unsigned long now = millis();
-    if (now - mb_last_event_check < 100) {
-        return;
-    }
-    mb_last_event_check = now;
 
-    // Check for events (non-blocking with 0 timeout)
-    mb_event_group_t event = mbc_slave_check_event(
-        (mb_event_group_t)(MB_EVENT_HOLDING_REG_WR | MB_EVENT_HOLDING_REG_RD | 
-                          MB_EVENT_INPUT_REG_RD | MB_EVENT_COILS_WR | 
-                          MB_EVENT_COILS_RD | MB_EVENT_DISCRETE_RD));
+    mb_param_info_t reg_info;
+    for (uint8_t n = 0; n < TCP_MODBUS_MAX_EVENTS_PER_LOOP; n++) {
+        if (mbc_slave_get_param_info(&reg_info, 0) != ESP_OK) {
+            break;
+        }
+
+        mb_event_group_t event = (mb_event_group_t)reg_info.type;
+        if (event & MB_EVENT_HOLDING_REG_WR) {
+            modbusMapNotifyWrite(MB_TYPE_HOLDING, reg_info.mb_offset, reg_info.size);
+        } else if (event & MB_EVENT_COILS_WR) {
+            modbusMapNotifyWrite(MB_TYPE_COIL, reg_info.mb_offset, reg_info.size);
+        }
 
-    if (event != MB_EVENT_NO_EVENTS) {
-        mb_param_info_t reg_info = {0};
-        // Use 0 timeout for non-blocking operation
-        esp_err_t err = mbc_slave_get_param_info(&reg_info, 0);
-        if (err == ESP_OK) {
-            // Pass the actual event that was triggered
+        if (mb_event_callback != NULL) {
             mb_event_callback(event, reg_info.mb_offset, reg_info.size);
         }
     }
@@ -0,0 +1,644 @@
+#ifndef TCP_MODBUS_MASTER_H
+#define TCP_MODBUS_MASTER_H
+
+// Native Modbus TCP master on EthernetClient (W5500).
+//
+// Requests are queued with a callback and sent by tcpMasterLoop(). Each
+// slave (IP:port) gets a persistent connection that carries up to
+// TCP_MASTER_MAX_INFLIGHT requests at once; responses are matched back to
+// their request by MBAP transaction ID, so polling many devices is bounded
+// by network latency rather than by one request at a time.
+//
+// Sockets: the W5500 has 8, shared with the Modbus server (listener plus
+// tcpModbusSetMaxClients(), 4 by default), MQTT and any web/OTA client.
+// The master uses tcpMasterSetMaxConnections() of them, 2 by default, up to
+// TCP_MASTER_MAX_CONNECTIONS. Slaves behind one TCP-to-RTU gateway share
+// its connection (one ip:port, many unit IDs). To keep a connection open
+// per device for N directly addressed slaves, lower the server's client
+// count and raise this to N; past the pool size, a request for another
+// slave closes the least recently used idle connection.
+//
+// Connects are made in short bounded attempts from tcpMasterLoop()
+// (w5500_connect.h), so the network lock is never held for a full connect
+// timeout. A slave that refuses or does not
+// answer is skipped for TCP_MASTER_RETRY_MS; that back-off is kept per
+// slave, not per connection, so rotating connections does not reset it.
+//
+//   tcpMasterReadHolding(IPAddress(192,168,1,50), 1, 0, 10,
+//       [](const TCPMasterResult& r) {
+//           if (r.status == TCP_MASTER_OK) Serial.println(r.regs[0]);
+//       });
+//   ...
+//   loop() { tcpMasterLoop(); }
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include "tcp_modbus_simple.h"
+#include "w5500_connect.h"
+
+#ifndef TCP_MASTER_MAX_CONNECTIONS
+#define TCP_MASTER_MAX_CONNECTIONS  6       // Connection table; the most the master may be given
+#endif
+#define TCP_MASTER_DEFAULT_CONNECTIONS 2    // Fits beside the server's default 4 clients and MQTT
+#ifndef TCP_MASTER_MAX_SLAVES
+#define TCP_MASTER_MAX_SLAVES       32      // Slaves whose connect back-off is remembered
+#endif
+#ifndef TCP_MASTER_MAX_INFLIGHT
+#define TCP_MASTER_MAX_INFLIGHT     4       // Outstanding requests per connection
+#endif
+#ifndef TCP_MASTER_QUEUE_SIZE
+#define TCP_MASTER_QUEUE_SIZE       16      // Queued + in-flight requests
+#endif
+#define TCP_MASTER_TIMEOUT_MS       1000    // Default response timeout
+#define TCP_MASTER_CONNECT_TIMEOUT  3000    // Connect attempts without an answer: give up
+#define TCP_MASTER_RETRY_MS         5000    // Back-off after a failed connect
+#define TCP_MASTER_MAX_TIMEOUTS     3       // Consecutive timeouts before reconnecting
+
+// Result status: 0 on success, a Modbus exception code (0x01-0x0B), or one
+// of the local errors below
+#define TCP_MASTER_OK               0x00
+#define TCP_MASTER_ERR_TIMEOUT      0xE0
+#define TCP_MASTER_ERR_CONNECT      0xE1
+#define TCP_MASTER_ERR_RESPONSE     0xE2    // Malformed or mismatched response
+#define TCP_MASTER_ERR_CLOSED       0xE3    // Connection dropped while in flight
+
+struct TCPMasterResult {
+    IPAddress ip;
+    uint8_t unitId;
+    uint8_t functionCode;
+    uint16_t address;
+    uint16_t count;
+    uint8_t status;
+    const uint16_t* regs;   // FC03/04: count registers
+    const uint8_t* bits;    // FC01/02: count bits, packed LSB first
+    uint32_t rttMs;
+};
+
+typedef std::function<void(const TCPMasterResult&)> TCPMasterCallback;
+
+enum TCPMasterRequestState {
+    TCP_MASTER_FREE = 0,
+    TCP_MASTER_QUEUED,
+    TCP_MASTER_INFLIGHT
+};
+
+struct TCPMasterRequest {
+    TCPMasterRequestState state;
+    IPAddress ip;
+    uint16_t port;
+    uint8_t unitId;
+    uint16_t address;
+    uint16_t count;
+    uint8_t pdu[MB_MAX_PDU];
+    uint8_t pduLen;
+    uint16_t txId;
+    int8_t conn;            // Connection index while in flight
+    uint32_t order;         // Queue order, oldest first
+    unsigned long sentAt;
+    TCPMasterCallback callback;
+};
+
+struct TCPMasterConnection {
+    EthernetClient client;
+    IPAddress ip;
+    uint16_t port;
+    bool open;
+    bool connecting;
+    W5500Connect connect;
+    unsigned long connectStarted;
+    uint8_t inflight;
+    uint8_t timeouts;
+    uint8_t rxBuf[MB_TCP_MAX_ADU];
+    uint16_t rxLen;
+    unsigned long lastUsed;
+};
+
+// Slave that failed to connect, skipped until retryAt
+struct TCPMasterBackoff {
+    IPAddress ip;
+    uint16_t port;
+    bool used;
+    unsigned long retryAt;
+};
+
+static TCPMasterRequest mb_master_requests[TCP_MASTER_QUEUE_SIZE];
+static TCPMasterConnection mb_master_conns[TCP_MASTER_MAX_CONNECTIONS];
+static TCPMasterBackoff mb_master_backoff[TCP_MASTER_MAX_SLAVES];
+static uint8_t mb_master_max_conns = TCP_MASTER_DEFAULT_CONNECTIONS;
+static uint16_t mb_master_next_txid = 1;
+static uint32_t mb_master_next_order = 0;
+static uint32_t mb_master_timeout_ms = TCP_MASTER_TIMEOUT_MS;
+
+// ==================== HELPERS ====================
+
+void tcpMasterSetTimeout(uint32_t ms) {
+    mb_master_timeout_ms = ms;
+}
+
+uint8_t tcpMasterOpenCount() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < TCP_MASTER_MAX_CONNECTIONS; i++) {
+        if (mb_master_conns[i].open || mb_master_conns[i].connecting) n++;
+    }
+    return n;
+}
+
+uint8_t tcpMasterPendingCount() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        if (mb_master_requests[i].state != TCP_MASTER_FREE) n++;
+    }
+    return n;
+}
+
+static void tcpMasterComplete(TCPMasterRequest& req, uint8_t status, const uint16_t* regs, const uint8_t* bits) {
+    // Free the slot before the callback so it can queue a follow-up
+    TCPMasterCallback callback = std::move(req.callback);
+    TCPMasterResult result;
+    result.ip = req.ip;
+    result.unitId = req.unitId;
+    result.functionCode = req.pdu[0];
+    result.address = req.address;
+    result.count = req.count;
+    result.status = status;
+    result.regs = regs;
+    result.bits = bits;
+    result.rttMs = (req.state == TCP_MASTER_INFLIGHT) ? millis() - req.sentAt : 0;
+
+    if (req.state == TCP_MASTER_INFLIGHT && req.conn >= 0) {
+        TCPMasterConnection& conn = mb_master_conns[req.conn];
+        if (conn.inflight > 0) conn.inflight--;
+    }
+    req.state = TCP_MASTER_FREE;
+    req.callback = nullptr;
+
+    if (debugTCPModbus && status != TCP_MASTER_OK) {
+        Serial.printf("[TCPMaster] %s unit %d FC%02X @%d -> 0x%02X\n",
+                      result.ip.toString().c_str(), result.unitId, result.functionCode, result.address, status);
+    }
+    if (callback) callback(result);
+}
+
+static bool tcpMasterQueue(IPAddress ip, uint16_t port, uint8_t unitId, const uint8_t* pdu, uint8_t pduLen,
+                           uint16_t address, uint16_t count, TCPMasterCallback callback) {
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        TCPMasterRequest& req = mb_master_requests[i];
+        if (req.state != TCP_MASTER_FREE) continue;
+        req.ip = ip;
+        req.port = port;
+        req.unitId = unitId;
+        req.address = address;
+        req.count = count;
+        memcpy(req.pdu, pdu, pduLen);
+        req.pduLen = pduLen;
+        req.conn = -1;
+        req.order = mb_master_next_order++;
+        req.callback = callback;
+        req.state = TCP_MASTER_QUEUED;
+        return true;
+    }
+    Serial.println("[TCPMaster] ✗ Request queue full");
+    return false;
+}
+
+// ==================== REQUEST API ====================
+// All return false if the queue is full or the arguments are out of range;
+// otherwise the callback runs exactly once from tcpMasterLoop().
+
+static bool tcpMasterQueueRead(IPAddress ip, uint8_t unitId, uint8_t fc, uint16_t address, uint16_t count,
+                               uint16_t maxCount, TCPMasterCallback callback, uint16_t port) {
+    if (count < 1 || count > maxCount) return false;
+    uint8_t pdu[5] = { fc, (uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(count >> 8), (uint8_t)count };
+    return tcpMasterQueue(ip, port, unitId, pdu, sizeof(pdu), address, count, callback);
+}
+
+bool tcpMasterReadCoils(IPAddress ip, uint8_t unitId, uint16_t address, uint16_t count, TCPMasterCallback callback, uint16_t port = 502) {
+    return tcpMasterQueueRead(ip, unitId, 0x01, address, count, 2000, callback, port);
+}
+
+bool tcpMasterReadDiscreteInputs(IPAddress ip, uint8_t unitId, uint16_t address, uint16_t count, TCPMasterCallback callback, uint16_t port = 502) {
+    return tcpMasterQueueRead(ip, unitId, 0x02, address, count, 2000, callback, port);
+}
+
+bool tcpMasterReadHolding(IPAddress ip, uint8_t unitId, uint16_t address, uint16_t count, TCPMasterCallback callback, uint16_t port = 502) {
+    return tcpMasterQueueRead(ip, unitId, 0x03, address, count, 125, callback, port);
+}
+
+bool tcpMasterReadInput(IPAddress ip, uint8_t unitId, uint16_t address, uint16_t count, TCPMasterCallback callback, uint16_t port = 502) {
+    return tcpMasterQueueRead(ip, unitId, 0x04, address, count, 125, callback, port);
+}
+
+bool tcpMasterWriteCoil(IPAddress ip, uint8_t unitId, uint16_t address, bool value, TCPMasterCallback callback, uint16_t port = 502) {
+    uint8_t pdu[5] = { 0x05, (uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(value ? 0xFF : 0x00), 0x00 };
+    return tcpMasterQueue(ip, port, unitId, pdu, sizeof(pdu), address, 1, callback);
+}
+
+bool tcpMasterWriteRegister(IPAddress ip, uint8_t unitId, uint16_t address, uint16_t value, TCPMasterCallback callback, uint16_t port = 502) {
+    uint8_t pdu[5] = { 0x06, (uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(value >> 8), (uint8_t)value };
+    return tcpMasterQueue(ip, port, unitId, pdu, sizeof(pdu), address, 1, callback);
+}
+
+bool tcpMasterWriteRegisters(IPAddress ip, uint8_t unitId, uint16_t address, const uint16_t* values, uint16_t count,
+                             TCPMasterCallback callback, uint16_t port = 502) {
+    if (count < 1 || count > 123) return false;
+    uint8_t pdu[MB_MAX_PDU];
+    pdu[0] = 0x10;
+    pdu[1] = address >> 8;
+    pdu[2] = address & 0xFF;
+    pdu[3] = count >> 8;
+    pdu[4] = count & 0xFF;
+    pdu[5] = count * 2;
+    for (uint16_t i = 0; i < count; i++) {
+        pdu[6 + i * 2] = values[i] >> 8;
+        pdu[7 + i * 2] = values[i] & 0xFF;
+    }
+    return tcpMasterQueue(ip, port, unitId, pdu, 6 + count * 2, address, count, callback);
+}
+
+// ==================== CONNECTIONS ====================
+
+static TCPMasterBackoff* tcpMasterFindBackoff(IPAddress ip, uint16_t port) {
+    for (uint8_t i = 0; i < TCP_MASTER_MAX_SLAVES; i++) {
+        TCPMasterBackoff& b = mb_master_backoff[i];
+        if (b.used && b.ip == ip && b.port == port) return &b;
+    }
+    return nullptr;
+}
+
+static bool tcpMasterBackingOff(IPAddress ip, uint16_t port) {
+    TCPMasterBackoff* b = tcpMasterFindBackoff(ip, port);
+    if (!b) return false;
+    if ((long)(millis() - b->retryAt) < 0) return true;
+    b->used = false;
+    return false;
+}
+
+// Remember the failure; a full table gives up the entry closest to expiry
+static void tcpMasterStartBackoff(IPAddress ip, uint16_t port) {
+    TCPMasterBackoff* b = tcpMasterFindBackoff(ip, port);
+    for (uint8_t i = 0; !b && i < TCP_MASTER_MAX_SLAVES; i++) {
+        if (!mb_master_backoff[i].used) b = &mb_master_backoff[i];
+    }
+    if (!b) {
+        b = &mb_master_backoff[0];
+        for (uint8_t i = 1; i < TCP_MASTER_MAX_SLAVES; i++) {
+            if ((long)(mb_master_backoff[i].retryAt - b->retryAt) < 0) b = &mb_master_backoff[i];
+        }
+    }
+    b->ip = ip;
+    b->port = port;
+    b->used = true;
+    b->retryAt = millis() + TCP_MASTER_RETRY_MS;
+}
+
+// Fail every queued request for a slave that cannot be reached
+static void tcpMasterFailQueued(IPAddress ip, uint16_t port) {
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        TCPMasterRequest& req = mb_master_requests[i];
+        if (req.state == TCP_MASTER_QUEUED && req.ip == ip && req.port == port) {
+            tcpMasterComplete(req, TCP_MASTER_ERR_CONNECT, nullptr, nullptr);
+        }
+    }
+}
+
+static void tcpMasterCloseConnection(uint8_t index, uint8_t status) {
+    TCPMasterConnection& conn = mb_master_conns[index];
+    if (conn.open || conn.connecting) {
+        tcpModbusLockNetwork();
+        if (conn.connecting) conn.connect.abort();
+        else conn.client.stop();
+        tcpModbusUnlockNetwork();
+    }
+    conn.open = false;
+    conn.connecting = false;
+    conn.rxLen = 0;
+    conn.timeouts = 0;
+
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        TCPMasterRequest& req = mb_master_requests[i];
+        if (req.state == TCP_MASTER_INFLIGHT && req.conn == index) {
+            tcpMasterComplete(req, status, nullptr, nullptr);
+        }
+    }
+    conn.inflight = 0;
+}
+
+// Check a connect in progress. On failure the slave backs off and its
+// queued requests fail.
+static void tcpMasterPollConnect(uint8_t index) {
+    TCPMasterConnection& conn = mb_master_conns[index];
+    tcpModbusLockNetwork();
+    int8_t result = conn.connect.poll(conn.client);
+    if (result == 0 && millis() - conn.connectStarted >= TCP_MASTER_CONNECT_TIMEOUT) {
+        conn.connect.abort();
+        result = -1;
+    }
+    tcpModbusUnlockNetwork();
+    if (result == 0) return;
+
+    conn.connecting = false;
+    conn.lastUsed = millis();
+    if (result < 0) {
+        Serial.printf("[TCPMaster] ✗ Connect to %s:%d failed\n", conn.ip.toString().c_str(), conn.port);
+        tcpMasterStartBackoff(conn.ip, conn.port);
+        tcpMasterFailQueued(conn.ip, conn.port);
+        return;
+    }
+    conn.open = true;
+    if (debugTCPModbus) {
+        Serial.printf("[TCPMaster] ✓ Connected to %s:%d\n", conn.ip.toString().c_str(), conn.port);
+    }
+}
+
+#define TCP_MASTER_CONN_BUSY        -1      // Nothing can be opened right now
+#define TCP_MASTER_CONN_FAILED      -2      // Slave unreachable or backing off
+#define TCP_MASTER_CONN_PENDING     -3      // Connect started, polled from tcpMasterLoop()
+
+// Open connection for ip:port, or one of the codes above. Starting a
+// connect may evict the least recently used idle connection.
+static int8_t tcpMasterGetConnection(IPAddress ip, uint16_t port) {
+    int8_t freeSlot = -1;
+    int8_t lru = -1;
+    for (uint8_t i = 0; i < mb_master_max_conns; i++) {
+        TCPMasterConnection& conn = mb_master_conns[i];
+        if (conn.ip == ip && conn.port == port && (conn.open || conn.connecting)) {
+            return conn.open ? i : TCP_MASTER_CONN_PENDING;
+        }
+        if (conn.connecting) continue;
+        if (!conn.open) {
+            if (freeSlot < 0) freeSlot = i;
+        } else if (conn.inflight == 0 && (lru < 0 || conn.lastUsed < mb_master_conns[lru].lastUsed)) {
+            lru = i;
+        }
+    }
+    if (tcpMasterBackingOff(ip, port)) return TCP_MASTER_CONN_FAILED;
+
+    if (freeSlot < 0) {
+        if (lru < 0) return TCP_MASTER_CONN_BUSY;   // Every connection is busy
+        if (debugTCPModbus) {
+            Serial.printf("[TCPMaster] Evicting %s\n", mb_master_conns[lru].ip.toString().c_str());
+        }
+        tcpMasterCloseConnection(lru, TCP_MASTER_ERR_CLOSED);
+        freeSlot = lru;
+    }
+
+    TCPMasterConnection& conn = mb_master_conns[freeSlot];
+    conn.ip = ip;
+    conn.port = port;
+    conn.rxLen = 0;
+    conn.inflight = 0;
+    conn.timeouts = 0;
+    conn.lastUsed = millis();
+
+    conn.connect.begin(ip, port);
+    conn.connecting = true;
+    conn.connectStarted = conn.lastUsed;
+    return TCP_MASTER_CONN_PENDING;
+}
+
+// Sockets the master may use (see the top of this file); connections past
+// a lowered limit are closed
+void tcpMasterSetMaxConnections(uint8_t count) {
+    if (count < 1) count = 1;
+    if (count > TCP_MASTER_MAX_CONNECTIONS) count = TCP_MASTER_MAX_CONNECTIONS;
+    for (uint8_t i = count; i < TCP_MASTER_MAX_CONNECTIONS; i++) {
+        tcpMasterCloseConnection(i, TCP_MASTER_ERR_CLOSED);
+    }
+    mb_master_max_conns = count;
+}
+
+// ==================== RESPONSE HANDLING ====================
+
+static void tcpMasterHandleResponse(uint8_t connIndex, const uint8_t* adu, uint16_t len) {
+    uint16_t txId = (adu[0] << 8) | adu[1];
+    TCPMasterRequest* req = nullptr;
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        TCPMasterRequest& r = mb_master_requests[i];
+        if (r.state == TCP_MASTER_INFLIGHT && r.conn == connIndex && r.txId == txId) {
+            req = &r;
+            break;
+        }
+    }
+    if (!req) return;   // Late reply to a request that already timed out
+
+    mb_master_conns[connIndex].timeouts = 0;
+    const uint8_t* pdu = &adu[MB_MBAP_HEADER_LEN];
+    uint16_t pduLen = len - MB_MBAP_HEADER_LEN;
+    uint8_t fc = req->pdu[0];
+
+    if (adu[6] != req->unitId) {
+        tcpMasterComplete(*req, TCP_MASTER_ERR_RESPONSE, nullptr, nullptr);
+        return;
+    }
+    if (pdu[0] == (fc | 0x80)) {
+        tcpMasterComplete(*req, pduLen >= 2 ? pdu[1] : TCP_MASTER_ERR_RESPONSE, nullptr, nullptr);
+        return;
+    }
+    if (pdu[0] != fc) {
+        tcpMasterComplete(*req, TCP_MASTER_ERR_RESPONSE, nullptr, nullptr);
+        return;
+    }
+
+    switch (fc) {
+        case 0x01:
+        case 0x02: {
+            uint8_t byteCount = (req->count + 7) / 8;
+            if (pduLen != 2 + byteCount || pdu[1] != byteCount) break;
+            tcpMasterComplete(*req, TCP_MASTER_OK, nullptr, &pdu[2]);
+            return;
+        }
+        case 0x03:
+        case 0x04: {
+            if (pduLen != 2 + req->count * 2 || pdu[1] != req->count * 2) break;
+            uint16_t regs[125];
+            for (uint16_t i = 0; i < req->count; i++) {
+                regs[i] = (pdu[2 + i * 2] << 8) | pdu[3 + i * 2];
+            }
+            tcpMasterComplete(*req, TCP_MASTER_OK, regs, nullptr);
+            return;
+        }
+        default:
+            // Writes echo address and value/quantity
+            if (pduLen != 5 || memcmp(pdu, req->pdu, 5) != 0) break;
+            tcpMasterComplete(*req, TCP_MASTER_OK, nullptr, nullptr);
+            return;
+    }
+    tcpMasterComplete(*req, TCP_MASTER_ERR_RESPONSE, nullptr, nullptr);
+}
+
+// Pull available bytes into rxBuf (under the network lock), then hand each
+// complete ADU to tcpMasterHandleResponse with the lock released so
+// callbacks may touch the network.
+static void tcpMasterServiceConnection(uint8_t index) {
+    TCPMasterConnection& conn = mb_master_conns[index];
+    if (conn.connecting) tcpMasterPollConnect(index);
+    if (!conn.open) return;
+
+    tcpModbusLockNetwork();
+    bool connected = conn.client.connected();
+    int available = connected ? conn.client.available() : 0;
+    if (available > 0 && conn.rxLen < MB_TCP_MAX_ADU) {
+        int n = conn.client.read(conn.rxBuf + conn.rxLen, MB_TCP_MAX_ADU - conn.rxLen);
+        if (n > 0) conn.rxLen += n;
+    }
+    tcpModbusUnlockNetwork();
+
+    for (;;) {
+        if (conn.rxLen < MB_MBAP_HEADER_LEN) break;
+        uint16_t protocolId = (conn.rxBuf[2] << 8) | conn.rxBuf[3];
+        uint16_t length = (conn.rxBuf[4] << 8) | conn.rxBuf[5];
+        if (protocolId != 0 || length < MB_MBAP_MIN_LENGTH || length > MB_MBAP_MAX_LENGTH) {
+            Serial.printf("[TCPMaster] ✗ Bad MBAP from %s, reconnecting\n", conn.ip.toString().c_str());
+            tcpMasterCloseConnection(index, TCP_MASTER_ERR_RESPONSE);
+            return;
+        }
+        uint16_t aduLen = 6 + length;
+        if (conn.rxLen < aduLen) break;
+
+        uint8_t adu[MB_TCP_MAX_ADU];
+        memcpy(adu, conn.rxBuf, aduLen);
+        conn.rxLen -= aduLen;
+        memmove(conn.rxBuf, conn.rxBuf + aduLen, conn.rxLen);
+        conn.lastUsed = millis();
+        tcpMasterHandleResponse(index, adu, aduLen);
+        if (!conn.open) return;
+    }
+
+    if (!connected) {
+        tcpMasterCloseConnection(index, TCP_MASTER_ERR_CLOSED);
+    }
+}
+
+// ==================== MAIN LOOP ====================
+
+static void tcpMasterExpireRequests() {
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        TCPMasterRequest& req = mb_master_requests[i];
+        if (req.state != TCP_MASTER_INFLIGHT || now - req.sentAt < mb_master_timeout_ms) continue;
+
+        int8_t connIndex = req.conn;
+        tcpMasterComplete(req, TCP_MASTER_ERR_TIMEOUT, nullptr, nullptr);
+        if (connIndex >= 0 && ++mb_master_conns[connIndex].timeouts >= TCP_MASTER_MAX_TIMEOUTS) {
+            Serial.printf("[TCPMaster] ✗ %s not answering, reconnecting\n", mb_master_conns[connIndex].ip.toString().c_str());
+            tcpMasterCloseConnection(connIndex, TCP_MASTER_ERR_CLOSED);
+        }
+    }
+}
+
+// True if req can go out now: its connection has a free in-flight slot, or
+// it has no connection and one can be opened or evicted. Requests wait
+// while their slave's connect is in progress.
+static bool tcpMasterCanSend(const TCPMasterRequest& req, bool canOpen) {
+    for (uint8_t c = 0; c < mb_master_max_conns; c++) {
+        const TCPMasterConnection& conn = mb_master_conns[c];
+        if (conn.ip != req.ip || conn.port != req.port) continue;
+        if (conn.open) return conn.inflight < TCP_MASTER_MAX_INFLIGHT;
+        if (conn.connecting) return false;
+    }
+    return canOpen;
+}
+
+// Send queued requests oldest first, skipping slaves that cannot take
+// another one yet
+static void tcpMasterSendQueued() {
+    for (;;) {
+        bool canOpen = false;
+        for (uint8_t c = 0; c < mb_master_max_conns; c++) {
+            const TCPMasterConnection& conn = mb_master_conns[c];
+            if (!conn.connecting && (!conn.open || conn.inflight == 0)) canOpen = true;
+        }
+
+        TCPMasterRequest* next = nullptr;
+        for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+            TCPMasterRequest& req = mb_master_requests[i];
+            if (req.state != TCP_MASTER_QUEUED) continue;
+            if (next && (int32_t)(req.order - next->order) >= 0) continue;
+            if (tcpMasterCanSend(req, canOpen)) next = &req;
+        }
+        if (!next) return;
+
+        int8_t connIndex = tcpMasterGetConnection(next->ip, next->port);
+        if (connIndex == TCP_MASTER_CONN_BUSY) return;
+        if (connIndex == TCP_MASTER_CONN_PENDING) continue;    // Its requests wait; look at others
+        if (connIndex == TCP_MASTER_CONN_FAILED) {
+            IPAddress ip = next->ip;
+            tcpMasterFailQueued(ip, next->port);
+            continue;
+        }
+
+        TCPMasterConnection& conn = mb_master_conns[connIndex];
+        uint8_t adu[MB_TCP_MAX_ADU];
+        uint16_t txId = mb_master_next_txid++;
+        if (mb_master_next_txid == 0) mb_master_next_txid = 1;
+        adu[0] = txId >> 8;
+        adu[1] = txId & 0xFF;
+        adu[2] = 0;
+        adu[3] = 0;
+        adu[4] = (next->pduLen + 1) >> 8;
+        adu[5] = (next->pduLen + 1) & 0xFF;
+        adu[6] = next->unitId;
+        memcpy(&adu[MB_MBAP_HEADER_LEN], next->pdu, next->pduLen);
+
+        tcpModbusLockNetwork();
+        size_t written = conn.client.write(adu, MB_MBAP_HEADER_LEN + next->pduLen);
+        tcpModbusUnlockNetwork();
+
+        next->txId = txId;
+        next->conn = connIndex;
+        next->sentAt = millis();
+        next->state = TCP_MASTER_INFLIGHT;
+        conn.inflight++;
+        conn.lastUsed = next->sentAt;
+
+        if (written != (size_t)(MB_MBAP_HEADER_LEN + next->pduLen)) {
+            tcpMasterCloseConnection(connIndex, TCP_MASTER_ERR_CLOSED);
+        }
+    }
+}
+
+// Never blocks on the network; connects are polled here
+void tcpMasterLoop() {
+    for (uint8_t i = 0; i < TCP_MASTER_MAX_CONNECTIONS; i++) {
+        tcpMasterServiceConnection(i);
+    }
+    tcpMasterExpireRequests();
+    tcpMasterSendQueued();
+}
+
+// Close every connection and fail anything pending
+void tcpMasterStop() {
+    for (uint8_t i = 0; i < TCP_MASTER_MAX_CONNECTIONS; i++) {
+        tcpMasterCloseConnection(i, TCP_MASTER_ERR_CLOSED);
+    }
+    for (uint8_t i = 0; i < TCP_MASTER_QUEUE_SIZE; i++) {
+        if (mb_master_requests[i].state == TCP_MASTER_QUEUED) {
+            tcpMasterComplete(mb_master_requests[i], TCP_MASTER_ERR_CLOSED, nullptr, nullptr);
+        }
+    }
+}
+
+void tcpMasterPrintStatus() {
+    Serial.println("=== TCP Modbus Master ===");
+    Serial.printf("Pending requests: %d/%d\n", tcpMasterPendingCount(), TCP_MASTER_QUEUE_SIZE);
+    Serial.printf("Timeout: %lu ms\n", (unsigned long)mb_master_timeout_ms);
+    Serial.printf("Connections: %d of %d sockets\n", tcpMasterOpenCount(), mb_master_max_conns);
+    for (uint8_t i = 0; i < TCP_MASTER_MAX_CONNECTIONS; i++) {
+        const TCPMasterConnection& conn = mb_master_conns[i];
+        if (conn.connecting) {
+            Serial.printf("  [%d] %s:%d connecting\n", i, conn.ip.toString().c_str(), conn.port);
+        }
+        if (!conn.open) continue;
+        Serial.printf("  [%d] %s:%d in-flight %d, idle %lus\n", i, conn.ip.toString().c_str(), conn.port,
+                      conn.inflight, (millis() - conn.lastUsed) / 1000);
+    }
+    for (uint8_t i = 0; i < TCP_MASTER_MAX_SLAVES; i++) {
+        const TCPMasterBackoff& b = mb_master_backoff[i];
+        if (!b.used || (long)(millis() - b.retryAt) >= 0) continue;
+        Serial.printf("  %s:%d backing off, retry in %lus\n", b.ip.toString().c_str(), b.port,
+                      (b.retryAt - millis()) / 1000);
+    }
+    Serial.println("=========================");
+}
+
+#endif // TCP_MODBUS_MASTER_H
@@ -6,6 +6,8 @@
 #include <WiFi.h>
 #include <Ethernet.h>
 #include "esp_task_wdt.h"
+#include <algorithm>
+#include "RS485_modbus_RTU.h"
 
 // External reference to preferences
 extern Preferences tcpModbusPref;
@@ -15,41 +17,134 @@ bool debugTCPModbus = false;
 std::function<void(uint16_t, uint16_t)> single_write_callback = nullptr;
 
 
+// ==================== MODBUS REGISTER DEFINITIONS ====================
+// Register storage lives in the runtime register map; see
+// modbus_register_map.h for declaring blocks (default: MB_REG_*_COUNT at 0).
+// Application access (tcpModbusSet*/Get*) is in modbus_register_store.h.
+#include "modbus_register_store.h"
+
+// ==================== CLIENT CONNECTION TABLE ====================
+// W5500 has 8 hardware sockets shared by the listener, MQTT and everything
+// else, so keep the compile-time table small. The runtime limit ("maxclients"
+// preference) can only lower it.
+#ifndef TCP_MODBUS_MAX_CLIENTS
+#define TCP_MODBUS_MAX_CLIENTS      4
+#endif
+#define TCP_MODBUS_IDLE_TIMEOUT     60      // Default idle timeout in seconds (0 = never)
+
+// MBAP framing: [TxID(2)][ProtID(2)][Len(2)][UnitID(1)] followed by the PDU.
+// Len counts the unit ID plus PDU, so a full ADU is 6 + Len bytes.
+#define MB_MBAP_HEADER_LEN          7
+#define MB_TCP_MAX_ADU              260     // 7-byte MBAP + 253-byte PDU
+#define MB_MBAP_MIN_LENGTH          2       // Unit ID + function code
+#define MB_MBAP_MAX_LENGTH          (MB_TCP_MAX_ADU - 6)
 
-// Transport type enum
-enum TCPModbusTransport {
-    TRANSPORT_WIFI = 0,
-    TRANSPORT_ETHERNET = 1,
-    TRANSPORT_AUTO = 2
+// Request statistics: log2 service-time histograms per function code and
+// per client. Bucket b counts replies that took [2^(b-1), 2^b) us; the last
+// bucket also takes everything slower.
+#define TCP_MODBUS_HIST_BUCKETS     16      // Up to 16.4 ms, then overflow
+#define TCP_MODBUS_STATS_FCS        10      // FC01-06, 15, 16, 23 and "other"
+
+struct TCPModbusHistogram {
+    uint32_t count;
+    uint32_t exceptions;
+    uint32_t maxUs;
+    uint32_t buckets[TCP_MODBUS_HIST_BUCKETS];
 };
 
-// ==================== MODBUS REGISTER DEFINITIONS ====================
-#define MB_REG_HOLDING_COUNT        100
-#define MB_REG_INPUT_COUNT          100
-#define MB_REG_COIL_COUNT           64
-#define MB_REG_DISCRETE_COUNT       64
+struct TCPModbusCounters {
+    uint32_t requests;              // Replies sent, local and gateway
+    uint32_t exceptions;
+    uint32_t malformed;             // Connections dropped for a bad MBAP header
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+};
 
-// Register storage
-static uint16_t mb_holding_registers[MB_REG_HOLDING_COUNT] = {0};
-static uint16_t mb_input_registers[MB_REG_INPUT_COUNT] = {0};
-static uint8_t mb_coil_registers[(MB_REG_COIL_COUNT + 7) / 8] = {0};
-static uint8_t mb_discrete_registers[(MB_REG_DISCRETE_COUNT + 7) / 8] = {0};
+struct TCPModbusClientSlot {
+    EthernetClient eth;
+    WiFiClient wifi;
+    uint8_t rxBuf[MB_TCP_MAX_ADU];  // Partial ADU carried between passes
+    uint16_t rxLen;
+    bool active;
+    unsigned long connectedAt;
+    unsigned long lastActivity;
+    uint32_t requests;
+    uint32_t session;               // Changes on every accept; stale gateway replies are dropped
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    TCPModbusHistogram hist;
+};
 
 // Server state
 static EthernetServer* ethModbusServer = nullptr;
 static WiFiServer* wifiModbusServer = nullptr;
-static EthernetClient mbEthClient;
-static WiFiClient mbWifiClient;
+static TCPModbusClientSlot mb_clients[TCP_MODBUS_MAX_CLIENTS];
+static uint8_t mb_max_clients = TCP_MODBUS_MAX_CLIENTS;
+static uint32_t mb_idle_timeout_ms = TCP_MODBUS_IDLE_TIMEOUT * 1000UL;
+static uint8_t mb_rr_next = 0;          // Slot serviced first on the next pass
+static uint32_t mb_next_session = 0;
 static bool mb_initialized = false;
 static bool mb_running = false;
 static bool mb_use_ethernet = false;
 
+// ==================== SERVER TASK / SERVICE STATS ====================
+// The server polls its sockets; nothing wakes it when data arrives, since
+// the Ethernet library leaves the W5500 interrupt output disabled. Delay
+// before a new request is read:
+// - Task mode ("tcpmodbus task on"): the server runs on its own pinned
+//   task and, after a pass that found nothing, sleeps
+//   TCP_MODBUS_TASK_IDLE_MS, so at most ~1 ms. Code that has its own
+//   readiness signal (e.g. INTn wired and enabled) can wake it sooner
+//   with tcpModbusNotifyFromISR().
+// - boardloop() mode (default): tcpModbusLoop() runs a pass at most every
+//   TCP_MODBUS_LOOP_INTERVAL_MS, so up to 50 ms plus the board loop's own
+//   period. A pass is skipped while another task holds the network lock
+//   for more than 1 ms.
+// Local requests are answered in the pass that reads them; gateway
+// requests when the RTU reply arrives.
+#define TCP_MODBUS_LOOP_INTERVAL_MS 50
+#define TCP_MODBUS_TASK_IDLE_MS     1
+#define TCP_MODBUS_TASK_STACK       4096
+#define TCP_MODBUS_TASK_PRIORITY    3
+#define TCP_MODBUS_STATS_SAMPLES    256     // Service-time ring used for p50/p99
+
+static TaskHandle_t mb_task_handle = nullptr;
+static SemaphoreHandle_t mb_net_lock = nullptr;
+static volatile bool mb_task_stop = false;
+
+static uint32_t mb_service_us[TCP_MODBUS_STATS_SAMPLES];   // Request-to-response time, us
+static uint16_t mb_service_head = 0;
+static uint32_t mb_service_total = 0;
+static uint32_t mb_service_max_us = 0;
+
+static TCPModbusCounters mb_stats;
+static TCPModbusHistogram mb_stats_fc[TCP_MODBUS_STATS_FCS];
+static const uint8_t mb_stats_fc_codes[TCP_MODBUS_STATS_FCS] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x0F, 0x10, 0x17, 0x00 };
+
+bool tcpModbusStartTask(uint8_t core = ARDUINO_RUNNING_CORE, uint8_t priority = TCP_MODBUS_TASK_PRIORITY);
+void tcpModbusLockNetwork();
+void tcpModbusUnlockNetwork();
+bool tcpModbusTryLockNetwork(uint32_t waitMs);
+SemaphoreHandle_t tcpModbusNetworkLock();
+bool tcpModbusSetGatewayUnits(const String& units);
+void tcpModbusSetGatewayCache(uint32_t maxAgeMs);
+
 // ==================== HELPER FUNCTIONS ====================
 
 void setsingleWriteCallback(std::function<void(uint16_t, uint16_t)> callback) {
     single_write_callback = callback;
 }
 
+void tcpModbusSetMaxClients(uint8_t maxClients) {
+    if (maxClients < 1) maxClients = 1;
+    if (maxClients > TCP_MODBUS_MAX_CLIENTS) maxClients = TCP_MODBUS_MAX_CLIENTS;
+    mb_max_clients = maxClients;
+}
+
+void tcpModbusSetIdleTimeout(uint32_t seconds) {
+    mb_idle_timeout_ms = seconds * 1000UL;
+}
+
 uint16_t modbusSwap16(uint16_t val) {
     return (val << 8) | (val >> 8);
 }
@@ -70,217 +165,303 @@ uint16_t modbusCRC16(uint8_t* buffer, uint16_t length) {
     return crc;
 }
 
-// ==================== REGISTER ACCESS FUNCTIONS ====================
+// ==================== MODBUS TCP FRAME PROCESSING ====================
 
-bool tcpModbusSetHoldingRegister(uint16_t address, uint16_t value) {
-    if (address >= MB_REG_HOLDING_COUNT) return false;
-    mb_holding_registers[address] = value;
-    return true;
+// Exception codes returned by function-code handlers
+#define MB_EX_NONE                  0x00
+#define MB_EX_ILLEGAL_FUNCTION      0x01
+#define MB_EX_ILLEGAL_DATA_ADDRESS  0x02
+#define MB_EX_ILLEGAL_DATA_VALUE    0x03
+#define MB_EX_SLAVE_DEVICE_FAILURE  0x04
+
+#define MB_MAX_PDU                  253
+
+// Function-code handler. req points at the request PDU (function code
+// first) and reqLen is its length; the handler writes the response PDU
+// after the function code (resp[0] is pre-filled) and sets *respLen to the
+// full PDU length. Return MB_EX_NONE or an exception code, in which case
+// the dispatcher sends the exception response instead.
+typedef uint8_t (*TCPModbusFCHandler)(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen);
+
+static TCPModbusFCHandler mb_fc_handlers[128] = {nullptr};
+static bool mb_fc_defaults_loaded = false;
+
+static inline uint16_t mbReadU16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
 }
 
-uint16_t tcpModbusGetHoldingRegister(uint16_t address) {
-    if (address >= MB_REG_HOLDING_COUNT) return 0;
-    return mb_holding_registers[address];
+static inline void mbWriteU16(uint8_t* p, uint16_t v) {
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
 }
 
-bool tcpModbusSetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (startAddress + count > MB_REG_HOLDING_COUNT) return false;
-    memcpy(&mb_holding_registers[startAddress], values, count * sizeof(uint16_t));
-    return true;
+// Pack count bits starting at bit startBit of a bit-packed block
+static void mbPackBits(const uint8_t* table, uint16_t startBit, uint16_t count, uint8_t* out) {
+    memset(out, 0, (count + 7) / 8);
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t bit = startBit + i;
+        if ((table[bit / 8] >> (bit % 8)) & 0x01) {
+            out[i / 8] |= (1 << (i % 8));
+        }
+    }
 }
 
-bool tcpModbusGetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (startAddress + count > MB_REG_HOLDING_COUNT) return false;
-    memcpy(values, &mb_holding_registers[startAddress], count * sizeof(uint16_t));
-    return true;
+static void mbUnpackBits(uint8_t* table, uint16_t startBit, uint16_t count, const uint8_t* in) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t bit = startBit + i;
+        if ((in[i / 8] >> (i % 8)) & 0x01) {
+            table[bit / 8] |= (1 << (bit % 8));
+        } else {
+            table[bit / 8] &= ~(1 << (bit % 8));
+        }
+    }
 }
 
-bool tcpModbusSetInputRegister(uint16_t address, uint16_t value) {
-    if (address >= MB_REG_INPUT_COUNT) return false;
-    mb_input_registers[address] = value;
-    return true;
+// FC 01 / 02 - Read Coils / Read Discrete Inputs
+static uint8_t mbReadBits(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen, ModbusRegType type) {
+    if (reqLen != 5) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t startAddr = mbReadU16(&req[1]);
+    uint16_t count = mbReadU16(&req[3]);
+    if (count < 1 || count > 2000) return MB_EX_ILLEGAL_DATA_VALUE;
+    const ModbusRegBlock* block = modbusMapFind(type, startAddr, count);
+    if (!block) return MB_EX_ILLEGAL_DATA_ADDRESS;
+
+    resp[1] = (count + 7) / 8;
+    uint32_t seq;
+    do {
+        seq = modbusMapReadBegin();
+        mbPackBits((const uint8_t*)block->data, startAddr - block->start, count, &resp[2]);
+    } while (modbusMapReadRetry(seq));
+    *respLen = 2 + resp[1];
+    return MB_EX_NONE;
 }
 
-uint16_t tcpModbusGetInputRegister(uint16_t address) {
-    if (address >= MB_REG_INPUT_COUNT) return 0;
-    return mb_input_registers[address];
+static uint8_t mbHandleReadCoils(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    return mbReadBits(req, reqLen, resp, respLen, MB_TYPE_COIL);
 }
 
-bool tcpModbusSetCoil(uint16_t address, bool value) {
-    if (address >= MB_REG_COIL_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    if (value) {
-        mb_coil_registers[byteIndex] |= (1 << bitIndex);
-    } else {
-        mb_coil_registers[byteIndex] &= ~(1 << bitIndex);
+static uint8_t mbHandleReadDiscreteInputs(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    return mbReadBits(req, reqLen, resp, respLen, MB_TYPE_DISCRETE);
+}
+
+// FC 03 / 04 - Read Holding / Input Registers
+static uint8_t mbReadRegisters(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen, ModbusRegType type) {
+    if (reqLen != 5) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t startAddr = mbReadU16(&req[1]);
+    uint16_t count = mbReadU16(&req[3]);
+    if (count < 1 || count > 125) return MB_EX_ILLEGAL_DATA_VALUE;
+    const uint16_t* regs = modbusMapRegisters(type, startAddr, count);
+    if (!regs) return MB_EX_ILLEGAL_DATA_ADDRESS;
+
+    resp[1] = count * 2;
+    uint32_t seq;
+    do {
+        seq = modbusMapReadBegin();
+        for (uint16_t i = 0; i < count; i++) {
+            mbWriteU16(&resp[2 + i * 2], regs[i]);
+        }
+    } while (modbusMapReadRetry(seq));
+    *respLen = 2 + resp[1];
+    return MB_EX_NONE;
+}
+
+static uint8_t mbHandleReadHolding(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    return mbReadRegisters(req, reqLen, resp, respLen, MB_TYPE_HOLDING);
+}
+
+static uint8_t mbHandleReadInput(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    return mbReadRegisters(req, reqLen, resp, respLen, MB_TYPE_INPUT);
+}
+
+// FC 05 - Write Single Coil
+static uint8_t mbHandleWriteCoil(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    if (reqLen != 5) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t addr = mbReadU16(&req[1]);
+    uint16_t value = mbReadU16(&req[3]);
+    if (value != 0x0000 && value != 0xFF00) return MB_EX_ILLEGAL_DATA_VALUE;
+    modbusMapWriteBegin();
+    bool ok = modbusMapSetBit(MB_TYPE_COIL, addr, value == 0xFF00);
+    modbusMapWriteEnd();
+    if (!ok) return MB_EX_ILLEGAL_DATA_ADDRESS;
+    modbusMapNotifyWrite(MB_TYPE_COIL, addr, 1);
+
+    memcpy(resp, req, 5); // Echo request
+    *respLen = 5;
+    return MB_EX_NONE;
+}
+
+// FC 06 - Write Single Register
+static uint8_t mbHandleWriteRegister(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    if (reqLen != 5) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t addr = mbReadU16(&req[1]);
+    uint16_t value = mbReadU16(&req[3]);
+    uint16_t* reg = modbusMapRegisters(MB_TYPE_HOLDING, addr);
+    if (!reg) return MB_EX_ILLEGAL_DATA_ADDRESS;
+
+    modbusMapWriteBegin();
+    *reg = value;
+    modbusMapWriteEnd();
+    modbusMapNotifyWrite(MB_TYPE_HOLDING, addr, 1);
+    memcpy(resp, req, 5); // Echo request
+    *respLen = 5;
+    if (single_write_callback) {
+        single_write_callback(addr, value);
     }
-    return true;
+    return MB_EX_NONE;
 }
 
-bool tcpModbusGetCoil(uint16_t address) {
-    if (address >= MB_REG_COIL_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    return (mb_coil_registers[byteIndex] >> bitIndex) & 0x01;
+// FC 15 - Write Multiple Coils
+static uint8_t mbHandleWriteCoils(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    if (reqLen < 6) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t startAddr = mbReadU16(&req[1]);
+    uint16_t count = mbReadU16(&req[3]);
+    uint8_t byteCount = req[5];
+    if (count < 1 || count > 1968 || byteCount != (count + 7) / 8 || reqLen != 6 + byteCount) {
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+    const ModbusRegBlock* block = modbusMapFind(MB_TYPE_COIL, startAddr, count);
+    if (!block) return MB_EX_ILLEGAL_DATA_ADDRESS;
+
+    modbusMapWriteBegin();
+    mbUnpackBits((uint8_t*)block->data, startAddr - block->start, count, &req[6]);
+    modbusMapWriteEnd();
+    modbusMapNotifyWrite(MB_TYPE_COIL, startAddr, count);
+    memcpy(resp, req, 5); // Echo address and quantity
+    *respLen = 5;
+    return MB_EX_NONE;
 }
 
-bool tcpModbusSetDiscreteInput(uint16_t address, bool value) {
-    if (address >= MB_REG_DISCRETE_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    if (value) {
-        mb_discrete_registers[byteIndex] |= (1 << bitIndex);
-    } else {
-        mb_discrete_registers[byteIndex] &= ~(1 << bitIndex);
+// FC 16 - Write Multiple Registers
+static uint8_t mbHandleWriteRegisters(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    if (reqLen < 6) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t startAddr = mbReadU16(&req[1]);
+    uint16_t count = mbReadU16(&req[3]);
+    uint8_t byteCount = req[5];
+    if (count < 1 || count > 123 || byteCount != count * 2 || reqLen != 6 + byteCount) {
+        return MB_EX_ILLEGAL_DATA_VALUE;
     }
-    return true;
+    uint16_t* regs = modbusMapRegisters(MB_TYPE_HOLDING, startAddr, count);
+    if (!regs) return MB_EX_ILLEGAL_DATA_ADDRESS;
+
+    modbusMapWriteBegin();
+    for (uint16_t i = 0; i < count; i++) {
+        regs[i] = mbReadU16(&req[6 + i * 2]);
+    }
+    modbusMapWriteEnd();
+    modbusMapNotifyWrite(MB_TYPE_HOLDING, startAddr, count);
+    memcpy(resp, req, 5); // Echo address and quantity
+    *respLen = 5;
+    return MB_EX_NONE;
 }
 
-bool tcpModbusGetDiscreteInput(uint16_t address) {
-    if (address >= MB_REG_DISCRETE_COUNT) return false;
-    uint16_t byteIndex = address / 8;
-    uint8_t bitIndex = address % 8;
-    return (mb_discrete_registers[byteIndex] >> bitIndex) & 0x01;
+// FC 23 - Read/Write Multiple Registers (write is applied before the read)
+static uint8_t mbHandleReadWriteRegisters(const uint8_t* req, uint16_t reqLen, uint8_t* resp, uint16_t* respLen) {
+    if (reqLen < 10) return MB_EX_ILLEGAL_DATA_VALUE;
+    uint16_t readAddr = mbReadU16(&req[1]);
+    uint16_t readCount = mbReadU16(&req[3]);
+    uint16_t writeAddr = mbReadU16(&req[5]);
+    uint16_t writeCount = mbReadU16(&req[7]);
+    uint8_t byteCount = req[9];
+    if (readCount < 1 || readCount > 125 || writeCount < 1 || writeCount > 121 ||
+        byteCount != writeCount * 2 || reqLen != 10 + byteCount) {
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+    uint16_t* readRegs = modbusMapRegisters(MB_TYPE_HOLDING, readAddr, readCount);
+    uint16_t* writeRegs = modbusMapRegisters(MB_TYPE_HOLDING, writeAddr, writeCount);
+    if (!readRegs || !writeRegs) return MB_EX_ILLEGAL_DATA_ADDRESS;
+
+    // Write and read back inside one write section so the reply matches
+    modbusMapWriteBegin();
+    for (uint16_t i = 0; i < writeCount; i++) {
+        writeRegs[i] = mbReadU16(&req[10 + i * 2]);
+    }
+    resp[1] = readCount * 2;
+    for (uint16_t i = 0; i < readCount; i++) {
+        mbWriteU16(&resp[2 + i * 2], readRegs[i]);
+    }
+    modbusMapWriteEnd();
+    modbusMapNotifyWrite(MB_TYPE_HOLDING, writeAddr, writeCount);
+    *respLen = 2 + resp[1];
+    return MB_EX_NONE;
 }
 
-// Float helpers
-bool tcpModbusSetHoldingFloat(uint16_t address, float value) {
-    if (address + 1 >= MB_REG_HOLDING_COUNT) return false;
-    uint16_t* ptr = (uint16_t*)&value;
-    mb_holding_registers[address] = ptr[1];
-    mb_holding_registers[address + 1] = ptr[0];
-    return true;
+static void tcpModbusRegisterDefaultHandlers() {
+    mb_fc_defaults_loaded = true;
+    mb_fc_handlers[0x01] = mbHandleReadCoils;
+    mb_fc_handlers[0x02] = mbHandleReadDiscreteInputs;
+    mb_fc_handlers[0x03] = mbHandleReadHolding;
+    mb_fc_handlers[0x04] = mbHandleReadInput;
+    mb_fc_handlers[0x05] = mbHandleWriteCoil;
+    mb_fc_handlers[0x06] = mbHandleWriteRegister;
+    mb_fc_handlers[0x0F] = mbHandleWriteCoils;
+    mb_fc_handlers[0x10] = mbHandleWriteRegisters;
+    mb_fc_handlers[0x17] = mbHandleReadWriteRegisters;
 }
 
-float tcpModbusGetHoldingFloat(uint16_t address) {
-    if (address + 1 >= MB_REG_HOLDING_COUNT) return 0.0f;
-    float value;
-    uint16_t* ptr = (uint16_t*)&value;
-    ptr[1] = mb_holding_registers[address];
-    ptr[0] = mb_holding_registers[address + 1];
-    return value;
+// Install (or with nullptr, remove) the handler for a function code. This
+// also overrides the built-in handlers. Function codes 0x80+ are reserved
+// for exception responses.
+bool tcpModbusRegisterHandler(uint8_t funcCode, TCPModbusFCHandler handler) {
+    if (funcCode == 0 || funcCode >= 0x80) return false;
+    if (!mb_fc_defaults_loaded) tcpModbusRegisterDefaultHandlers();
+    mb_fc_handlers[funcCode] = handler;
+    return true;
 }
 
-// ==================== MODBUS TCP FRAME PROCESSING ====================
+// Build the response ADU for one complete request ADU. Returns the response
+// length, or 0 if the frame is too short to answer at all. Every request
+// with a function code gets either a normal or an exception response.
+uint16_t tcpModbusBuildResponse(const uint8_t* frame, uint16_t len, uint8_t* response) {
+    if (len < MB_MBAP_HEADER_LEN + 1) return 0; // Too short for Modbus TCP
+
+    if (!mb_fc_defaults_loaded) tcpModbusRegisterDefaultHandlers();
 
-void processModbusFrame(uint8_t* frame, uint16_t len, Client& client) {
-    if (len < 8) return; // Too short for Modbus TCP
-    
-    yield(); // Feed watchdog at start
-    
     // Modbus TCP frame: [TxID(2)][ProtID(2)][Len(2)][UnitID(1)][FC(1)][Data...]
-    uint16_t txId = (frame[0] << 8) | frame[1];
-    uint8_t unitId = frame[6];
-    uint8_t funcCode = frame[7];
-    
-    uint8_t response[260];
-    uint16_t responseLen = 0;
-    
-    // Copy header
-    response[0] = frame[0]; // Transaction ID
-    response[1] = frame[1];
-    response[2] = 0x00; // Protocol ID
-    response[3] = 0x00;
-    response[6] = unitId;
-    response[7] = funcCode;
-    
-    if (funcCode == 0x03) { // Read Holding Registers
-        yield(); // Feed watchdog before processing
-        uint16_t startAddr = (frame[8] << 8) | frame[9];
-        uint16_t numRegs = (frame[10] << 8) | frame[11];
-        
-        if (startAddr + numRegs <= MB_REG_HOLDING_COUNT) {
-            response[8] = numRegs * 2; // Byte count
-            responseLen = 9;
-            
-            for (uint16_t i = 0; i < numRegs; i++) {
-                if (i % 20 == 0) yield(); // Feed watchdog every 20 registers
-                uint16_t val = mb_holding_registers[startAddr + i];
-                response[responseLen++] = (val >> 8) & 0xFF;
-                response[responseLen++] = val & 0xFF;
-            }
-            
-            // Set length
-            uint16_t pduLen = responseLen - 6;
-            response[4] = (pduLen >> 8) & 0xFF;
-            response[5] = pduLen & 0xFF;
-            
-            client.write(response, responseLen);
-            if (debugTCPModbus){
-                Serial.printf("[Modbus] Read Holding Regs: addr=%d, count=%d\n", startAddr, numRegs);
-            }
+    const uint8_t* req = &frame[MB_MBAP_HEADER_LEN];
+    uint16_t reqLen = len - MB_MBAP_HEADER_LEN;
+    uint8_t funcCode = req[0];
+    uint8_t* resp = &response[MB_MBAP_HEADER_LEN];
+    uint16_t respLen = 1;
+
+    TCPModbusFCHandler handler = (funcCode < 0x80) ? mb_fc_handlers[funcCode] : nullptr;
+    uint8_t exception = MB_EX_ILLEGAL_FUNCTION;
+    resp[0] = funcCode;
+    if (handler) {
+        exception = handler(req, reqLen, resp, &respLen);
+        if (exception == MB_EX_NONE && (respLen < 1 || respLen > MB_MAX_PDU)) {
+            exception = MB_EX_SLAVE_DEVICE_FAILURE;
         }
     }
-    else if (funcCode == 0x04) { // Read Input Registers
-        yield(); // Feed watchdog before processing
-        uint16_t startAddr = (frame[8] << 8) | frame[9];
-        uint16_t numRegs = (frame[10] << 8) | frame[11];
-        
-        if (startAddr + numRegs <= MB_REG_INPUT_COUNT) {
-            response[8] = numRegs * 2;
-            responseLen = 9;
-            
-            for (uint16_t i = 0; i < numRegs; i++) {
-                if (i % 20 == 0) yield(); // Feed watchdog every 20 registers
-                uint16_t val = mb_input_registers[startAddr + i];
-                response[responseLen++] = (val >> 8) & 0xFF;
-                response[responseLen++] = val & 0xFF;
-            }
-            
-            uint16_t pduLen = responseLen - 6;
-            response[4] = (pduLen >> 8) & 0xFF;
-            response[5] = pduLen & 0xFF;
-            
-            client.write(response, responseLen);
-            if (debugTCPModbus){
-                Serial.printf("[Modbus] Read Input Regs: addr=%d, count=%d\n", startAddr, numRegs);
-            }
-        }
+    if (exception != MB_EX_NONE) {
+        resp[0] = funcCode | 0x80;
+        resp[1] = exception;
+        respLen = 2;
     }
-    else if (funcCode == 0x06) { // Write Single Register
-        yield(); // Feed watchdog before processing
-        uint16_t addr = (frame[8] << 8) | frame[9];
-        uint16_t value = (frame[10] << 8) | frame[11];
-        
-        if (addr < MB_REG_HOLDING_COUNT) {
-            mb_holding_registers[addr] = value;
-            client.write(frame, 12); // Echo request
-            if (debugTCPModbus){
-                Serial.printf("[Modbus] Write Reg: addr=%d, value=%d\n", addr, value);
-            }
-            if(single_write_callback){
-                single_write_callback(addr, value);
-            }
+
+    // MBAP header: echo transaction and unit ID, length covers unit ID + PDU
+    response[0] = frame[0];
+    response[1] = frame[1];
+    response[2] = 0x00;
+    response[3] = 0x00;
+    mbWriteU16(&response[4], respLen + 1);
+    response[6] = frame[6];
+
+    if (debugTCPModbus) {
+        if (exception != MB_EX_NONE) {
+            Serial.printf("[Modbus] FC 0x%02X -> exception %d\n", funcCode, exception);
+        } else {
+            Serial.printf("[Modbus] FC 0x%02X addr=%d\n", funcCode, (reqLen >= 3) ? mbReadU16(&req[1]) : 0);
         }
     }
-    else if (funcCode == 0x10) { // Write Multiple Registers
-        yield(); // Feed watchdog before processing
-        uint16_t startAddr = (frame[8] << 8) | frame[9];
-        uint16_t numRegs = (frame[10] << 8) | frame[11];
-        uint8_t byteCount = frame[12];
-        
-        if (startAddr + numRegs <= MB_REG_HOLDING_COUNT && byteCount == numRegs * 2) {
-            for (uint16_t i = 0; i < numRegs; i++) {
-                if (i % 20 == 0) yield(); // Feed watchdog every 20 registers
-                uint16_t val = (frame[13 + i * 2] << 8) | frame[14 + i * 2];
-                mb_holding_registers[startAddr + i] = val;
-            }
-            
-            // Send response (echo first 12 bytes)
-            responseLen = 12;
-            memcpy(response, frame, 12);
-            response[4] = 0x00;
-            response[5] = 0x06;
-            
-            client.write(response, responseLen);
-            if (debugTCPModbus){
-                Serial.printf("[Modbus] Write Multiple Regs: addr=%d, count=%d\n", startAddr, numRegs);
-            }
-        }
+    return MB_MBAP_HEADER_LEN + respLen;
+}
+
+void processModbusFrame(uint8_t* frame, uint16_t len, Client& client) {
+    uint8_t response[MB_TCP_MAX_ADU];
+    uint16_t responseLen = tcpModbusBuildResponse(frame, len, response);
+    if (responseLen > 0) {
+        client.write(response, responseLen);
     }
-    
-    yield(); // Feed watchdog at end of processing
 }
 
 // ==================== INITIALIZATION ====================
@@ -299,20 +480,19 @@ bool tcpModbusInit() {
 
     uint16_t port = tcpModbusPref.getUShort("port", 502);
     uint8_t transport = tcpModbusPref.getUChar("transport", TRANSPORT_AUTO);
+    tcpModbusSetMaxClients(tcpModbusPref.getUChar("maxclients", TCP_MODBUS_MAX_CLIENTS));
+    tcpModbusSetIdleTimeout(tcpModbusPref.getUShort("idletimeout", TCP_MODBUS_IDLE_TIMEOUT));
+    tcpModbusSetGatewayUnits(tcpModbusPref.getString("gwunits", ""));
+    tcpModbusSetGatewayCache(tcpModbusPref.getUShort("gwcache", 0));
 
-    bool useWiFi = false;
-    bool useEthernet = false;
+    bool useEthernet = false;   // Otherwise WiFi
 
-    if (transport == TRANSPORT_WIFI) {
-        useWiFi = true;
-    } else if (transport == TRANSPORT_ETHERNET) {
+    if (transport == TRANSPORT_ETHERNET) {
         useEthernet = true;
-    } else { // AUTO
+    } else if (transport != TRANSPORT_WIFI) { // AUTO
         if (Ethernet.linkStatus() == LinkON) {
             useEthernet = true;
-        } else if (WiFi.status() == WL_CONNECTED) {
-            useWiFi = true;
-        } else {
+        } else if (WiFi.status() != WL_CONNECTED) {
             Serial.println("[TCPModbus] No network");
             return false;
         }
@@ -329,109 +509,911 @@ bool tcpModbusInit() {
         mb_use_ethernet = false;
         Serial.printf("[TCPModbus] Started on WiFi %s:%d\n", WiFi.localIP().toString().c_str(), port);
     }
+    Serial.printf("[TCPModbus] Max clients: %d, idle timeout: %lus\n", mb_max_clients, (unsigned long)(mb_idle_timeout_ms / 1000));
 
     mb_initialized = true;
     mb_running = true;
+
+    if (tcpModbusPref.getBool("taskmode", false)) {
+        tcpModbusStartTask();
+    }
     return true;
 }
 
-// ==================== LOOP ====================
+// ==================== SERVICE-TIME STATISTICS ====================
 
-void tcpModbusLoop() {
-    if (!mb_running) return;
-    
-    yield(); // Feed watchdog at start of loop
-    
-    // Aggressive throttling - check every 50ms to reduce blocking frequency
-    static unsigned long lastCheck = 0;
-    unsigned long now = millis();
-    if (now - lastCheck < 50) { // Increased from 10ms to 50ms
-        return;
+static void tcpModbusRecordServiceTime(uint32_t us) {
+    mb_service_us[mb_service_head] = us;
+    mb_service_head = (mb_service_head + 1) % TCP_MODBUS_STATS_SAMPLES;
+    mb_service_total++;
+    if (us > mb_service_max_us) mb_service_max_us = us;
+}
+
+// Percentiles over the last TCP_MODBUS_STATS_SAMPLES requests. Sorting a
+// copy keeps the recording side to a single store.
+bool tcpModbusGetServiceStats(uint32_t* p50, uint32_t* p99, uint32_t* maxUs, uint32_t* total) {
+    uint32_t n = (mb_service_total < TCP_MODBUS_STATS_SAMPLES) ? mb_service_total : TCP_MODBUS_STATS_SAMPLES;
+    if (total) *total = mb_service_total;
+    if (maxUs) *maxUs = mb_service_max_us;
+    if (n == 0) {
+        if (p50) *p50 = 0;
+        if (p99) *p99 = 0;
+        return false;
     }
-    lastCheck = now;
-    
-    // Watchdog managed by Arduino framework via yield() and delay()
-    yield();
 
+    uint32_t sorted[TCP_MODBUS_STATS_SAMPLES];
+    memcpy(sorted, mb_service_us, n * sizeof(uint32_t));
+    std::sort(sorted, sorted + n);
+    if (p50) *p50 = sorted[(n - 1) * 50 / 100];
+    if (p99) *p99 = sorted[(n - 1) * 99 / 100];
+    return true;
+}
+
+void tcpModbusResetServiceStats() {
+    mb_service_head = 0;
+    mb_service_total = 0;
+    mb_service_max_us = 0;
+}
+
+// ==================== REQUEST STATISTICS ====================
+// Recorded once per reply from whichever context sends it (server pass or
+// gateway bus hook); both run under the network lock in task mode. Readers
+// take no lock: each counter is a single aligned word.
+
+static inline uint8_t tcpModbusStatsFcIndex(uint8_t fc) {
+    switch (fc) {
+        case 0x01: return 0;
+        case 0x02: return 1;
+        case 0x03: return 2;
+        case 0x04: return 3;
+        case 0x05: return 4;
+        case 0x06: return 5;
+        case 0x0F: return 6;
+        case 0x10: return 7;
+        case 0x17: return 8;
+        default:   return 9;
+    }
+}
+
+static inline void tcpModbusHistAdd(TCPModbusHistogram& hist, uint32_t us, bool exception) {
+    uint8_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= TCP_MODBUS_HIST_BUCKETS) bucket = TCP_MODBUS_HIST_BUCKETS - 1;
+    hist.buckets[bucket]++;
+    hist.count++;
+    if (exception) hist.exceptions++;
+    if (us > hist.maxUs) hist.maxUs = us;
+}
+
+// respFc is the function code byte of the reply, with 0x80 set for an
+// exception. index is the client slot, or -1 if the client has gone.
+static void tcpModbusRecordReply(int8_t index, uint8_t respFc, uint16_t bytesOut, uint32_t us) {
+    bool exception = (respFc & 0x80) != 0;
+    tcpModbusHistAdd(mb_stats_fc[tcpModbusStatsFcIndex(respFc & 0x7F)], us, exception);
+    mb_stats.requests++;
+    if (exception) mb_stats.exceptions++;
+    mb_stats.bytesOut += bytesOut;
+    if (index >= 0) {
+        TCPModbusClientSlot& slot = mb_clients[index];
+        tcpModbusHistAdd(slot.hist, us, exception);
+        slot.bytesOut += bytesOut;
+    }
+}
+
+// Upper bound in us of the bucket holding the given percentile, capped at
+// the observed maximum. 0 if nothing was recorded.
+uint32_t tcpModbusHistPercentile(const TCPModbusHistogram& hist, uint8_t percent) {
+    if (hist.count == 0) return 0;
+    uint32_t rank = ((uint64_t)hist.count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < TCP_MODBUS_HIST_BUCKETS; b++) {
+        seen += hist.buckets[b];
+        if (seen >= rank && b < TCP_MODBUS_HIST_BUCKETS - 1) {
+            uint32_t bound = 1UL << b;
+            return bound < hist.maxUs ? bound : hist.maxUs;
+        }
+    }
+    return hist.maxUs;
+}
+
+void tcpModbusGetStats(TCPModbusCounters* counters) {
+    *counters = mb_stats;
+}
+
+// Histogram for one of the TCP_MODBUS_STATS_FCS function-code slots; fc is
+// set to the code, or 0 for the "other" slot
+bool tcpModbusGetFcStats(uint8_t index, uint8_t* fc, TCPModbusHistogram* hist) {
+    if (index >= TCP_MODBUS_STATS_FCS) return false;
+    if (fc) *fc = mb_stats_fc_codes[index];
+    if (hist) *hist = mb_stats_fc[index];
+    return true;
+}
+
+// Histogram and byte counts of a connected client; reset on each accept
+bool tcpModbusGetClientStats(uint8_t index, IPAddress* ip, TCPModbusHistogram* hist, uint32_t* bytesIn, uint32_t* bytesOut) {
+    if (index >= TCP_MODBUS_MAX_CLIENTS || !mb_clients[index].active) return false;
+    TCPModbusClientSlot& slot = mb_clients[index];
+    if (ip) *ip = mb_use_ethernet ? slot.eth.remoteIP() : slot.wifi.remoteIP();
+    if (hist) *hist = slot.hist;
+    if (bytesIn) *bytesIn = slot.bytesIn;
+    if (bytesOut) *bytesOut = slot.bytesOut;
+    return true;
+}
+
+void tcpModbusResetStats() {
+    memset(&mb_stats, 0, sizeof(mb_stats));
+    memset(mb_stats_fc, 0, sizeof(mb_stats_fc));
+    for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+        memset(&mb_clients[i].hist, 0, sizeof(TCPModbusHistogram));
+        mb_clients[i].bytesIn = 0;
+        mb_clients[i].bytesOut = 0;
+    }
+}
+
+void tcpModbusPrintStats() {
+    Serial.println("=== TCP Modbus Statistics ===");
+    Serial.printf("Requests: %lu, exceptions: %lu, malformed: %lu\n", (unsigned long)mb_stats.requests,
+                  (unsigned long)mb_stats.exceptions, (unsigned long)mb_stats.malformed);
+    Serial.printf("Bytes in: %lu, out: %lu\n", (unsigned long)mb_stats.bytesIn, (unsigned long)mb_stats.bytesOut);
+    Serial.println("FC     requests  except   p50us   p99us   maxus");
+    for (uint8_t i = 0; i < TCP_MODBUS_STATS_FCS; i++) {
+        const TCPModbusHistogram& hist = mb_stats_fc[i];
+        if (hist.count == 0) continue;
+        char fc[6];
+        if (mb_stats_fc_codes[i]) snprintf(fc, sizeof(fc), "%02u", mb_stats_fc_codes[i]);
+        else snprintf(fc, sizeof(fc), "other");
+        Serial.printf("%-5s %9lu %7lu %7lu %7lu %7lu\n", fc, (unsigned long)hist.count, (unsigned long)hist.exceptions,
+                      (unsigned long)tcpModbusHistPercentile(hist, 50), (unsigned long)tcpModbusHistPercentile(hist, 99),
+                      (unsigned long)hist.maxUs);
+    }
+    for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+        TCPModbusClientSlot& slot = mb_clients[i];
+        if (!slot.active) continue;
+        IPAddress ip = mb_use_ethernet ? slot.eth.remoteIP() : slot.wifi.remoteIP();
+        Serial.printf("  [%d] %s  requests %lu  except %lu  p50 %lu us  p99 %lu us  in %lu B  out %lu B\n", i,
+                      ip.toString().c_str(), (unsigned long)slot.hist.count, (unsigned long)slot.hist.exceptions,
+                      (unsigned long)tcpModbusHistPercentile(slot.hist, 50),
+                      (unsigned long)tcpModbusHistPercentile(slot.hist, 99),
+                      (unsigned long)slot.bytesIn, (unsigned long)slot.bytesOut);
+    }
+    Serial.println("=============================");
+}
+
+// ==================== CLIENT TABLE MANAGEMENT ====================
+
+// Both client types derive from Client, so slot servicing works on the base
+// class and only accept() needs to know the transport.
+static Client& tcpModbusSlotClient(TCPModbusClientSlot& slot) {
+    if (mb_use_ethernet) return slot.eth;
+    return slot.wifi;
+}
+
+static void tcpModbusReleaseSlot(uint8_t index, const char* reason) {
+    TCPModbusClientSlot& slot = mb_clients[index];
+    if (!slot.active) return;
+    tcpModbusSlotClient(slot).stop();
+    slot.active = false;
+    Serial.printf("[TCPModbus] Client %d released (%s, %lu requests)\n", index, reason, (unsigned long)slot.requests);
+}
+
+static int tcpModbusFreeSlot() {
+    for (uint8_t i = 0; i < mb_max_clients; i++) {
+        if (!mb_clients[i].active) return i;
+    }
+    return -1;
+}
+
+static void tcpModbusClaimSlot(uint8_t index) {
+    TCPModbusClientSlot& slot = mb_clients[index];
+    slot.active = true;
+    slot.connectedAt = millis();
+    slot.lastActivity = slot.connectedAt;
+    slot.requests = 0;
+    slot.rxLen = 0;
+    slot.session = ++mb_next_session;
+    slot.bytesIn = 0;
+    slot.bytesOut = 0;
+    memset(&slot.hist, 0, sizeof(slot.hist));
+}
+
+// Accept every pending connection; reject once the table is full
+static void tcpModbusAcceptClients() {
     if (mb_use_ethernet && ethModbusServer) {
-        yield(); // Before checking for new clients
-        EthernetClient newClient = ethModbusServer->available();
-        yield(); // After checking for new clients
-        
-        if (newClient) {
-            if (!mbEthClient || !mbEthClient.connected()) {
-                mbEthClient = newClient;
-                Serial.println("[TCPModbus] Client connected");
+        for (;;) {
+            EthernetClient newClient = ethModbusServer->accept();
+            if (!newClient) break;
+            int index = tcpModbusFreeSlot();
+            if (index < 0) {
+                Serial.println("[TCPModbus] Client rejected (max clients reached)");
+                newClient.stop();
+                continue;
             }
+            mb_clients[index].eth = newClient;
+            tcpModbusClaimSlot(index);
+            Serial.printf("[TCPModbus] Client %d connected from %s\n", index, newClient.remoteIP().toString().c_str());
+        }
+    } else if (!mb_use_ethernet && wifiModbusServer) {
+        for (;;) {
+            WiFiClient newClient = wifiModbusServer->accept();
+            if (!newClient) break;
+            int index = tcpModbusFreeSlot();
+            if (index < 0) {
+                Serial.println("[TCPModbus] Client rejected (max clients reached)");
+                newClient.stop();
+                continue;
+            }
+            mb_clients[index].wifi = newClient;
+            tcpModbusClaimSlot(index);
+            Serial.printf("[TCPModbus] Client %d connected from %s\n", index, newClient.remoteIP().toString().c_str());
+        }
+    }
+}
+
+// Drop disconnected peers and reclaim slots that have been silent too long
+static void tcpModbusReapClients() {
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+        TCPModbusClientSlot& slot = mb_clients[i];
+        if (!slot.active) continue;
+        if (i >= mb_max_clients) {
+            tcpModbusReleaseSlot(i, "max clients lowered");
+        } else if (!tcpModbusSlotClient(slot).connected()) {
+            tcpModbusReleaseSlot(i, "disconnected");
+        } else if (mb_idle_timeout_ms > 0 && now - slot.lastActivity > mb_idle_timeout_ms) {
+            tcpModbusReleaseSlot(i, "idle timeout");
         }
+    }
+}
+
+// Bytes still missing from the ADU in rxBuf, or 0 once it is complete.
+// Returns -1 if the MBAP header is not Modbus TCP; the stream cannot be
+// resynchronised after that, so the caller drops the connection.
+static int tcpModbusFrameRemaining(const TCPModbusClientSlot& slot) {
+    if (slot.rxLen < MB_MBAP_HEADER_LEN) return MB_MBAP_HEADER_LEN - slot.rxLen;
+
+    uint16_t protocolId = (slot.rxBuf[2] << 8) | slot.rxBuf[3];
+    uint16_t length = (slot.rxBuf[4] << 8) | slot.rxBuf[5];
+    if (protocolId != 0 || length < MB_MBAP_MIN_LENGTH || length > MB_MBAP_MAX_LENGTH) return -1;
+
+    return (6 + length) - slot.rxLen;
+}
+
+static bool tcpModbusGatewayAccept(uint8_t index, const uint8_t* adu, uint16_t len, uint32_t startedUs);
+
+// Bulk-read whatever the socket holds and answer every complete ADU in
+// order, so pipelined requests are answered back-to-back. A trailing
+// partial ADU stays in rxBuf until the rest arrives.
+static uint8_t tcpModbusServiceClient(uint8_t index) {
+    TCPModbusClientSlot& slot = mb_clients[index];
+    Client& client = tcpModbusSlotClient(slot);
+    uint8_t frames = 0;
+
+    for (;;) {
+        int remaining = tcpModbusFrameRemaining(slot);
+        if (remaining < 0) {
+            mb_stats.malformed++;
+            tcpModbusReleaseSlot(index, "bad MBAP header");
+            return frames;
+        }
+
+        if (remaining == 0) {
+            uint32_t started = micros();
+            slot.requests++;
+            if (!tcpModbusGatewayAccept(index, slot.rxBuf, slot.rxLen, started)) {
+                uint8_t response[MB_TCP_MAX_ADU];
+                uint16_t responseLen = tcpModbusBuildResponse(slot.rxBuf, slot.rxLen, response);
+                client.write(response, responseLen);
+                uint32_t us = micros() - started;
+                tcpModbusRecordReply(index, response[MB_MBAP_HEADER_LEN], responseLen, us);
+                tcpModbusRecordServiceTime(us);
+            }   // Forwarded requests are timed when their reply goes out
+            slot.rxLen = 0;
+            frames++;
+            continue;
+        }
+
+        int avail = client.available();
+        if (avail <= 0) return frames;
+
+        int n = client.read(slot.rxBuf + slot.rxLen, (avail < remaining) ? avail : remaining);
+        if (n <= 0) return frames;
+        slot.rxLen += n;
+        slot.bytesIn += n;
+        mb_stats.bytesIn += n;
+        slot.lastActivity = millis();
+    }
+}
+
+uint8_t tcpModbusGetClientCount() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+        if (mb_clients[i].active) count++;
+    }
+    return count;
+}
+
+// ==================== RTU GATEWAY ====================
+// Requests for the configured unit IDs are forwarded to the RS485 slaves
+// through mb instead of being answered from the local map. They wait in a
+// small queue and go out one at a time from modbusLoop(), ahead of the poll
+// scheduler. Read replies can be cached for a max-age, and identical reads
+// still waiting in the queue are answered from the same serial transaction.
+#define TCP_MODBUS_GW_QUEUE         8       // Forwarded requests waiting or on the bus
+#define TCP_MODBUS_GW_CACHE         8       // Cached read responses
+#define TCP_MODBUS_GW_TIMEOUT       2000    // ms a request may wait before 0x0B
 
-        yield(); // Before client operations
-        if (mbEthClient && mbEthClient.connected()) {
-            yield(); // Before available check
-            if (mbEthClient.available()) {
-                uint8_t frame[260];
-                uint16_t len = 0;
-                unsigned long startTime = millis();
-                
-                // Read with strict timeout - max 50ms
-                while (mbEthClient.available() && len < 260 && (millis() - startTime < 50)) {
-                    frame[len++] = mbEthClient.read();
-                    delayMicroseconds(100); // Small delay between bytes
-                    
-                    // Feed watchdog every 10 bytes
-                    if (len % 10 == 0) {
-                        yield(); // Feed watchdog
-                    }
-                }
-                
-                if (len >= 8) {
-                    processModbusFrame(frame, len, mbEthClient);
-                }
+#define MB_EX_GATEWAY_PATH          0x0A    // Gateway path unavailable
+#define MB_EX_GATEWAY_TARGET        0x0B    // Gateway target failed to respond
+
+struct TCPModbusGwRequest {
+    bool used;
+    bool sent;                      // On the serial bus now
+    uint8_t slot;
+    uint32_t session;
+    uint8_t adu[MB_TCP_MAX_ADU];
+    uint16_t len;
+    unsigned long queuedAt;
+    unsigned long sentAt;           // Given up on after RTU_POLL_STUCK_MS with 0x0B
+    uint32_t startedUs;             // micros() when the request arrived, for statistics
+};
+
+struct TCPModbusGwCacheEntry {
+    bool valid;
+    uint8_t key[6];                 // Unit ID + FC + address + count
+    uint8_t pdu[MB_MAX_PDU];
+    uint16_t pduLen;
+    unsigned long storedAt;
+};
+
+// Caller of a reply, copied out so replies go out without the queue lock
+struct TCPModbusGwReplyTo {
+    uint8_t slot;
+    uint32_t session;
+    uint8_t mbap[MB_MBAP_HEADER_LEN];
+    uint32_t startedUs;
+};
+
+static TCPModbusGwRequest mb_gw_queue[TCP_MODBUS_GW_QUEUE];
+static TCPModbusGwCacheEntry mb_gw_cache[TCP_MODBUS_GW_CACHE];
+static uint8_t mb_gw_units[32];         // Bitmap of forwarded unit IDs
+static bool mb_gw_enabled = false;
+static uint32_t mb_gw_cache_ms = 0;     // 0 = no caching
+static int8_t mb_gw_active = -1;        // Queue index on the bus
+static SemaphoreHandle_t mb_gw_lock = nullptr;
+static uint32_t mb_gw_forwarded = 0;
+static uint32_t mb_gw_cache_hits = 0;
+static uint32_t mb_gw_shared = 0;       // Answered by another request's transaction
+static uint32_t mb_gw_failures = 0;
+static uint32_t mb_gw_stale = 0;        // Replies that arrived after their request was given up on
+
+static void tcpModbusGatewayLock() {
+    if (mb_gw_lock) xSemaphoreTake(mb_gw_lock, portMAX_DELAY);
+}
+
+static void tcpModbusGatewayUnlock() {
+    if (mb_gw_lock) xSemaphoreGive(mb_gw_lock);
+}
+
+static inline bool tcpModbusGatewayUnit(uint8_t unit) {
+    return (mb_gw_units[unit / 8] >> (unit % 8)) & 0x01;
+}
+
+static inline bool tcpModbusGatewayIsRead(uint8_t fc) {
+    return fc >= 0x01 && fc <= 0x04;
+}
+
+// Wrap a response PDU in the MBAP header of the request it answers
+static uint16_t tcpModbusGatewayFrame(const uint8_t* mbap, const uint8_t* pdu, uint16_t pduLen, uint8_t* out) {
+    memcpy(out, mbap, MB_MBAP_HEADER_LEN);
+    out[2] = 0x00;
+    out[3] = 0x00;
+    mbWriteU16(&out[4], pduLen + 1);
+    memcpy(&out[MB_MBAP_HEADER_LEN], pdu, pduLen);
+    return MB_MBAP_HEADER_LEN + pduLen;
+}
+
+static uint16_t tcpModbusGatewayException(const uint8_t* adu, uint8_t exception, uint8_t* out) {
+    uint8_t pdu[2] = { (uint8_t)(adu[MB_MBAP_HEADER_LEN] | 0x80), exception };
+    return tcpModbusGatewayFrame(adu, pdu, 2, out);
+}
+
+// Validate a request PDU the way the local handlers do; only the function
+// codes mb can issue as a master are forwarded
+static uint8_t tcpModbusGatewayCheck(const uint8_t* req, uint16_t reqLen) {
+    uint16_t count = (reqLen >= 5) ? mbReadU16(&req[3]) : 0;
+    switch (req[0]) {
+        case 0x01:
+        case 0x02:
+            return (reqLen == 5 && count >= 1 && count <= 2000) ? MB_EX_NONE : MB_EX_ILLEGAL_DATA_VALUE;
+        case 0x03:
+        case 0x04:
+            return (reqLen == 5 && count >= 1 && count <= 125) ? MB_EX_NONE : MB_EX_ILLEGAL_DATA_VALUE;
+        case 0x05:
+            return (reqLen == 5 && (count == 0x0000 || count == 0xFF00)) ? MB_EX_NONE : MB_EX_ILLEGAL_DATA_VALUE;
+        case 0x06:
+            return (reqLen == 5) ? MB_EX_NONE : MB_EX_ILLEGAL_DATA_VALUE;
+        case 0x0F:
+            return (reqLen >= 6 && count >= 1 && count <= 1968 && req[5] == (count + 7) / 8 &&
+                    reqLen == 6 + req[5]) ? MB_EX_NONE : MB_EX_ILLEGAL_DATA_VALUE;
+        case 0x10:
+            return (reqLen >= 6 && count >= 1 && count <= 123 && req[5] == count * 2 &&
+                    reqLen == 6 + req[5]) ? MB_EX_NONE : MB_EX_ILLEGAL_DATA_VALUE;
+        default:
+            return MB_EX_ILLEGAL_FUNCTION;
+    }
+}
+
+static TCPModbusGwCacheEntry* tcpModbusGatewayCacheFind(const uint8_t* adu) {
+    if (mb_gw_cache_ms == 0 || !tcpModbusGatewayIsRead(adu[MB_MBAP_HEADER_LEN])) return nullptr;
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_CACHE; i++) {
+        TCPModbusGwCacheEntry& entry = mb_gw_cache[i];
+        if (entry.valid && millis() - entry.storedAt <= mb_gw_cache_ms &&
+            memcmp(entry.key, &adu[MB_MBAP_HEADER_LEN - 1], sizeof(entry.key)) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+static void tcpModbusGatewayCacheStore(const uint8_t* adu, const uint8_t* pdu, uint16_t pduLen) {
+    if (mb_gw_cache_ms == 0) return;
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_CACHE; i++) {
+        if (!mb_gw_cache[i].valid) {
+            victim = i;
+            break;
+        }
+        if ((long)(mb_gw_cache[i].storedAt - mb_gw_cache[victim].storedAt) < 0) victim = i;
+    }
+    TCPModbusGwCacheEntry& entry = mb_gw_cache[victim];
+    memcpy(entry.key, &adu[MB_MBAP_HEADER_LEN - 1], sizeof(entry.key));
+    memcpy(entry.pdu, pdu, pduLen);
+    entry.pduLen = pduLen;
+    entry.storedAt = millis();
+    entry.valid = true;
+}
+
+// A write may change anything the unit reports
+static void tcpModbusGatewayCacheInvalidate(uint8_t unit) {
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_CACHE; i++) {
+        if (mb_gw_cache[i].key[0] == unit) mb_gw_cache[i].valid = false;
+    }
+}
+
+// TCP side: take a complete request ADU if its unit is forwarded. Cache
+// hits and errors are answered here; everything else is queued.
+static bool tcpModbusGatewayAccept(uint8_t index, const uint8_t* adu, uint16_t len, uint32_t startedUs) {
+    if (!mb_gw_enabled || !tcpModbusGatewayUnit(adu[6]) || len < MB_MBAP_HEADER_LEN + 1) return false;
+
+    uint8_t response[MB_TCP_MAX_ADU];
+    uint16_t responseLen = 0;
+    uint8_t exception = tcpModbusGatewayCheck(&adu[MB_MBAP_HEADER_LEN], len - MB_MBAP_HEADER_LEN);
+    if (exception == MB_EX_NONE && !modbusInitialized) exception = MB_EX_GATEWAY_PATH;
+
+    if (exception == MB_EX_NONE) {
+        tcpModbusGatewayLock();
+        TCPModbusGwCacheEntry* cached = tcpModbusGatewayCacheFind(adu);
+        if (cached) {
+            responseLen = tcpModbusGatewayFrame(adu, cached->pdu, cached->pduLen, response);
+            mb_gw_cache_hits++;
+        } else {
+            exception = MB_EX_GATEWAY_PATH;     // Queue full
+            for (uint8_t i = 0; i < TCP_MODBUS_GW_QUEUE; i++) {
+                TCPModbusGwRequest& req = mb_gw_queue[i];
+                if (req.used) continue;
+                req.used = true;
+                req.sent = false;
+                req.slot = index;
+                req.session = mb_clients[index].session;
+                memcpy(req.adu, adu, len);
+                req.len = len;
+                req.queuedAt = millis();
+                req.startedUs = startedUs;
+                exception = MB_EX_NONE;
+                break;
             }
         }
-    } else if (!mb_use_ethernet && wifiModbusServer) {
-        yield(); // Before checking for new clients
-        WiFiClient newClient = wifiModbusServer->available();
-        yield(); // After checking for new clients
-        
-        if (newClient) {
-            if (!mbWifiClient || !mbWifiClient.connected()) {
-                mbWifiClient = newClient;
-                Serial.println("[TCPModbus] Client connected");
+        tcpModbusGatewayUnlock();
+    }
+
+    if (exception != MB_EX_NONE) {
+        responseLen = tcpModbusGatewayException(adu, exception, response);
+        if (debugTCPModbus) {
+            Serial.printf("[TCPModbus] Gateway unit %d FC 0x%02X -> exception %d\n", adu[6], adu[7], exception);
+        }
+    }
+    if (responseLen > 0) {
+        tcpModbusSlotClient(mb_clients[index]).write(response, responseLen);
+        uint32_t us = micros() - startedUs;
+        tcpModbusRecordReply(index, response[MB_MBAP_HEADER_LEN], responseLen, us);
+        tcpModbusRecordServiceTime(us);
+    }
+    return true;
+}
+
+// Bus side: send a reply to a TCP client that may have gone away meanwhile
+static void tcpModbusGatewayReply(const TCPModbusGwReplyTo& to, const uint8_t* pdu, uint16_t pduLen) {
+    uint8_t response[MB_TCP_MAX_ADU];
+    uint16_t responseLen = tcpModbusGatewayFrame(to.mbap, pdu, pduLen, response);
+
+    tcpModbusLockNetwork();
+    TCPModbusClientSlot& slot = mb_clients[to.slot];
+    if (slot.active && slot.session == to.session) {
+        tcpModbusSlotClient(slot).write(response, responseLen);
+        uint32_t us = micros() - to.startedUs;
+        tcpModbusRecordReply(to.slot, pdu[0], responseLen, us);
+        tcpModbusRecordServiceTime(us);
+    } else {
+        tcpModbusRecordReply(-1, pdu[0], 0, micros() - to.startedUs);
+    }
+    tcpModbusUnlockNetwork();
+}
+
+static uint8_t tcpModbusGatewayExceptionFor(Modbus::ResultCode event) {
+    if (event >= 0x01 && event <= 0x0B) return event;      // Slave's own exception
+    if (event == Modbus::EX_TIMEOUT) return MB_EX_GATEWAY_TARGET;
+    return MB_EX_SLAVE_DEVICE_FAILURE;
+}
+
+// Completion of the request on the bus: build the response PDU, cache it,
+// and answer the request plus any identical read still waiting. A reply
+// for a request already given up on is ignored; the bus is not ours then.
+static bool tcpModbusGatewayDone(Modbus::ResultCode event, uint16_t, void*) {
+    TCPModbusGwReplyTo replyTo[TCP_MODBUS_GW_QUEUE];
+    uint8_t replies = 0;
+    uint8_t pdu[MB_MAX_PDU];
+    uint16_t pduLen = 0;
+
+    tcpModbusGatewayLock();
+    if (mb_gw_active < 0) {
+        mb_gw_stale++;
+        tcpModbusGatewayUnlock();
+        return true;
+    }
+    rtuBusReleased();
+    TCPModbusGwRequest& active = mb_gw_queue[mb_gw_active];
+    mb_gw_active = -1;
+    const uint8_t* req = &active.adu[MB_MBAP_HEADER_LEN];
+    uint8_t fc = req[0];
+    uint16_t count = mbReadU16(&req[3]);
+
+    if (event == Modbus::EX_SUCCESS) {
+        pdu[0] = fc;
+        if (fc == 0x01 || fc == 0x02) {
+            pdu[1] = (count + 7) / 8;
+            memset(&pdu[2], 0, pdu[1]);
+            for (uint16_t i = 0; i < count; i++) {
+                if (rtu_poll_buf.bits[i]) pdu[2 + i / 8] |= (1 << (i % 8));
+            }
+            pduLen = 2 + pdu[1];
+        } else if (fc == 0x03 || fc == 0x04) {
+            pdu[1] = count * 2;
+            for (uint16_t i = 0; i < count; i++) {
+                mbWriteU16(&pdu[2 + i * 2], rtu_poll_buf.regs[i]);
+            }
+            pduLen = 2 + pdu[1];
+        } else {
+            memcpy(pdu, req, 5);    // Writes echo address and value/quantity
+            pduLen = 5;
+            tcpModbusGatewayCacheInvalidate(active.adu[6]);
+        }
+        if (tcpModbusGatewayIsRead(fc)) tcpModbusGatewayCacheStore(active.adu, pdu, pduLen);
+    } else {
+        pdu[0] = fc | 0x80;
+        pdu[1] = tcpModbusGatewayExceptionFor(event);
+        pduLen = 2;
+        mb_gw_failures++;
+    }
+
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_QUEUE; i++) {
+        TCPModbusGwRequest& r = mb_gw_queue[i];
+        if (!r.used) continue;
+        bool same = (&r == &active);
+        if (!same && !r.sent && tcpModbusGatewayIsRead(fc) && r.adu[6] == active.adu[6] &&
+            memcmp(&r.adu[MB_MBAP_HEADER_LEN], req, 5) == 0) {
+            same = true;
+            mb_gw_shared++;
+        }
+        if (!same) continue;
+        replyTo[replies].slot = r.slot;
+        replyTo[replies].session = r.session;
+        replyTo[replies].startedUs = r.startedUs;
+        memcpy(replyTo[replies].mbap, r.adu, MB_MBAP_HEADER_LEN);
+        replies++;
+        r.used = false;
+    }
+    tcpModbusGatewayUnlock();
+
+    for (uint8_t i = 0; i < replies; i++) {
+        tcpModbusGatewayReply(replyTo[i], pdu, pduLen);
+    }
+    return true;
+}
+
+// Issue one request through mb. Returns mb's transaction ID, 0 if the bus
+// was busy.
+static uint16_t tcpModbusGatewaySubmit(const TCPModbusGwRequest& r) {
+    const uint8_t* req = &r.adu[MB_MBAP_HEADER_LEN];
+    uint8_t unit = r.adu[6];
+    uint16_t addr = mbReadU16(&req[1]);
+    uint16_t count = mbReadU16(&req[3]);
+
+    switch (req[0]) {
+        case 0x01: return mb.readCoil(unit, addr, rtu_poll_buf.bits, count, tcpModbusGatewayDone);
+        case 0x02: return mb.readIsts(unit, addr, rtu_poll_buf.bits, count, tcpModbusGatewayDone);
+        case 0x03: return mb.readHreg(unit, addr, rtu_poll_buf.regs, count, tcpModbusGatewayDone);
+        case 0x04: return mb.readIreg(unit, addr, rtu_poll_buf.regs, count, tcpModbusGatewayDone);
+        case 0x05: return mb.writeCoil(unit, addr, count == 0xFF00, tcpModbusGatewayDone);
+        case 0x06: return mb.writeHreg(unit, addr, count, tcpModbusGatewayDone);
+        case 0x0F:
+            for (uint16_t i = 0; i < count; i++) {
+                rtu_poll_buf.bits[i] = (req[6 + i / 8] >> (i % 8)) & 0x01;
+            }
+            return mb.writeCoil(unit, addr, rtu_poll_buf.bits, count, tcpModbusGatewayDone);
+        case 0x10:
+            for (uint16_t i = 0; i < count; i++) {
+                rtu_poll_buf.regs[i] = mbReadU16(&req[6 + i * 2]);
             }
+            return mb.writeHreg(unit, addr, rtu_poll_buf.regs, count, tcpModbusGatewayDone);
+    }
+    return 0;
+}
+
+// Installed as rtu_bus_hook: expire stale requests, then put the oldest
+// waiting request on the bus if it is free
+static void tcpModbusGatewayBus() {
+    TCPModbusGwReplyTo expired[TCP_MODBUS_GW_QUEUE];
+    uint8_t expiredFc[TCP_MODBUS_GW_QUEUE];
+    uint8_t expiredCount = 0;
+    unsigned long now = millis();
+
+    tcpModbusGatewayLock();
+    // ModbusRTU never reported the request on the bus: answer 0x0B and
+    // free the bus. A late reply finds mb_gw_active < 0 and is dropped.
+    if (mb_gw_active >= 0 && now - mb_gw_queue[mb_gw_active].sentAt > RTU_POLL_STUCK_MS) {
+        TCPModbusGwRequest& r = mb_gw_queue[mb_gw_active];
+        expired[expiredCount].slot = r.slot;
+        expired[expiredCount].session = r.session;
+        expired[expiredCount].startedUs = r.startedUs;
+        memcpy(expired[expiredCount].mbap, r.adu, MB_MBAP_HEADER_LEN);
+        expiredFc[expiredCount++] = r.adu[MB_MBAP_HEADER_LEN];
+        r.used = false;
+        mb_gw_active = -1;
+        mb_gw_failures++;
+        rtuBusReleased();
+    }
+
+    int8_t next = -1;
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_QUEUE; i++) {
+        TCPModbusGwRequest& r = mb_gw_queue[i];
+        if (!r.used || r.sent) continue;
+        if (now - r.queuedAt > TCP_MODBUS_GW_TIMEOUT) {
+            expired[expiredCount].slot = r.slot;
+            expired[expiredCount].session = r.session;
+            expired[expiredCount].startedUs = r.startedUs;
+            memcpy(expired[expiredCount].mbap, r.adu, MB_MBAP_HEADER_LEN);
+            expiredFc[expiredCount++] = r.adu[MB_MBAP_HEADER_LEN];
+            r.used = false;
+            mb_gw_failures++;
+            continue;
+        }
+        if (next < 0 || (long)(r.queuedAt - mb_gw_queue[next].queuedAt) < 0) next = i;
+    }
+
+    if (next >= 0 && mb_gw_active < 0 && rtuBusReady()) {
+        TCPModbusGwRequest& r = mb_gw_queue[next];
+        mb_gw_active = next;
+        r.sent = true;
+        r.sentAt = now;
+        if (tcpModbusGatewaySubmit(r)) {
+            mb_gw_forwarded++;
+        } else {
+            mb_gw_active = -1;
+            r.sent = false;
         }
+    }
+    tcpModbusGatewayUnlock();
 
-        yield(); // Before client operations
-        if (mbWifiClient && mbWifiClient.connected()) {
-            yield(); // Before available check
-            if (mbWifiClient.available()) {
-                uint8_t frame[260];
-                uint16_t len = 0;
-                unsigned long startTime = millis();
-                
-                // Read with strict timeout - max 50ms
-                while (mbWifiClient.available() && len < 260 && (millis() - startTime < 50)) {
-                    frame[len++] = mbWifiClient.read();
-                    delayMicroseconds(100);
-                    
-                    // Feed watchdog every 10 bytes
-                    if (len % 10 == 0) {
-                        yield(); // Feed watchdog
-                    }
-                }
-                
-                if (len >= 8) {
-                    processModbusFrame(frame, len, mbWifiClient);
-                }
+    for (uint8_t i = 0; i < expiredCount; i++) {
+        uint8_t pdu[2] = { (uint8_t)(expiredFc[i] | 0x80), MB_EX_GATEWAY_TARGET };
+        tcpModbusGatewayReply(expired[i], pdu, 2);
+    }
+}
+
+// Parse a unit list such as "1-5,9" into the forwarding bitmap. An empty
+// list or "off" disables the gateway.
+bool tcpModbusSetGatewayUnits(const String& units) {
+    uint8_t bitmap[32] = {0};
+    bool any = false;
+    if (units.length() > 0 && units != "off") {
+        int pos = 0;
+        while (pos < (int)units.length()) {
+            int comma = units.indexOf(',', pos);
+            if (comma < 0) comma = units.length();
+            String part = units.substring(pos, comma);
+            part.trim();
+            int dash = part.indexOf('-');
+            int first = (dash > 0) ? part.substring(0, dash).toInt() : part.toInt();
+            int last = (dash > 0) ? part.substring(dash + 1).toInt() : first;
+            if (first < 1 || last > 247 || last < first) return false;
+            for (int u = first; u <= last; u++) {
+                bitmap[u / 8] |= (1 << (u % 8));
             }
+            any = true;
+            pos = comma + 1;
         }
     }
+
+    if (!mb_gw_lock) mb_gw_lock = xSemaphoreCreateMutex();
+    tcpModbusGatewayLock();
+    memcpy(mb_gw_units, bitmap, sizeof(mb_gw_units));
+    mb_gw_enabled = any;
+    tcpModbusGatewayUnlock();
+    if (any) rtu_bus_hook = tcpModbusGatewayBus;
+    return true;
+}
+
+void tcpModbusSetGatewayCache(uint32_t maxAgeMs) {
+    tcpModbusGatewayLock();
+    mb_gw_cache_ms = maxAgeMs;
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_CACHE; i++) {
+        mb_gw_cache[i].valid = false;
+    }
+    tcpModbusGatewayUnlock();
+}
+
+void tcpModbusPrintGatewayStatus() {
+    Serial.println("=== TCP Modbus RTU Gateway ===");
+    Serial.printf("Enabled: %s\n", mb_gw_enabled ? "Yes" : "No");
+    Serial.printf("Units: %s\n", tcpModbusPref.getString("gwunits", "").c_str());
+    Serial.printf("Cache max-age: %lu ms\n", (unsigned long)mb_gw_cache_ms);
+    uint8_t queued = 0;
+    for (uint8_t i = 0; i < TCP_MODBUS_GW_QUEUE; i++) {
+        if (mb_gw_queue[i].used) queued++;
+    }
+    Serial.printf("Queued: %d/%d\n", queued, TCP_MODBUS_GW_QUEUE);
+    Serial.printf("Forwarded: %lu, cache hits: %lu, shared: %lu, failed: %lu, late replies: %lu\n",
+                  (unsigned long)mb_gw_forwarded, (unsigned long)mb_gw_cache_hits,
+                  (unsigned long)mb_gw_shared, (unsigned long)mb_gw_failures, (unsigned long)mb_gw_stale);
+    Serial.println("==============================");
+}
+
+// ==================== LOOP ====================
+
+// One unthrottled pass over the server: accept, reap, then service every
+// client round-robin. Returns the number of requests answered.
+static uint16_t tcpModbusPoll() {
+    uint16_t frames = 0;
+
+    tcpModbusAcceptClients();
+    tcpModbusReapClients();
+
+    // Round-robin: start one slot further each pass so no client is
+    // always served first
+    uint8_t start = mb_rr_next;
+    for (uint8_t n = 0; n < mb_max_clients; n++) {
+        uint8_t i = (start + n) % mb_max_clients;
+        if (mb_clients[i].active) {
+            frames += tcpModbusServiceClient(i);
+        }
+    }
+    mb_rr_next = (start + 1) % mb_max_clients;
+    return frames;
+}
+
+// Ethernet (W5500) and lwIP sockets are not safe to drive from two tasks at
+// once. In task mode other users of the network interface (MQTT, web server)
+// should bracket their calls with these; both are no-ops otherwise.
+void tcpModbusLockNetwork() {
+    if (mb_net_lock) xSemaphoreTake(mb_net_lock, portMAX_DELAY);
+}
+
+void tcpModbusUnlockNetwork() {
+    if (mb_net_lock) xSemaphoreGive(mb_net_lock);
+}
+
+// For loop-driven users that would rather skip a round than wait out
+// another task's slow operation (e.g. an MQTT connect attempt)
+bool tcpModbusTryLockNetwork(uint32_t waitMs) {
+    if (!mb_net_lock) return true;
+    return xSemaphoreTake(mb_net_lock, pdMS_TO_TICKS(waitMs)) == pdTRUE;
+}
+
+// The lock itself, created on first use, for users on other tasks (the
+// MQTT connection task) that need it even when the server is not in task
+// mode
+SemaphoreHandle_t tcpModbusNetworkLock() {
+    if (!mb_net_lock) mb_net_lock = xSemaphoreCreateMutex();
+    return mb_net_lock;
+}
+
+// Wake the server task early, e.g. from a W5500 INTn edge
+void IRAM_ATTR tcpModbusNotifyFromISR() {
+    if (!mb_task_handle) return;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(mb_task_handle, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static void tcpModbusTask(void*) {
+    while (!mb_task_stop) {
+        xSemaphoreTake(mb_net_lock, portMAX_DELAY);
+        uint16_t frames = tcpModbusPoll();
+        xSemaphoreGive(mb_net_lock);
+
+        // Busy: go straight round again. Idle: block until notified or
+        // TCP_MODBUS_TASK_IDLE_MS has passed.
+        if (frames == 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TCP_MODBUS_TASK_IDLE_MS));
+        }
+    }
+    mb_task_handle = nullptr;
+    vTaskDelete(NULL);
+}
+
+bool tcpModbusStartTask(uint8_t core, uint8_t priority) {
+    if (mb_task_handle) return true;
+    tcpModbusNetworkLock();
+
+    mb_task_stop = false;
+    BaseType_t ok = xTaskCreatePinnedToCore(
+        tcpModbusTask,
+        "TCPModbusTask",
+        TCP_MODBUS_TASK_STACK,
+        nullptr,
+        priority,
+        &mb_task_handle,
+        core
+    );
+    if (ok != pdPASS) {
+        mb_task_handle = nullptr;
+        Serial.println("[TCPModbus] Failed to start server task");
+        return false;
+    }
+    Serial.printf("[TCPModbus] Server task running on core %d (priority %d)\n", core, priority);
+    return true;
+}
+
+void tcpModbusStopTask() {
+    if (!mb_task_handle) return;
+    mb_task_stop = true;
+    xTaskNotifyGive(mb_task_handle);
+    for (uint8_t i = 0; i < 100 && mb_task_handle; i++) {
+        delay(1);
+    }
+}
+
+bool tcpModbusTaskRunning() {
+    return mb_task_handle != nullptr;
+}
+
+void tcpModbusLoop() {
+    if (!mb_running) return;
+    if (mb_task_handle) return; // Serviced by TCPModbusTask
+    
+    yield(); // Feed watchdog at start of loop
+    
+    // One pass per TCP_MODBUS_LOOP_INTERVAL_MS; see the latency note at
+    // the server task
+    static unsigned long lastCheck = 0;
+    unsigned long now = millis();
+    if (now - lastCheck < TCP_MODBUS_LOOP_INTERVAL_MS) {
+        return;
+    }
+    if (!tcpModbusTryLockNetwork(1)) return;    // Another task is using the interface
+    lastCheck = now;
+
+    tcpModbusPoll();
+    tcpModbusUnlockNetwork();
     
     // Feed watchdog at end of loop
     yield();
 }
 
 void tcpModbusStop() {
+    tcpModbusStopTask();
+    for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+        tcpModbusReleaseSlot(i, "server stopped");
+    }
     if (ethModbusServer) delete ethModbusServer;
     if (wifiModbusServer) delete wifiModbusServer;
     ethModbusServer = nullptr;
@@ -453,6 +1435,14 @@ void printTCPModbusHelp() {
     Serial.println("  tcpmodbus slaveid <id>   - Set Slave ID");
     Serial.println("  tcpmodbus port <p>       - Set port");
     Serial.println("  tcpmodbus transport <t>  - wifi/ethernet/auto");
+    Serial.printf("  tcpmodbus maxclients <n> - Max simultaneous clients (1-%d)\n", TCP_MODBUS_MAX_CLIENTS);
+    Serial.println("  tcpmodbus idletimeout <s>- Drop silent clients after s seconds (0=never)");
+    Serial.println("  tcpmodbus task <on|off>  - Run server on its own task (next start)");
+    Serial.println("  tcpmodbus latency [reset]- Show p50/p99 service time");
+    Serial.println("  tcpmodbus stats [reset]  - Request counters and per-FC/client latency");
+    Serial.println("  tcpmodbus map            - Show register map");
+    Serial.println("  tcpmodbus gateway <units>- Forward unit IDs to RS485, e.g. 1-5,9 (off)");
+    Serial.println("  tcpmodbus gwcache <ms>   - Gateway read cache max-age (0=off)");
     Serial.println("  tcpmodbus status         - Show status");
     Serial.println("  tcpmodbus debug          - Toggle debug mode");
     Serial.println("========================================");
@@ -506,11 +1496,112 @@ void handleTCPModbusCommand(String args) {
             Serial.printf("[TCPModbus] Port: %d\n", port);
         }
     }
+    else if (subCmd == "maxclients") {
+        int maxClients = subArgs.toInt();
+        if (maxClients >= 1 && maxClients <= TCP_MODBUS_MAX_CLIENTS) {
+            tcpModbusPref.end();
+            tcpModbusPref.begin("tcpmodbus", false);
+            tcpModbusPref.putUChar("maxclients", maxClients);
+            tcpModbusPref.end();
+            tcpModbusPref.begin("tcpmodbus", true);
+            tcpModbusSetMaxClients(maxClients);
+            Serial.printf("[TCPModbus] Max clients: %d\n", maxClients);
+        } else {
+            Serial.printf("[TCPModbus] Max clients must be 1-%d\n", TCP_MODBUS_MAX_CLIENTS);
+        }
+    }
+    else if (subCmd == "idletimeout") {
+        int seconds = subArgs.toInt();
+        if (seconds >= 0 && seconds < 65536) {
+            tcpModbusPref.end();
+            tcpModbusPref.begin("tcpmodbus", false);
+            tcpModbusPref.putUShort("idletimeout", seconds);
+            tcpModbusPref.end();
+            tcpModbusPref.begin("tcpmodbus", true);
+            tcpModbusSetIdleTimeout(seconds);
+            Serial.printf("[TCPModbus] Idle timeout: %ds\n", seconds);
+        }
+    }
+    else if (subCmd == "task") {
+        bool on = (subArgs == "on" || subArgs == "enable" || subArgs == "1");
+        tcpModbusPref.end();
+        tcpModbusPref.begin("tcpmodbus", false);
+        tcpModbusPref.putBool("taskmode", on);
+        tcpModbusPref.end();
+        tcpModbusPref.begin("tcpmodbus", true);
+        Serial.printf("[TCPModbus] Task mode: %s (applies on next start)\n", on ? "ON" : "OFF");
+    }
+    else if (subCmd == "latency") {
+        if (subArgs == "reset") {
+            tcpModbusResetServiceStats();
+            Serial.println("[TCPModbus] Service stats reset");
+            return;
+        }
+        uint32_t p50, p99, maxUs, total;
+        tcpModbusGetServiceStats(&p50, &p99, &maxUs, &total);
+        Serial.println("=== TCP Modbus Service Time ===");
+        Serial.printf("Mode: %s\n", mb_task_handle ? "task" : "boardloop");
+        Serial.printf("Requests: %lu\n", (unsigned long)total);
+        Serial.printf("p50: %lu us\n", (unsigned long)p50);
+        Serial.printf("p99: %lu us\n", (unsigned long)p99);
+        Serial.printf("max: %lu us\n", (unsigned long)maxUs);
+        Serial.println("===============================");
+    }
+    else if (subCmd == "stats") {
+        if (subArgs == "reset") {
+            tcpModbusResetStats();
+            Serial.println("[TCPModbus] Statistics reset");
+            return;
+        }
+        tcpModbusPrintStats();
+    }
+    else if (subCmd == "map") {
+        modbusMapPrint();
+    }
+    else if (subCmd == "gateway") {
+        if (subArgs.length() == 0) {
+            tcpModbusPrintGatewayStatus();
+            return;
+        }
+        if (!tcpModbusSetGatewayUnits(subArgs)) {
+            Serial.println("[TCPModbus] Units must be 1-247, e.g. 1-5,9");
+            return;
+        }
+        tcpModbusPref.end();
+        tcpModbusPref.begin("tcpmodbus", false);
+        tcpModbusPref.putString("gwunits", subArgs == "off" ? "" : subArgs);
+        tcpModbusPref.end();
+        tcpModbusPref.begin("tcpmodbus", true);
+        Serial.printf("[TCPModbus] Gateway: %s\n", mb_gw_enabled ? subArgs.c_str() : "off");
+    }
+    else if (subCmd == "gwcache") {
+        int ms = subArgs.toInt();
+        if (ms >= 0 && ms < 65536) {
+            tcpModbusPref.end();
+            tcpModbusPref.begin("tcpmodbus", false);
+            tcpModbusPref.putUShort("gwcache", ms);
+            tcpModbusPref.end();
+            tcpModbusPref.begin("tcpmodbus", true);
+            tcpModbusSetGatewayCache(ms);
+            Serial.printf("[TCPModbus] Gateway cache max-age: %d ms\n", ms);
+        }
+    }
     else if (subCmd == "status") {
         Serial.println("=== TCP Modbus Status ===");
         Serial.printf("Enabled: %s\n", tcpModbusPref.getBool("enabled", false) ? "Yes" : "No");
         Serial.printf("Running: %s\n", mb_running ? "Yes" : "No");
         Serial.printf("Port: %d\n", tcpModbusPref.getUShort("port", 502));
+        Serial.printf("Task mode: %s\n", mb_task_handle ? "running" : (tcpModbusPref.getBool("taskmode", false) ? "configured" : "off"));
+        Serial.printf("RTU gateway: %s\n", mb_gw_enabled ? tcpModbusPref.getString("gwunits", "").c_str() : "off");
+        Serial.printf("Clients: %d/%d (idle timeout %lus)\n", tcpModbusGetClientCount(), mb_max_clients, (unsigned long)(mb_idle_timeout_ms / 1000));
+        for (uint8_t i = 0; i < TCP_MODBUS_MAX_CLIENTS; i++) {
+            TCPModbusClientSlot& slot = mb_clients[i];
+            if (!slot.active) continue;
+            IPAddress ip = mb_use_ethernet ? slot.eth.remoteIP() : slot.wifi.remoteIP();
+            Serial.printf("  [%d] %s  up %lus  idle %lus  requests %lu\n", i, ip.toString().c_str(),
+                          (millis() - slot.connectedAt) / 1000, (millis() - slot.lastActivity) / 1000,
+                          (unsigned long)slot.requests);
+        }
         Serial.println("=========================");
     }
     else if (subCmd == "debug") {
@@ -527,6 +1618,8 @@ struct TCPModbusConfig {
     uint8_t slaveId;
     uint16_t port;
     uint8_t transport;
+    uint8_t maxClients;
+    uint16_t idleTimeout;
 };
 
 TCPModbusConfig getTCPModbusConfig() {
@@ -535,6 +1628,8 @@ TCPModbusConfig getTCPModbusConfig() {
     config.slaveId = tcpModbusPref.getUChar("slaveid", 1);
     config.port = tcpModbusPref.getUShort("port", 502);
     config.transport = tcpModbusPref.getUChar("transport", TRANSPORT_AUTO);
+    config.maxClients = tcpModbusPref.getUChar("maxclients", TCP_MODBUS_MAX_CLIENTS);
+    config.idleTimeout = tcpModbusPref.getUShort("idletimeout", TCP_MODBUS_IDLE_TIMEOUT);
     return config;
 }
 
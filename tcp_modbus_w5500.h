@@ -18,22 +18,12 @@ extern Preferences tcpModbusPref;
 // External reference to Ethernet client (for W5500)
 extern EthernetClient ethClient;
 
-// Transport type enum
-enum TCPModbusTransport {
-    TRANSPORT_WIFI = 0,
-    TRANSPORT_ETHERNET = 1,
-    TRANSPORT_AUTO = 2
-};
-
 // ==================== MODBUS REGISTER DEFINITIONS ====================
-#define MB_REG_HOLDING_START        0
-#define MB_REG_HOLDING_COUNT        100
-#define MB_REG_INPUT_START          0
-#define MB_REG_INPUT_COUNT          100
-#define MB_REG_COIL_START           0
-#define MB_REG_COIL_COUNT           64
-#define MB_REG_DISCRETE_START       0
-#define MB_REG_DISCRETE_COUNT       64
+// Register storage lives in the runtime register map, shared with the other
+// backends; ModbusIP only holds placeholders whose get/set callbacks go to
+// the map. Application access (tcpModbusSet*/Get*) is in
+// modbus_register_store.h.
+#include "modbus_register_store.h"
 
 // Modbus IP object
 static ModbusIP* mbTCP = nullptr;
@@ -220,96 +210,139 @@ void handleTCPModbusCommand(String args) {
     }
 }
 
-// ==================== REGISTER ACCESS FUNCTIONS ====================
+// ==================== MODBUSIP BINDING ====================
+// ModbusIP keeps its own register list and serves requests from it. The map
+// stays the source of truth: before a request the addressed range is copied
+// from the map into ModbusIP's placeholders in one seqlock read, and after
+// a successful write the written range is copied back in one write section.
+// A multi-register read or write is therefore one consistent snapshot,
+// like the other backends, instead of one map access per register.
 
-// Holding Register functions
-bool tcpModbusSetHoldingRegister(uint16_t address, uint16_t value) {
-    if (!mbTCP || address >= MB_REG_HOLDING_COUNT) return false;
-    mbTCP->Hreg(address, value);
-    return true;
-}
+#define TCP_MODBUS_IP_MAX_WORDS  125    // FC03 limit; also holds 2000 packed bits (FC01)
 
-uint16_t tcpModbusGetHoldingRegister(uint16_t address) {
-    if (!mbTCP || address >= MB_REG_HOLDING_COUNT) return 0;
-    return mbTCP->Hreg(address);
-}
+static uint16_t mb_ip_buf[TCP_MODBUS_IP_MAX_WORDS];
 
-bool tcpModbusSetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (!mbTCP || startAddress + count > MB_REG_HOLDING_COUNT) return false;
-    for (uint16_t i = 0; i < count; i++) {
-        mbTCP->Hreg(startAddress + i, values[i]);
+static ModbusRegType tcpModbusIPType(const TAddress& reg) {
+    switch (reg.type) {
+        case TAddress::COIL: return MB_TYPE_COIL;
+        case TAddress::ISTS: return MB_TYPE_DISCRETE;
+        case TAddress::IREG: return MB_TYPE_INPUT;
+        default: return MB_TYPE_HOLDING;
     }
-    return true;
 }
 
-bool tcpModbusGetHoldingRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (!mbTCP || startAddress + count > MB_REG_HOLDING_COUNT) return false;
-    for (uint16_t i = 0; i < count; i++) {
-        values[i] = mbTCP->Hreg(startAddress + i);
-    }
-    return true;
+static bool tcpModbusIPFits(ModbusRegType type, uint16_t count) {
+    if (count == 0) return false;
+    return count <= (modbusMapIsBitType(type) ? TCP_MODBUS_IP_MAX_WORDS * 16 : TCP_MODBUS_IP_MAX_WORDS);
 }
 
-// Input Register functions
-bool tcpModbusSetInputRegister(uint16_t address, uint16_t value) {
-    if (!mbTCP || address >= MB_REG_INPUT_COUNT) return false;
-    mbTCP->Ireg(address, value);
-    return true;
-}
-
-uint16_t tcpModbusGetInputRegister(uint16_t address) {
-    if (!mbTCP || address >= MB_REG_INPUT_COUNT) return 0;
-    return mbTCP->Ireg(address);
-}
+// Map -> placeholders. Addresses outside the map are left alone; ModbusIP
+// rejects those itself.
+static void tcpModbusIPLoad(const TAddress& reg, uint16_t count) {
+    ModbusRegType type = tcpModbusIPType(reg);
+    if (!tcpModbusIPFits(type, count)) return;
+    bool bits = modbusMapIsBitType(type);
+
+    uint32_t seq;
+    do {
+        seq = modbusMapReadBegin();
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t address = reg.address + i;
+            if (bits) {
+                if (modbusMapGetBit(type, address)) mb_ip_buf[i / 16] |= (1 << (i % 16));
+                else mb_ip_buf[i / 16] &= ~(1 << (i % 16));
+            } else {
+                const uint16_t* value = modbusMapRegisters(type, address);
+                mb_ip_buf[i] = value ? *value : 0;
+            }
+        }
+    } while (modbusMapReadRetry(seq));
 
-bool tcpModbusSetInputRegisters(uint16_t startAddress, uint16_t* values, uint16_t count) {
-    if (!mbTCP || startAddress + count > MB_REG_INPUT_COUNT) return false;
     for (uint16_t i = 0; i < count; i++) {
-        mbTCP->Ireg(startAddress + i, values[i]);
+        uint16_t address = reg.address + i;
+        switch (type) {
+            case MB_TYPE_HOLDING:  mbTCP->Hreg(address, mb_ip_buf[i]); break;
+            case MB_TYPE_INPUT:    mbTCP->Ireg(address, mb_ip_buf[i]); break;
+            case MB_TYPE_COIL:     mbTCP->Coil(address, (mb_ip_buf[i / 16] >> (i % 16)) & 0x01); break;
+            case MB_TYPE_DISCRETE: mbTCP->Ists(address, (mb_ip_buf[i / 16] >> (i % 16)) & 0x01); break;
+        }
     }
-    return true;
 }
 
-// Coil functions
-bool tcpModbusSetCoil(uint16_t address, bool value) {
-    if (!mbTCP || address >= MB_REG_COIL_COUNT) return false;
-    mbTCP->Coil(address, value);
-    return true;
-}
+// Placeholders -> map, then one write notification for the whole range
+static void tcpModbusIPStore(const TAddress& reg, uint16_t count) {
+    ModbusRegType type = tcpModbusIPType(reg);
+    if (!tcpModbusIPFits(type, count)) return;
+    bool bits = modbusMapIsBitType(type);
 
-bool tcpModbusGetCoil(uint16_t address) {
-    if (!mbTCP || address >= MB_REG_COIL_COUNT) return false;
-    return mbTCP->Coil(address);
-}
-
-// Discrete Input functions
-bool tcpModbusSetDiscreteInput(uint16_t address, bool value) {
-    if (!mbTCP || address >= MB_REG_DISCRETE_COUNT) return false;
-    mbTCP->Ists(address, value);
-    return true;
+    bool ok = false;
+    modbusMapWriteBegin();
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t address = reg.address + i;
+        if (bits) {
+            ok |= modbusMapSetBit(type, address, mbTCP->Coil(address));
+        } else {
+            uint16_t* value = modbusMapRegisters(type, address);
+            if (!value) continue;
+            *value = mbTCP->Hreg(address);
+            ok = true;
+        }
+    }
+    modbusMapWriteEnd();
+    if (ok) modbusMapNotifyWrite(type, reg.address, count);
 }
 
-bool tcpModbusGetDiscreteInput(uint16_t address) {
-    if (!mbTCP || address >= MB_REG_DISCRETE_COUNT) return false;
-    return mbTCP->Ists(address);
+static Modbus::ResultCode tcpModbusIPOnRequest(Modbus::FunctionCode fc, const Modbus::RequestData data) {
+    switch (fc) {
+        case Modbus::FC_READ_COILS:
+        case Modbus::FC_READ_INPUT_STAT:
+        case Modbus::FC_READ_REGS:
+        case Modbus::FC_READ_INPUT_REGS:
+        case Modbus::FC_MASKWRITE_REG:      // Masks the current value
+            tcpModbusIPLoad(data.reg, data.regCount);
+            break;
+        case Modbus::FC_READWRITE_REGS:     // Write is applied to the placeholders first
+            tcpModbusIPLoad(data.regRead, data.regReadCount);
+            break;
+        default:
+            break;
+    }
+    return Modbus::EX_SUCCESS;
 }
 
-// Float helper functions
-bool tcpModbusSetHoldingFloat(uint16_t address, float value) {
-    if (!mbTCP || address + 1 >= MB_REG_HOLDING_COUNT) return false;
-    uint16_t* ptr = (uint16_t*)&value;
-    mbTCP->Hreg(address, ptr[1]);     // High word
-    mbTCP->Hreg(address + 1, ptr[0]); // Low word
-    return true;
+static Modbus::ResultCode tcpModbusIPOnSuccess(Modbus::FunctionCode fc, const Modbus::RequestData data) {
+    switch (fc) {
+        case Modbus::FC_WRITE_COIL:
+        case Modbus::FC_WRITE_COILS:
+        case Modbus::FC_WRITE_REG:
+        case Modbus::FC_WRITE_REGS:
+        case Modbus::FC_MASKWRITE_REG:
+        case Modbus::FC_READWRITE_REGS:
+            tcpModbusIPStore(data.reg, data.regCount);
+            break;
+        default:
+            break;
+    }
+    return Modbus::EX_SUCCESS;
 }
 
-float tcpModbusGetHoldingFloat(uint16_t address) {
-    if (!mbTCP || address + 1 >= MB_REG_HOLDING_COUNT) return 0.0f;
-    float value;
-    uint16_t* ptr = (uint16_t*)&value;
-    ptr[1] = mbTCP->Hreg(address);     // High word
-    ptr[0] = mbTCP->Hreg(address + 1); // Low word
-    return value;
+// Add one placeholder range per map block and route requests to the map
+static void tcpModbusIPAddBlocks() {
+    modbusMapEnsure();
+    for (uint8_t t = 0; t < MB_TYPE_COUNT; t++) {
+        const ModbusRegTable& table = mb_map[t];
+        for (uint8_t b = 0; b < table.count; b++) {
+            const ModbusRegBlock& block = table.blocks[b];
+            switch (t) {
+                case MB_TYPE_HOLDING:  mbTCP->addHreg(block.start, 0, block.count); break;
+                case MB_TYPE_INPUT:    mbTCP->addIreg(block.start, 0, block.count); break;
+                case MB_TYPE_COIL:     mbTCP->addCoil(block.start, false, block.count); break;
+                case MB_TYPE_DISCRETE: mbTCP->addIsts(block.start, false, block.count); break;
+            }
+        }
+    }
+    mbTCP->onRequest(tcpModbusIPOnRequest);
+    mbTCP->onRequestSuccess(tcpModbusIPOnSuccess);
 }
 
 // ==================== MODBUS INITIALIZATION ====================
@@ -374,20 +407,9 @@ bool tcpModbusInit() {
         Serial.printf("[TCPModbus] Server started on port %d\n", port);
     }
 
-    // Add all registers
+    // Register every map block with ModbusIP
     Serial.println("[TCPModbus] Adding registers...");
-    for (uint16_t i = 0; i < MB_REG_HOLDING_COUNT; i++) {
-        mbTCP->addHreg(i, 0);
-    }
-    for (uint16_t i = 0; i < MB_REG_INPUT_COUNT; i++) {
-        mbTCP->addIreg(i, 0);
-    }
-    for (uint16_t i = 0; i < MB_REG_COIL_COUNT; i++) {
-        mbTCP->addCoil(i, false);
-    }
-    for (uint16_t i = 0; i < MB_REG_DISCRETE_COUNT; i++) {
-        mbTCP->addIsts(i, false);
-    }
+    tcpModbusIPAddBlocks();
 
     mb_initialized = true;
     mb_running = true;
@@ -0,0 +1,66 @@
+#ifndef W5500_CONNECT_H
+#define W5500_CONNECT_H
+
+// Bounded TCP connect on the W5500.
+//
+// EthernetClient::connect() waits for the handshake for up to the client's
+// connection timeout, with the caller holding the network lock shared by
+// MQTT and Modbus. Here each attempt is the library's own connect() with
+// setConnectionTimeout() cut to a short slice, so the lock is never held
+// for longer than that. A peer that has not answered within the slice is
+// tried again on the next poll with the slice doubled, up to
+// W5500_CONNECT_SLICE_MAX_MS; a refusal ends the connect at once.
+//
+//   W5500Connect pending;
+//   pending.begin(ip, 502);
+//   ...
+//   int8_t result = pending.poll(client);      // Network lock held
+//
+// The caller gives up on its own overall timeout with abort().
+
+#include <Arduino.h>
+#include <Ethernet.h>
+
+#define W5500_CONNECT_SLICE_MS      10      // First attempt; a LAN peer answers well within it
+#define W5500_CONNECT_SLICE_MAX_MS  160     // Longest single wait under the lock
+
+struct W5500Connect {
+    IPAddress ip;
+    uint16_t port = 0;
+    uint16_t sliceMs = 0;       // Next attempt's wait; 0 when not connecting
+
+    void begin(IPAddress address, uint16_t remotePort) {
+        ip = address;
+        port = remotePort;
+        sliceMs = W5500_CONNECT_SLICE_MS;
+    }
+
+    bool active() const {
+        return sliceMs != 0;
+    }
+
+    // Nothing is left open between attempts, so there is no socket to close
+    void abort() {
+        sliceMs = 0;
+    }
+
+    // 1 connected, 0 not yet (poll again), -1 refused or no free socket
+    int8_t poll(EthernetClient& client) {
+        if (!sliceMs) return -1;
+        client.setConnectionTimeout(sliceMs);
+        unsigned long started = millis();
+        if (client.connect(ip, port) == 1) {
+            sliceMs = 0;
+            return 1;
+        }
+        // connect() only runs to the end of its timeout when nothing came back
+        if (millis() - started < sliceMs) {
+            sliceMs = 0;
+            return -1;
+        }
+        sliceMs = (sliceMs * 2 > W5500_CONNECT_SLICE_MAX_MS) ? W5500_CONNECT_SLICE_MAX_MS : sliceMs * 2;
+        return 0;
+    }
+};
+
+#endif // W5500_CONNECT_H